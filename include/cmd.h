@@ -5,8 +5,10 @@
  */
 #include <stdint.h>
 #define CMD_BUFF_SZ 4096
+// 入力バッファ($$TX/$$TXRAWはバッファせずにデコードするのでバイナリコマンドのフレームが入ればよい)
+#define CMD_IN_BUFF_SZ 1100
 
-typedef enum { CMD_STATE_WAIT = 0, CMD_STATE_BUFFERING_ASCII, CMD_STATE_BUFFERING_BIN, _CMD_STATE_CNT_ } CmdState;
+typedef enum { CMD_STATE_WAIT = 0, CMD_STATE_BUFFERING_ASCII, CMD_STATE_BUFFERING_BIN, CMD_STATE_STREAMING_ASCII, CMD_STATE_SKIPPING_BIN, _CMD_STATE_CNT_ } CmdState;
 
 typedef struct
 {
@@ -14,4 +16,5 @@ typedef struct
     uint16_t response_len;
 } CmdResponse;
 
+void CmdInit(void);
 CmdResponse *CmdParse(uint8_t b);
@@ -7,6 +7,7 @@
 #define CMD_ASCII_H
 
 #include <stdint.h>
+#include <zephyr/sys/iterable_sections.h>
 
 #define CMD_REG_W "W"
 #define CMD_REG_R "R"
@@ -14,10 +15,13 @@
 #define CMD_TX "$TX"
 #define CMD_RX "$RX"
 #define CMD_TXRAW "$TXRAW"
+#define CMD_OUTBOX "$OUTBOX"
 #define CMD_FPUT "$FPUT"
 #define CMD_FGET "$FGET"
 #define CMD_UNLOCK "$UNLOCK"
 #define CMD_UPDATE "$UPDATE"
+#define CMD_BAUD "$BAUD"
+#define CMD_TLSSTAT "$TLSSTAT"
 
 #define CMD_GNSS_ENABLE "$GNSSEN"
 #define CMD_GNSS_GET_STATUS "$GNSSSTAT"
@@ -29,6 +33,41 @@
 #define CMD_RES_CMDFAIL (-2)
 #define CMD_RES_LOCKED (-3)
 
+#define CMD_RX_SINK_SZ (1024) // $$RXで出力バッファのうちUARTへの送信に使う大きさ(残りにオブジェクトを溜める)
+
+typedef int (*CmdAsciiCmdFunc)(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len);
+typedef void (*CmdAsciiStreamBeginFunc)(void);
+typedef int (*CmdAsciiStreamPutFunc)(uint8_t c);
+typedef struct
+{
+    const char *cmd_name;
+    CmdAsciiCmdFunc cmd_func;
+    // ストリーム処理するコマンドのみ(コマンド名の後ろを1byteずつ受け取る)
+    CmdAsciiStreamBeginFunc stream_begin;
+    CmdAsciiStreamPutFunc stream_put;
+} CmdAsciiCmd;
+
+/**
+ * コマンドを登録する(各モジュールのソースに置く)
+ * 登録されたコマンドはCmdAsciiInit()でハッシュテーブルに載る
+ */
+#define CMD_ASCII_DEFINE(_id, _name, _func) STRUCT_SECTION_ITERABLE(CmdAsciiCmd, cmd_ascii_##_id) = {.cmd_name = _name, .cmd_func = _func}
+
+/**
+ * ストリーム処理するコマンドを登録する
+ * コマンド名の後ろは行をバッファせずに_putへ1byteずつ渡し、改行で_func(in_buff=NULL, in_len=0)を呼ぶ
+ */
+#define CMD_ASCII_DEFINE_STREAM(_id, _name, _begin, _put, _func) STRUCT_SECTION_ITERABLE(CmdAsciiCmd, cmd_ascii_##_id) = {.cmd_name = _name, .cmd_func = _func, .stream_begin = _begin, .stream_put = _put}
+
+int CmdAsciiResIllParam(uint8_t *out_buff, uint16_t out_buff_len);
+int CmdAsciiResOk(uint8_t *out_buff, uint16_t out_buff_len);
+int CmdAsciiResNg(uint8_t *out_buff, uint16_t out_buff_len);
+
+int CmdAsciiInit(void);
 int CmdAsciiParse(uint8_t *in_buff, uint16_t in_buff_len, uint8_t *out_buff, uint16_t out_buff_len);
 
+int CmdAsciiStreamBegin(const uint8_t *name, uint16_t name_len);
+int CmdAsciiStreamPut(uint8_t c);
+int CmdAsciiStreamEnd(uint8_t *out_buff, uint16_t out_buff_len);
+
 #endif
\ No newline at end of file
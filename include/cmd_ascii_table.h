@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _CMD_ASCII_TABLE_H_
+#define _CMD_ASCII_TABLE_H_
+
+#include <stdint.h>
+
+#include "cmd_ascii.h"
+
+/* コマンド名 -> コマンドのハッシュテーブル(FNV-1a, オープンアドレス法) */
+#define CMD_ASCII_HASH_SZ (64)
+
+void CmdAsciiTableClear(void);
+int CmdAsciiTableAdd(const CmdAsciiCmd *cmd);
+const CmdAsciiCmd *CmdAsciiTableLookup(const uint8_t *name, uint16_t len);
+const CmdAsciiCmd *CmdAsciiTableSlot(int idx);
+
+#endif
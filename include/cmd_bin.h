@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2021 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef CMD_BIN_H
+#define CMD_BIN_H
+
+#include <stdint.h>
+
+/*
+ * バイナリコマンドのフレーム
+ *  SOF(0x02) | OPCODE(1) | LENGTH(2, BigEndian) | PAYLOAD(LENGTH) | CRC(2, BigEndian)
+ * CRCはOPCODEからPAYLOADまでのCRC-16/CCITT-FALSE
+ *
+ * 応答はOPCODEの最上位ビットを立て、PAYLOADの先頭にステータスを置く
+ * SOFを受信した時点でエコーバックは止まり、応答を返した後に再開する
+ */
+#define CMD_BIN_SOF (0x02)
+#define CMD_BIN_HEADER_SZ (3) // OPCODE + LENGTH
+#define CMD_BIN_CRC_SZ (2)
+#define CMD_BIN_PAYLOAD_MAX (1024)
+#define CMD_BIN_TIMEOUT_MS (500) // バイト間タイムアウト
+
+#define CMD_BIN_OP_REG_W (0x01)
+#define CMD_BIN_OP_REG_R (0x02)
+#define CMD_BIN_OP_TX (0x10)
+#define CMD_BIN_OP_RX (0x11)
+#define CMD_BIN_OP_RES (0x80)
+
+#define CMD_BIN_RES_OK (0x00)
+#define CMD_BIN_RES_ILLPARM (0x01)
+#define CMD_BIN_RES_CMDFAIL (0x02)
+#define CMD_BIN_RES_CRC (0x03)
+#define CMD_BIN_RES_UNKNOWN (0x04)
+
+int CmdBinParse(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len);
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _CMD_JOB_H_
+#define _CMD_JOB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include "sipf/sipf_client_http.h"
+
+/*
+ * 非同期コマンド(REG_01_ASYNC=0x01のとき)
+ *  受け付けたら "+ACCEPT:<ID>" と "OK" を返し、完了したら "+TX:<ID>,<OTID>" か "+TX:<ID>,NG" を通知する
+ *  ジョブはリクエストコンテキストを別に確保するので、同期のコマンドと同時に実行できる
+ *  完了通知が割り込むと困るコマンド(XMODEMの転送など)の前にはCmdJobDrain()で実行中のジョブを待つ
+ *
+ * バッチ送信(REG_01_BATCH_WINDOWが0以外のとき)
+ *  最初の$$TXからREG_01_BATCH_WINDOWの間に受け付けた$$TXのオブジェクトを1つのOBJECTS_UPにまとめて送る
+ *  数(REG_01_BATCH_CNT)か大きさ(REG_01_BATCH_SZ)に達したら待たずに送る
+ *  まとめた$$TXにはそれぞれ同じOTIDを "+TX:<ID>,<OTID>" で通知する
+ *
+ * アウトボックス(REG_01_OUTBOX=0x01のとき)
+ *  送れなかった$$TXはフラッシュに溜めて "+TX:<ID>,QUEUED" を通知し、接続が戻ったらワークキューで送り直す
+ *
+ * 受信の先読み(REG_01_PREFETCHが0x00以外のとき)
+ *  $$RXでREMAINSが残っていれば、ワークキューで受信を続けてキューに溜める(rx_queue.h)
+ */
+#define CMD_JOB_CNT (4)                      // 同時に受け付けられるジョブの数
+#define CMD_JOB_PAYLOAD_SZ (BUFF_SZ - 12 - 1) // OBJECTS_UPのペイロードの最大長
+#define CMD_JOB_STACK_SZ (8192)
+#define CMD_JOB_PRIORITY (5)
+#define CMD_JOB_BATCH_MAX (16) // 1つのOBJECTS_UPにまとめる$$TXの数の上限
+
+typedef struct
+{
+    struct k_work work;
+    uint8_t id;
+    uint16_t len;
+    uint8_t payload[CMD_JOB_PAYLOAD_SZ];
+} CmdJob;
+
+void CmdJobInit(void);
+bool CmdJobIsAsync(void);
+CmdJob *CmdJobAlloc(void);
+void CmdJobFree(CmdJob *job);
+int CmdJobSubmitTx(CmdJob *job, uint16_t len);
+void CmdJobDrain(void);
+bool CmdJobStoreOutbox(const uint8_t *payload, uint16_t len);
+void CmdJobKickOutbox(void);
+void CmdJobKickPrefetch(void);
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _CMD_SINK_H_
+#define _CMD_SINK_H_
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
+
+/*
+ * コマンドの応答をUARTへ流しながら書くためのライタ
+ *  渡されたバッファを2つに分けて、片方を送信している間にもう片方へ書く
+ *  CmdSinkEnd()の戻り値をコマンドの戻り値にする(応答は送信済みなのでcmd.cからは何も送らない)
+ */
+typedef struct
+{
+    uint8_t *buff[2];
+    uint16_t sz;  // 片方のサイズ
+    uint16_t len; // 書き込み中のバッファに書いた長さ
+    uint8_t cur;  // 書き込み中のバッファ
+    struct k_sem sem_done[2];
+    int total; // UARTに渡したバイト数
+    int err;
+} CmdSink;
+
+void CmdSinkInit(CmdSink *sink, uint8_t *buff, uint16_t buff_len);
+int CmdSinkWrite(CmdSink *sink, const void *data, uint16_t len);
+int CmdSinkPuts(CmdSink *sink, const char *str);
+int CmdSinkPrintf(CmdSink *sink, const char *fmt, ...) __printf_like(2, 3);
+int CmdSinkHex(CmdSink *sink, const uint8_t *data, uint16_t len);
+int CmdSinkFlush(CmdSink *sink);
+int CmdSinkEnd(CmdSink *sink);
+
+#endif
@@ -17,6 +17,7 @@ int gnss_start();
 int gnss_stop();
 bool gnss_get_data(struct nrf_modem_gnss_pvt_data_frame *gps_data); // TRUE: fixed, FALSE: not fixed
 int gnss_log_dbg_nmea();
+const char *gnss_get_nmea(int idx);
 int gnss_strcpy_nmea(char *dest);
 
 #endif // GNSS_H
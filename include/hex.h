@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _HEX_H_
+#define _HEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+int HexNibble(uint8_t c);
+int HexToUint8(const uint8_t *src);
+
+size_t HexEncode(uint8_t *dst, const uint8_t *src, size_t len);
+int HexDecode(uint8_t *dst, const uint8_t *src, size_t len);
+
+#endif
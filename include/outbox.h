@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _OUTBOX_H_
+#define _OUTBOX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sipf/sipf_client_http.h"
+
+/*
+ * 送信できなかったOBJECTS_UPのペイロードをフラッシュ(NVS)に溜めておくリングバッファ
+ *  REG_01_OUTBOX=0x01のとき、失敗した$$TX/$$TXRAWのペイロードを保存する
+ *  接続が戻ったらまとめてOBJECTS_UP_RETRYで送り直す(一杯になったら古いものから捨てる)
+ */
+#define OUTBOX_ENTRY_SZ (BUFF_SZ - 12 - 1) // 1件のペイロードの最大長
+
+bool OutboxIsEnabled(void);
+int OutboxInit(void);
+int OutboxPut(const uint8_t *payload, uint16_t len);
+int OutboxDrain(void);
+int OutboxDepth(void);
+int64_t OutboxOldestAge(void);
+
+#endif
@@ -17,6 +17,15 @@ extern uint8_t bank00[240];
 #define REG_00_PW_LEN (uint8_t *)&bank00[0x80]
 #define REG_00_PASSWORD (char *)&bank00[0x90]
 
+/* BANK01: コマンド実行の設定 */
+extern uint8_t bank01[240];
+#define REG_01_ASYNC (uint8_t *)&bank01[0x00] // 0x01: $$TX/$$TXRAWを非同期で実行する
+#define REG_01_BATCH_WINDOW (uint8_t *)&bank01[0x01] // 非同期の$$TXをまとめて送るまで待つ時間(x10ms), 0x00: まとめない
+#define REG_01_BATCH_CNT (uint8_t *)&bank01[0x02]    // まとめる$$TXの数の上限, 0x00: CMD_JOB_BATCH_MAX
+#define REG_01_BATCH_SZ (uint8_t *)&bank01[0x03]     // まとめたペイロードがこの大きさ(x16byte)に達したら送る, 0x00: バッファいっぱいまで
+#define REG_01_OUTBOX (uint8_t *)&bank01[0x04]      // 0x01: 送れなかった$$TX/$$TXRAWをフラッシュに溜めて後で送り直す
+#define REG_01_PREFETCH (uint8_t *)&bank01[0x05]    // 0x01: REMAINSが0になるまで受信を先読みする, 0x02: 先読みして "+RX:<件数>" を通知する
+
 extern uint8_t reg_common[16];
 #define REG_CMN_FW_TYPE (uint8_t *)&reg_common[0x0]
 #define REG_CMN_VER_MJR (uint8_t *)&reg_common[0x1]
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _RX_QUEUE_H_
+#define _RX_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sipf/sipf_object.h"
+
+/*
+ * 受信の先読みキュー(REG_01_PREFETCHが0x00以外のとき)
+ *  OBJECTS_DOWNのREMAINSが0になるまでワークキューで受信を続けてRAMに溜めておき、$$RXは溜めたものから返す
+ *  サーバーから同じOTIDを受信したら(再送など)読み捨てる
+ */
+#define RX_QUEUE_OBJS_SZ (3072)   // 1件のOBJECTSの最大長($$RXが出力バッファに溜められる大きさと同じ)
+#define RX_QUEUE_OTID_HIST (16)   // 重複を確認するために覚えておくOTIDの数
+
+typedef struct
+{
+    SipfObjectDownHead head;
+    uint8_t objqty;
+    uint16_t len;
+    uint8_t objs[RX_QUEUE_OBJS_SZ]; // TYPE TAG_ID VALUE_LEN VALUEのまま
+} RxQueueMsg;
+
+bool RxQueueIsEnabled(void);
+bool RxQueueIsNotify(void);
+int RxQueueFetch(bool *queued);
+int RxQueueHead(RxQueueMsg **msg);
+RxQueueMsg *RxQueuePeek(void);
+void RxQueuePop(void);
+int RxQueueDepth(void);
+int RxQueueRemains(void);
+
+#endif
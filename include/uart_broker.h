@@ -10,30 +10,44 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
 #include <zephyr/drivers/uart.h>
 
 #define UART_TX_BUF_SZ (256)
 #define UART_RX_BUF_SZ (1024)
+#define UART_TX_DESC_CNT (8)
+
+typedef void (*UartBrokerTxDoneCb)(const uint8_t *data, int len, void *user_data);
 
 int UartBrokerInit(const struct device *uart);
 int UartBrokerTerm(void);
 bool UartBrokerSetEcho(bool echo);
+void UartBrokerSetEchoBreak(int byte);
+int UartBrokerFlush(int timeout_ms);
+int UartBrokerGetConfig(struct uart_config *cfg);
+int UartBrokerSetConfig(const struct uart_config *cfg);
 
 int UartBrokerPutByte(uint8_t byte);
 int UartBrokerPut(uint8_t *data, int len);
+int UartBrokerPutRef(const uint8_t *data, int len, UartBrokerTxDoneCb cb, void *user_data);
+int UartBrokerPutRefWait(struct k_sem *sem);
+int UartBrokerPutZeroCopy(const uint8_t *data, int len);
 int UartBrokerGetByte(uint8_t *byte);
 int UartBrokerGetByteTm(uint8_t *byte, int timeout_ms);
 int UartBrokerGet(uint8_t *data, int len);
+int UartBrokerGetTm(uint8_t *data, int len, int timeout_ms);
+int UartBrokerGetClaim(uint8_t **data, int len, int timeout_ms);
+int UartBrokerGetFinish(int len);
+int UartBrokerGetDropped(void);
+#ifdef CONFIG_SIPF_XMODEM_RECV_BENCH
+int UartBrokerFeedRx(const uint8_t *data, int len);
+#endif
 
 int UartBrokerPuts(const char *msg);
 
 void UartBrokerClearRecveiveQueue(void);
 
-#define UartBrokerPrint(...)                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                           \
-    {                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                  \
-        char msg[140];                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                 \
-        int len = sprintf(msg, __VA_ARGS__);                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                           \
-        UartBrokerPut((uint8_t *)msg, len);                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                            \
-    }
+int UartBrokerPrint(const char *fmt, ...) __printf_like(1, 2);
 
 #endif
\ No newline at end of file
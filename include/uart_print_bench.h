@@ -0,0 +1,11 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _UART_PRINT_BENCH_H_
+#define _UART_PRINT_BENCH_H_
+
+void UartPrintBench(void);
+
+#endif
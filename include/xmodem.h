@@ -6,7 +6,22 @@
 #ifndef _XMODEM_H_
 #define _XMODEM_H_
 
-#define XMODEM_SZ_BLOCK (128)
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * 受信は'C'で開始してCRC-16を要求し、応答がなければNAKでチェックサムに切り替える
+ * SOH(128Byte)とSTX(1024Byte)のどちらのブロックも受け付ける
+ * 送信は相手の要求が'C'ならCRC-16で1024Byteのブロック、NAKならチェックサムで128Byteのブロックを送る
+ *
+ * YMODEM-G(フロー制御の効いたUART向け)
+ *  'G'で始めて、ファイル名とサイズのヘッダブロック(BN=0)の後はACKを待たずにブロックを続けて送る
+ *  エラーがあれば再送せずにCANで転送全体をやめる
+ *  フロー制御が無いときは'C'で始めて、ヘッダブロックの後も1ブロックずつACKを返す(YMODEM)
+ */
+#define XMODEM_SZ_BLOCK (128)                             // SOHのブロックのデータ長
+#define XMODEM_SZ_BLOCK_1K (1024)                         // STX(XMODEM-1K)のブロックのデータ長
+#define XMODEM_SZ_BLOCK_BUFF (3 + XMODEM_SZ_BLOCK_1K + 2) // ブロックの最大長(SOH/STX BN BNC DATA CRC)
 
 typedef enum xmodem_recv_ret {
     XMODEM_RECV_RET_OK,
@@ -32,11 +47,18 @@ void XmodemEnd(void);
 int XmodemTransmitCancel(void);
 
 int XmodemReceiveStart(void);
-XmodemRecvRet XmodemReceiveBlock(uint8_t *bn, uint8_t *block, int time_out);
+int XmodemReceiveStartBatch(bool stream);
+XmodemRecvRet XmodemReceiveBlock(uint8_t *bn, uint8_t *block, uint16_t *sz_data, int time_out);
 int XmodemReceiveReqNextBlock(void);
 int XmodemReceiveReqCurrentBlock(void);
+int XmodemParseHeader(uint8_t *data, uint16_t sz_data, char **name, uint32_t *size);
+int XmodemReceiveBatchEnd(uint8_t *block, int time_out);
 
 XmodemSendRet XmodemSendWaitRequest(int time_out);
+int XmodemSendBlockSize(void);
+bool XmodemSendIsStream(void);
+XmodemSendRet XmodemSendHeader(const char *name, uint32_t size, int time_out);
+XmodemSendRet XmodemSendBatchEnd(int time_out);
 XmodemSendRet XmodemSendEnd(int time_out);
 XmodemSendRet XmodemSendBlock(uint8_t *bn, uint8_t *payload, int sz_payload, int time_out);
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _XMODEM_PIPE_H_
+#define _XMODEM_PIPE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "xmodem.h"
+
+/*
+ * XMODEMの受信をネットワークへの送信と並行して行うパイプライン
+ *  受信スレッドはブロックプールに空きがあればすぐにACKを返して次のブロックを受信する
+ *  受信したブロックは順番にXmodemPipeGet()で取り出して、使い終わったらXmodemPipeFree()で返す
+ */
+#define XMODEM_PIPE_BLOCK_CNT (4) // ブロックプールの数
+#define XMODEM_PIPE_STACK_SZ (2048)
+#define XMODEM_PIPE_PRIORITY (5)
+
+typedef struct
+{
+    uint16_t sz_data;                    // データ長
+    uint8_t block[XMODEM_SZ_BLOCK_BUFF]; // 受信したブロック(データは&block[3]から)
+} XmodemPipeBlock;
+
+int XmodemPipeStart(const uint8_t *block, uint16_t sz_data, uint8_t bn, bool is_batch);
+XmodemPipeBlock *XmodemPipeGet(void);
+void XmodemPipeFree(XmodemPipeBlock *blk);
+int XmodemPipeStop(void);
+
+#endif
@@ -0,0 +1,11 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _XMODEM_RECV_BENCH_H_
+#define _XMODEM_RECV_BENCH_H_
+
+void XmodemRecvBench(void);
+
+#endif
@@ -6,8 +6,8 @@
 #ifndef SIPF_CLIENT_HTTP_H
 #define SIPF_CLIENT_HTTP_H
 
+#include <zephyr/kernel.h>
 #include <zephyr/net/http/client.h>
-#include "sipf/sipf_object.h"
 
 #define HTTP_PORT 80
 #define HTTPS_PORT 443
@@ -15,13 +15,54 @@
 
 #define BUFF_SZ (1500)
 
-extern uint8_t httpc_req_buff[BUFF_SZ];
-extern uint8_t httpc_res_buff[BUFF_SZ];
+#define SIPF_HTTP_CONN_CNT (2)    // Keep-Aliveで維持する接続の数
+#define SIPF_TLS_SESSION_CNT (4)  // TLSセッションキャッシュの統計を持つホストの数
+#define SIPF_HOSTNAME_MAX (64)
+#define SIPF_DNS_CACHE_CNT (4) // 名前解決をキャッシュするホストの数
+
+#define SIPF_HTTP_PATH_SZ (128)
+#define SIPF_HTTP_TIMEOUT_MS (3 * MSEC_PER_SEC)
+#define SIPF_HTTP_CTX_TIMEOUT K_SECONDS(10) // リクエストコンテキストの空きを待つ時間
+
+/**
+ * レスポンスボディを受信するたびに呼ばれるコールバック(受信バッファを使い回すので断片ごとに呼ばれる)
+ */
+typedef void (*SipfClientHttpBodyCb)(const uint8_t *data, size_t len, void *user_data);
+
+/**
+ * リクエストコンテキスト
+ *  リクエストごとにSipfClientHttpCtxAlloc()で確保してSipfClientHttpCtxFree()で返す
+ *  バッファを共有しないので、別のスレッドからのリクエストを同時に実行できる
+ */
+typedef struct
+{
+    struct http_request req;
+    struct http_response res;
+    uint32_t timeout; // ms
+    bool keep_alive;  // 接続を維持する(SipfClientHttpRunRequestKeepAlive()で実行する)
+    SipfClientHttpBodyCb body_cb; // NULLでなければボディの断片ごとに呼ぶ
+    void *body_user_data;
+    void *payload_user_data; // req.payload_cbで使う(payload_cbのuser_dataはresなのでCONTAINER_OF()でctxを得る)
+    char path[SIPF_HTTP_PATH_SZ];
+    uint8_t req_buff[BUFF_SZ];
+    uint8_t res_buff[BUFF_SZ];
+} SipfClientHttpCtx;
+
+SipfClientHttpCtx *SipfClientHttpCtxAlloc(k_timeout_t timeout);
+void SipfClientHttpCtxFree(SipfClientHttpCtx *ctx);
+int SipfClientHttpCtxRun(SipfClientHttpCtx *ctx, const char *hostname, bool tls);
 
 int SipfClientHttpSetAuthInfo(const char *user_name, const char *passwd);
 char *SipfClientHttpGetAuthInfo(void);
 
 int SipfClientHttpRunRequest(const char *hostname, struct http_request *req, uint32_t timeout, struct http_response *http_res, bool tls);
+int SipfClientHttpRunRequestKeepAlive(const char *hostname, struct http_request *req, uint32_t timeout, struct http_response *http_res, bool tls, bool retry);
+void SipfClientHttpCloseAll(void);
+
+int SipfClientHttpPreResolve(const char *hostname);
+
+void SipfClientHttpTlsSessionPurge(void);
+int SipfClientHttpTlsSessionStats(const char *host_name, uint32_t *hit, uint32_t *miss);
 
 int SipfClientHttpParseURL(char *url, const int url_len, char **protocol, char **host, char **path);
 #endif
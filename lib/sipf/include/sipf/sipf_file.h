@@ -16,9 +16,34 @@ int SipfFileRequestDownloadURL(const char *file_id, char *url, int sz_url);
 int SipfFileRequestUploadURL(const char *file_id, char *url, int sz_url);
 int SipfFileUploadComplete(const char *file_id);
 
-int SipfFileUpload(char *file_id, uint8_t *buff, http_payload_cb_t cb, int sz_payload);
+/*
+ * アップロードするデータのライタ(リクエストごとにsipf_file.cが用意してコールバックに渡す)
+ *  バッファはリクエストコンテキストのreq_buff(コールバックで送るときは使わない)を使う
+ */
+typedef struct
+{
+    int sock;
+    bool tls;
+    int err;
+    uint8_t *buff;
+    size_t sz;
+    size_t len;
+    size_t payload_bytes; // 書かれたデータの合計
+    size_t wire_bytes;    // ヘッダも含めて送ったおおよそのバイト数
+    int cnt_send;
+} SipfFileUploadWriter;
+
+/*
+ * アップロードするデータを書くコールバック
+ *  SipfFileUploadWrite()で書くと、CONFIG_SIPF_FILE_UPLOAD_CHUNK_SZずつまとめてsend()する
+ *  戻り値: 0 完了, 負 失敗(リクエストをやめる)
+ */
+typedef int (*sipfFileUpload_cb_t)(SipfFileUploadWriter *writer);
+int SipfFileUpload(char *file_id, uint8_t *buff, sipfFileUpload_cb_t cb, int sz_payload);
+int SipfFileUploadWrite(SipfFileUploadWriter *writer, const uint8_t *data, size_t len);
 
 typedef int (*sipfFileDownload_cb_t)(uint8_t *buff, size_t len);
 int SipfFileDownload(const char *file_id, uint8_t *buff, size_t sz_download, sipfFileDownload_cb_t cb);
+int SipfFileDownloadFileSize(void);
 
 #endif
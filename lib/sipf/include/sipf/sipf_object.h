@@ -10,6 +10,8 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "sipf/sipf_client_http.h"
+
 #define OBJ_MAX_CNT (255)
 
 #define OBJ_TYPE_UINT8 0x00
@@ -68,12 +70,65 @@ typedef struct
     uint8_t value[16];
 } SipfObjectOtid;
 
+/* OBJECTS_DOWNの固定部(OBJECTSより前) */
+typedef struct
+{
+    SipfObjectOtid otid;
+    uint8_t user_send_datetime[8]; // USER_SEND_DATETIME_MS(BigEndian)
+    uint8_t recv_datetime[8];      // RECEIVED_DATETIME_MS(BigEndian)
+    uint8_t remains;
+} SipfObjectDownHead;
+
+/*
+ * OBJECTS_DOWNを受信しながらパースして渡すハンドラ
+ *  objのvalueはコールバックの中でだけ有効(VALUEはBigEndianのまま)
+ *  コールバックが負の値を返すと以降のオブジェクトは読み捨てて、その値を返す
+ */
+typedef struct
+{
+    int (*on_head)(const SipfObjectDownHead *head, void *user_data);
+    int (*on_object)(const SipfObjectObject *obj, void *user_data);
+    void *user_data;
+} SipfObjectDownHandler;
+
+/*
+ * OBJECTS_UPのビルダー
+ *  リクエストコンテキストのペイロード領域に型ごとのVALUEをBigEndianで直接書く
+ *  途中で失敗したらerrに残して以降の追加は無視するので、最後にSipfObjectBuilderFinish()の戻り値を確認する
+ */
+typedef struct
+{
+    SipfClientHttpCtx *ctx;
+    uint8_t *buff;
+    uint16_t sz;
+    uint16_t len;
+    int err;
+} SipfObjectBuilder;
+
 int SipfObjectParse(uint8_t *raw_buff, const uint16_t raw_len, SipfObjectObject *obj);
 int SipfObjectCreateObjUpPayload(uint8_t *raw_buff, uint16_t sz_raw_buff, SipfObjectObject *objs, uint8_t obj_qty);
 
+int SipfObjectBuilderBegin(SipfObjectBuilder *builder, SipfClientHttpCtx *ctx);
+int SipfObjectBuilderAddU8(SipfObjectBuilder *builder, uint8_t tag_id, uint8_t value);
+int SipfObjectBuilderAddI8(SipfObjectBuilder *builder, uint8_t tag_id, int8_t value);
+int SipfObjectBuilderAddU16(SipfObjectBuilder *builder, uint8_t tag_id, uint16_t value);
+int SipfObjectBuilderAddI16(SipfObjectBuilder *builder, uint8_t tag_id, int16_t value);
+int SipfObjectBuilderAddU32(SipfObjectBuilder *builder, uint8_t tag_id, uint32_t value);
+int SipfObjectBuilderAddI32(SipfObjectBuilder *builder, uint8_t tag_id, int32_t value);
+int SipfObjectBuilderAddU64(SipfObjectBuilder *builder, uint8_t tag_id, uint64_t value);
+int SipfObjectBuilderAddI64(SipfObjectBuilder *builder, uint8_t tag_id, int64_t value);
+int SipfObjectBuilderAddFloat32(SipfObjectBuilder *builder, uint8_t tag_id, float value);
+int SipfObjectBuilderAddFloat64(SipfObjectBuilder *builder, uint8_t tag_id, double value);
+int SipfObjectBuilderAddBin(SipfObjectBuilder *builder, uint8_t tag_id, const uint8_t *value, uint8_t value_len);
+int SipfObjectBuilderAddStr(SipfObjectBuilder *builder, uint8_t tag_id, const char *value);
+int SipfObjectBuilderFinish(SipfObjectBuilder *builder, SipfObjectOtid *otid);
+
 /* SIPF_OBJクライアント */
+uint8_t *SipfObjClientGetObjUpPayloadBuff(SipfClientHttpCtx *ctx, uint16_t *sz);
+int SipfObjClientObjUpCtx(SipfClientHttpCtx *ctx, uint16_t size, SipfObjectOtid *otid);
+int SipfObjClientObjUpRetryCtx(SipfClientHttpCtx *ctx, uint16_t size, SipfObjectOtid *otid);
 int SipfObjClientObjUpRaw(uint8_t *payload_buffer, uint16_t size, SipfObjectOtid *otid);
 int SipfObjClientObjUp(const SipfObjectUp *simp_obj_up, SipfObjectOtid *otid);
-int SipfObjClientObjDown(SipfObjectOtid *otid, uint8_t *remains, uint8_t *objqty, uint8_t **p_objs, uint8_t **p_user_send_datetime, uint8_t **p_recv_datetime);
+int SipfObjClientObjDown(SipfClientHttpCtx *ctx, const SipfObjectDownHandler *handler);
 
 #endif
\ No newline at end of file
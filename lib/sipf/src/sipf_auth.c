@@ -12,78 +12,57 @@ LOG_MODULE_DECLARE(sipf);
 
 /** SIPF_AUTHクライアント  **/
 
-/**
- * HTTPレスポンスコールバック
- */
-static void http_response_cb(struct http_response *resp, enum http_final_call final_data, void *user_data)
-{
-    if (resp->data_len > 0) {
-        LOG_INF("HTTP response has come");
-        memcpy(user_data, resp, sizeof(struct http_response));
-    }
-}
-
-int run_get_session_key_http_request(struct http_response *http_res)
+static int run_get_session_key_http_request(SipfClientHttpCtx *ctx)
 {
-    struct http_request req;
-    memset(&req, 0, sizeof(req));
     const char *headers[] = {"Connection: Close\r\n", "Content-Type: text/plain\r\n", "Accept: text/plain\r\n", NULL};
 
-    req.method = HTTP_POST;
-    req.url = CONFIG_SIPF_AUTH_PATH;
-    req.host = CONFIG_SIPF_AUTH_HOST;
-    req.protocol = "HTTP/1.1";
-    req.payload = NULL;
-    req.payload_len = 0;
-    req.header_fields = headers;
-    req.response = http_response_cb;
-    req.recv_buf = httpc_res_buff;
-    req.recv_buf_len = sizeof(httpc_res_buff);
+    ctx->req.method = HTTP_POST;
+    ctx->req.url = CONFIG_SIPF_AUTH_PATH;
+    ctx->req.host = CONFIG_SIPF_AUTH_HOST;
+    ctx->req.payload = NULL;
+    ctx->req.payload_len = 0;
+    ctx->req.header_fields = headers;
 
 #ifndef CONFIG_SIPF_AUTH_DISABLE_SSL
     bool ssl = true;
 #else
     bool ssl = false;
 #endif
-    return SipfClientHttpRunRequest(CONFIG_SIPF_AUTH_HOST, &req, 3 * MSEC_PER_SEC, http_res, ssl);
+    return SipfClientHttpCtxRun(ctx, CONFIG_SIPF_AUTH_HOST, ssl);
 }
 
-/**
- * IPアドレス(SIM)認証リクエスト
- */
-int SipfAuthRequest(char *user_name, uint8_t sz_user_name, char *password, uint8_t sz_password)
+static int sipfAuthRequest(SipfClientHttpCtx *ctx, char *user_name, uint8_t sz_user_name, char *password, uint8_t sz_password)
 {
-    int ret;
-    static struct http_response http_res;
-    ret = run_get_session_key_http_request(&http_res);
+    int ret = run_get_session_key_http_request(ctx);
+    struct http_response *http_res = &ctx->res;
 
     LOG_INF("run_get_session_key_http_request(): %d", ret);
     if (ret < 0) {
         return ret;
     }
 
-    LOG_INF("Response status %s", http_res.http_status);
-    LOG_INF("content-length: %d", http_res.content_length);
+    LOG_INF("Response status %s", http_res->http_status);
+    LOG_INF("content-length: %d", http_res->content_length);
     // FIXME: CONFIG_SIPF_LOG_LEVEL をつかっていい感じに抑制する
-    for (int i = 0; i < http_res.content_length; i++) {
-        LOG_DBG("0x%02x ", http_res.body_frag_start[i]);
+    for (int i = 0; i < http_res->content_length; i++) {
+        LOG_DBG("0x%02x ", http_res->body_frag_start[i]);
     }
     // FIXME: ここまで
 
-    if (strcmp(http_res.http_status, "OK") != 0) {
+    if (strcmp(http_res->http_status, "OK") != 0) {
         // 200 OK以外のレスポンスが返ってきた
         return -1;
     }
 
     // レスポンスのフォーマットは USERNAME\nPASSWORD\n
     // FIXME: 例外処理もしっかりやる
-    char *u = (char *)&http_res.body_frag_start[0];
+    char *u = (char *)&http_res->body_frag_start[0];
     char *p = NULL;
-    for (int i = 0; i < http_res.content_length; i++) {
-        if (http_res.body_frag_start[i] == '\n') {
-            http_res.body_frag_start[i] = 0;
+    for (int i = 0; i < http_res->content_length; i++) {
+        if (http_res->body_frag_start[i] == '\n') {
+            http_res->body_frag_start[i] = 0;
             if (p == NULL) {
-                p = (char *)&(http_res.body_frag_start[i + 1]);
+                p = (char *)&(http_res->body_frag_start[i + 1]);
             }
         }
     }
@@ -108,3 +87,18 @@ int SipfAuthRequest(char *user_name, uint8_t sz_user_name, char *password, uint8
     }
     return -1;
 }
+
+/**
+ * IPアドレス(SIM)認証リクエスト
+ */
+int SipfAuthRequest(char *user_name, uint8_t sz_user_name, char *password, uint8_t sz_password)
+{
+    int ret;
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    if (ctx == NULL) {
+        return -ENOMEM;
+    }
+    ret = sipfAuthRequest(ctx, user_name, sz_user_name, password, sz_password);
+    SipfClientHttpCtxFree(ctx);
+    return ret;
+}
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <zephyr/kernel.h>
 #include <zephyr/net/net_ip.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/tls_credentials.h>
@@ -20,11 +21,127 @@ LOG_MODULE_DECLARE(sipf);
 #define HTTP_BASIC_AUTH_HEADER_PREFIX "Authorization: Basic "
 #define NEWLINE_STRING "\r\n"
 
-uint8_t httpc_req_buff[BUFF_SZ];
-uint8_t httpc_res_buff[BUFF_SZ];
-
 static char req_auth_header[256];
 
+/** TLSセッションキャッシュ **/
+typedef struct
+{
+    char hostname[SIPF_HOSTNAME_MAX]; // 空文字: 空き
+    bool has_session;                     // ハンドシェイクが完了していてセッションがキャッシュされているはず
+    uint32_t hit;
+    uint32_t miss;
+} SipfClientHttpTlsSession;
+
+static SipfClientHttpTlsSession tls_sessions[SIPF_TLS_SESSION_CNT];
+static int tls_session_next;
+static bool tls_session_purge;
+static K_MUTEX_DEFINE(tls_session_lock);
+
+/**
+ * ホストの統計を返す(無ければ古いものを上書きする)
+ * 入り切らない長さのホスト名は切り詰めると別のホストと混ざるので数えない(NULL)
+ */
+static SipfClientHttpTlsSession *tls_session_get(const char *host_name)
+{
+    if (strlen(host_name) >= SIPF_HOSTNAME_MAX) {
+        return NULL;
+    }
+    for (int i = 0; i < SIPF_TLS_SESSION_CNT; i++) {
+        if (strcmp(tls_sessions[i].hostname, host_name) == 0) {
+            return &tls_sessions[i];
+        }
+    }
+    // 無ければ古いものから上書きする
+    SipfClientHttpTlsSession *ts = &tls_sessions[tls_session_next];
+    tls_session_next = (tls_session_next + 1) % SIPF_TLS_SESSION_CNT;
+    memset(ts, 0, sizeof(SipfClientHttpTlsSession));
+    strcpy(ts->hostname, host_name);
+    return ts;
+}
+
+/**
+ * セッションキャッシュを有効にして、キャッシュのヒット/ミスを数える
+ */
+static void tls_session_setup(int fd, const char *host_name)
+{
+    int err;
+    int cache = TLS_SESSION_CACHE_ENABLED;
+
+    err = setsockopt(fd, SOL_TLS, TLS_SESSION_CACHE, &cache, sizeof(cache));
+    if (err) {
+        LOG_WRN("Failed to enable TLS session cache, err %d", errno);
+        return;
+    }
+
+    k_mutex_lock(&tls_session_lock, K_FOREVER);
+    if (tls_session_purge) {
+        // キャッシュされているセッションを全て捨てる
+        int dummy = 0;
+        err = setsockopt(fd, SOL_TLS, TLS_SESSION_CACHE_PURGE, &dummy, sizeof(dummy));
+        if (err) {
+            LOG_WRN("Failed to purge TLS session cache, err %d", errno);
+        } else {
+            tls_session_purge = false;
+            for (int i = 0; i < SIPF_TLS_SESSION_CNT; i++) {
+                tls_sessions[i].has_session = false;
+            }
+        }
+    }
+    SipfClientHttpTlsSession *ts = tls_session_get(host_name);
+    if (ts != NULL) {
+        if (ts->has_session) {
+            ts->hit++;
+        } else {
+            ts->miss++;
+        }
+        LOG_INF("TLS session cache %s: hit=%u miss=%u", host_name, ts->hit, ts->miss);
+    }
+    k_mutex_unlock(&tls_session_lock);
+}
+
+/**
+ * ハンドシェイクが完了したのでセッションがキャッシュされた
+ */
+static void tls_session_connected(const char *host_name)
+{
+    k_mutex_lock(&tls_session_lock, K_FOREVER);
+    SipfClientHttpTlsSession *ts = tls_session_get(host_name);
+    if (ts != NULL) {
+        ts->has_session = true;
+    }
+    k_mutex_unlock(&tls_session_lock);
+}
+
+/**
+ * TLSセッションキャッシュを捨てる(次のソケットで実行する)
+ * 証明書を書き換えたときに呼ぶ
+ */
+void SipfClientHttpTlsSessionPurge(void)
+{
+    k_mutex_lock(&tls_session_lock, K_FOREVER);
+    tls_session_purge = true;
+    k_mutex_unlock(&tls_session_lock);
+}
+
+/**
+ * ホストごとのTLSセッションキャッシュのヒット/ミス回数
+ */
+int SipfClientHttpTlsSessionStats(const char *host_name, uint32_t *hit, uint32_t *miss)
+{
+    int ret = -ENOENT;
+    k_mutex_lock(&tls_session_lock, K_FOREVER);
+    for (int i = 0; i < SIPF_TLS_SESSION_CNT; i++) {
+        if (strcmp(tls_sessions[i].hostname, host_name) == 0) {
+            *hit = tls_sessions[i].hit;
+            *miss = tls_sessions[i].miss;
+            ret = 0;
+            break;
+        }
+    }
+    k_mutex_unlock(&tls_session_lock);
+    return ret;
+}
+
 /* Setup TLS options on a given socket */
 static int tls_setup(int fd, const char *host_name)
 {
@@ -67,6 +184,9 @@ static int tls_setup(int fd, const char *host_name)
         return err;
     }
 
+    // 再接続は短縮ハンドシェイクで済ませる
+    tls_session_setup(fd, host_name);
+
     return 0;
 }
 
@@ -138,30 +258,144 @@ parse_finish:
     return 0;
 }
 
-int SipfClientHttpRunRequest(const char *hostname, struct http_request *req, uint32_t timeout, struct http_response *http_res, bool tls)
+/** 名前解決キャッシュ **/
+typedef struct
+{
+    char hostname[SIPF_HOSTNAME_MAX]; // 空文字: 空き
+    struct sockaddr_in addr;
+    int err; // 0以外: 名前解決に失敗した(ネガティブキャッシュ)
+    int64_t expire_ms;
+} SipfClientHttpDnsEntry;
+
+static SipfClientHttpDnsEntry dns_cache[SIPF_DNS_CACHE_CNT];
+static K_MUTEX_DEFINE(dns_cache_lock);
+
+static SipfClientHttpDnsEntry *dns_cache_find(const char *hostname)
+{
+    for (int i = 0; i < SIPF_DNS_CACHE_CNT; i++) {
+        if (strcmp(dns_cache[i].hostname, hostname) == 0) {
+            return &dns_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 名前解決する(キャッシュが有効ならキャッシュを返す)
+ */
+static int dns_cache_resolve(const char *hostname, struct sockaddr_in *addr)
 {
-    int sock;
     int ret;
+    int64_t now = k_uptime_get();
+    // 入りきらない名前はキャッシュしない(切り詰めると一致しないまま他のエントリを追い出す)
+    bool cacheable = strlen(hostname) < SIPF_HOSTNAME_MAX;
+
+    k_mutex_lock(&dns_cache_lock, K_FOREVER);
+    SipfClientHttpDnsEntry *ent = cacheable ? dns_cache_find(hostname) : NULL;
+    if ((ent != NULL) && (ent->expire_ms > now)) {
+        ret = ent->err;
+        if (ret == 0) {
+            memcpy(addr, &ent->addr, sizeof(struct sockaddr_in));
+        }
+        k_mutex_unlock(&dns_cache_lock);
+        LOG_DBG("DNS cache hit %s: %d", hostname, ret);
+        return ret;
+    }
+    k_mutex_unlock(&dns_cache_lock);
+
+    // 問い合わせ中はロックしない
     struct addrinfo *res;
     struct addrinfo hints = {
         .ai_family = AF_INET, .ai_socktype = SOCK_STREAM,
     };
-    // 接続先をセットアップするよ
     ret = getaddrinfo(hostname, NULL, &hints, &res);
     if (ret) {
-        LOG_ERR("getaddrinfo failed: ret=%d errno=%d", ret, errno);
-        return -errno;
+        LOG_ERR("getaddrinfo failed: ret=%d", ret);
+        // エラーは戻り値(EAI_*)で返ってくる(errnoが有効なのはEAI_SYSTEMのときだけ)
+        if ((ret == EAI_SYSTEM) && (errno != 0)) {
+            ret = -errno;
+        } else if (ret == EAI_AGAIN) {
+            ret = -EAGAIN;
+        } else {
+            ret = -EHOSTUNREACH;
+        }
+    } else {
+        memcpy(addr, res->ai_addr, sizeof(struct sockaddr_in));
+        freeaddrinfo(res);
+    }
+    if (!cacheable) {
+        return ret;
+    }
+
+    k_mutex_lock(&dns_cache_lock, K_FOREVER);
+    ent = dns_cache_find(hostname);
+    if (ent == NULL) {
+        // 空きか一番早く期限が切れるものを使う
+        ent = &dns_cache[0];
+        for (int i = 1; i < SIPF_DNS_CACHE_CNT; i++) {
+            if (dns_cache[i].expire_ms < ent->expire_ms) {
+                ent = &dns_cache[i];
+            }
+        }
+        memset(ent, 0, sizeof(SipfClientHttpDnsEntry));
+        strncpy(ent->hostname, hostname, sizeof(ent->hostname) - 1);
+    }
+    ent->err = ret;
+    if (ret == 0) {
+        memcpy(&ent->addr, addr, sizeof(struct sockaddr_in));
+        ent->expire_ms = now + CONFIG_SIPF_DNS_CACHE_TTL * MSEC_PER_SEC;
+    } else {
+        ent->expire_ms = now + CONFIG_SIPF_DNS_CACHE_NEG_TTL * MSEC_PER_SEC;
+    }
+    k_mutex_unlock(&dns_cache_lock);
+    return ret;
+}
+
+/**
+ * キャッシュを捨てて次は問い合わせ直す
+ */
+static void dns_cache_invalidate(const char *hostname)
+{
+    k_mutex_lock(&dns_cache_lock, K_FOREVER);
+    SipfClientHttpDnsEntry *ent = dns_cache_find(hostname);
+    if (ent != NULL) {
+        ent->expire_ms = 0;
+    }
+    k_mutex_unlock(&dns_cache_lock);
+}
+
+/**
+ * 名前解決してキャッシュしておく
+ */
+int SipfClientHttpPreResolve(const char *hostname)
+{
+    struct sockaddr_in addr;
+    return dns_cache_resolve(hostname, &addr);
+}
+
+/**
+ * 接続先を名前解決して接続したソケットを返す
+ */
+static int http_connect(const char *hostname, bool tls)
+{
+    int sock;
+    int ret;
+    struct sockaddr_in addr;
+
+    // 接続先をセットアップするよ
+    ret = dns_cache_resolve(hostname, &addr);
+    if (ret) {
+        return ret;
     }
     if (tls) {
-        ((struct sockaddr_in *)res->ai_addr)->sin_port = htons(HTTPS_PORT);
+        addr.sin_port = htons(HTTPS_PORT);
         sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TLS_1_2);
     } else {
-        ((struct sockaddr_in *)res->ai_addr)->sin_port = htons(HTTP_PORT);
+        addr.sin_port = htons(HTTP_PORT);
         sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     }
     if (sock < 0) {
         LOG_ERR("socket() failed: ret=%d errno=%d", ret, errno);
-        freeaddrinfo(res);
         return -errno;
     }
     if (tls) {
@@ -169,27 +403,320 @@ int SipfClientHttpRunRequest(const char *hostname, struct http_request *req, uin
         ret = tls_setup(sock, hostname);
         if (ret != 0) {
             LOG_ERR("tls_setup() failed: ret=%d", ret);
-            freeaddrinfo(res);
             (void)close(sock);
             return -errno;
         }
     }
     // 接続するよ
-    LOG_INF("Connect to %s:%d", hostname, HTTPS_PORT);
-    ret = connect(sock, res->ai_addr, sizeof(struct sockaddr_in));
+    LOG_INF("Connect to %s:%d", hostname, tls ? HTTPS_PORT : HTTP_PORT);
+    ret = connect(sock, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
     if (ret) {
         LOG_ERR("connect() failed: ret=%d errno=%d", ret, errno);
-        freeaddrinfo(res);
+        ret = -errno;
         (void)close(sock);
-        return -errno;
+        // アドレスが変わったかもしれないので次は問い合わせ直す
+        dns_cache_invalidate(hostname);
+        return ret;
+    }
+    if (tls) {
+        tls_session_connected(hostname);
+    }
+    return sock;
+}
+
+int SipfClientHttpRunRequest(const char *hostname, struct http_request *req, uint32_t timeout, struct http_response *http_res, bool tls)
+{
+    int sock;
+    int ret;
+
+    sock = http_connect(hostname, tls);
+    if (sock < 0) {
+        return sock;
     }
 
     ret = http_client_req(sock, req, timeout, http_res);
-    freeaddrinfo(res);
     close(sock);
     return ret;
 }
 
+/** Keep-Alive接続 **/
+typedef struct
+{
+    const char *hostname; // NULL: 未接続
+    bool tls;
+    bool busy; // リクエスト中(他のリクエストからは使わない)
+    int sock;
+    int64_t last_used_ms;
+} SipfClientHttpConn;
+
+static SipfClientHttpConn conns[SIPF_HTTP_CONN_CNT];
+static K_MUTEX_DEFINE(conn_lock);
+
+static void conn_close(SipfClientHttpConn *conn)
+{
+    if (conn->hostname != NULL) {
+        LOG_INF("Close keep-alive connection to %s", conn->hostname);
+        (void)close(conn->sock);
+        conn->hostname = NULL;
+        conn->sock = -1;
+    }
+}
+
+/**
+ * アイドルタイムアウトした接続を閉じる
+ */
+static void conn_idle_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(conn_idle_work, conn_idle_work_handler);
+
+static void conn_idle_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&conn_lock, K_FOREVER);
+    int64_t now = k_uptime_get();
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < SIPF_HTTP_CONN_CNT; i++) {
+        if ((conns[i].hostname == NULL) || conns[i].busy) {
+            continue;
+        }
+        int64_t expire = conns[i].last_used_ms + CONFIG_SIPF_HTTP_KEEPALIVE_TIMEOUT * MSEC_PER_SEC;
+        if (expire <= now) {
+            // 閉じておけばPSMに入れる
+            conn_close(&conns[i]);
+        } else if (expire < next) {
+            next = expire;
+        }
+    }
+    if (next != INT64_MAX) {
+        k_work_reschedule(&conn_idle_work, K_MSEC(next - now));
+    }
+    k_mutex_unlock(&conn_lock);
+}
+
+/**
+ * サーバー側から閉じられていないか
+ */
+static bool conn_is_alive(SipfClientHttpConn *conn)
+{
+    struct pollfd fds = {.fd = conn->sock, .events = POLLIN};
+    int ret = poll(&fds, 1, 0);
+    if (ret == 0) {
+        // 何も来ていない
+        return true;
+    }
+    // 要求していないのに読める=FIN/エラーか想定外のデータ
+    LOG_INF("Keep-alive connection to %s was closed by peer", conn->hostname);
+    return false;
+}
+
+/**
+ * ホストごとの接続を予約する(conn_lockを取ってから呼ぶ)
+ * 維持している接続が使えればreused=true、使えなければ空けた枠を返すので呼び出し元で接続する
+ * 全ての枠がリクエスト中ならNULL
+ */
+static SipfClientHttpConn *conn_acquire(const char *hostname, bool tls, bool *reused)
+{
+    SipfClientHttpConn *conn = NULL;
+    SipfClientHttpConn *lru = NULL;
+
+    for (int i = 0; i < SIPF_HTTP_CONN_CNT; i++) {
+        if (conns[i].busy) {
+            continue;
+        }
+        if ((conns[i].hostname != NULL) && (conns[i].tls == tls) && (strcmp(conns[i].hostname, hostname) == 0)) {
+            conn = &conns[i];
+            break;
+        }
+        // 未接続の枠を優先して、なければ一番使われていない接続
+        if ((lru == NULL) || ((lru->hostname != NULL) && ((conns[i].hostname == NULL) || (conns[i].last_used_ms < lru->last_used_ms)))) {
+            lru = &conns[i];
+        }
+    }
+    *reused = false;
+    if (conn != NULL) {
+        if (conn_is_alive(conn)) {
+            *reused = true;
+        } else {
+            conn_close(conn);
+        }
+    } else if (lru != NULL) {
+        // 空きがなければ一番使われていない接続を閉じる
+        conn = lru;
+        conn_close(conn);
+    } else {
+        return NULL;
+    }
+    conn->busy = true;
+    return conn;
+}
+
+/**
+ * 予約した接続を返す(conn_lockを取ってから呼ぶ)
+ */
+static void conn_release(SipfClientHttpConn *conn, bool ok)
+{
+    if (ok) {
+        conn->last_used_ms = k_uptime_get();
+    } else {
+        conn_close(conn);
+    }
+    conn->busy = false;
+}
+
+/**
+ * 接続を維持したままリクエストを実行する
+ * hostnameは接続を閉じるまで参照するので静的な文字列を渡すこと
+ * 維持していた接続が応答を1Byteも返さずに閉じられたとき(リクエストがサーバーに届いていない)だけ、接続し直して1回だけやり直す
+ * 送った後のタイムアウトや途中までの応答はやり直さない(OBJECTS_UP/OBJECTS_DOWNは冪等ではない)
+ * retry=falseなら閉じられていてもやり直さない
+ * 維持している接続が全て他のリクエストで使用中なら、このリクエストだけの接続で実行する
+ */
+int SipfClientHttpRunRequestKeepAlive(const char *hostname, struct http_request *req, uint32_t timeout, struct http_response *http_res, bool tls, bool retry)
+{
+    int ret;
+    bool reused;
+
+    if (CONFIG_SIPF_HTTP_KEEPALIVE_TIMEOUT == 0) {
+        // Keep-Aliveしない
+        return SipfClientHttpRunRequest(hostname, req, timeout, http_res, tls);
+    }
+
+    for (int cnt = 0; cnt < (retry ? 2 : 1); cnt++) {
+        k_mutex_lock(&conn_lock, K_FOREVER);
+        SipfClientHttpConn *conn = conn_acquire(hostname, tls, &reused);
+        k_mutex_unlock(&conn_lock);
+        if (conn == NULL) {
+            LOG_DBG("All keep-alive connections are busy");
+            return SipfClientHttpRunRequest(hostname, req, timeout, http_res, tls);
+        }
+
+        if (!reused) {
+            // 予約した枠は他のリクエストから使われないのでロックの外で接続する
+            int sock = http_connect(hostname, tls);
+            if (sock < 0) {
+                k_mutex_lock(&conn_lock, K_FOREVER);
+                conn->busy = false;
+                k_mutex_unlock(&conn_lock);
+                ret = sock;
+                break;
+            }
+            conn->hostname = hostname;
+            conn->tls = tls;
+            conn->sock = sock;
+        }
+
+        memset(http_res, 0, sizeof(struct http_response));
+        int64_t start_ms = k_uptime_get();
+        ret = http_client_req(conn->sock, req, timeout, http_res);
+        // 応答を受け取れたか
+        bool ok = (ret >= 0) && (http_res->http_status_code != 0);
+        // 応答が1Byteも来ないうちに(タイムアウトより前に)失敗した=送信に失敗したか閉じられていた
+        bool not_reached = (http_res->data_len == 0) && ((k_uptime_get() - start_ms) < timeout);
+        if (!ok) {
+            LOG_WRN("http_client_req() failed on %s connection: %d", reused ? "reused" : "new", ret);
+        }
+        k_mutex_lock(&conn_lock, K_FOREVER);
+        conn_release(conn, ok);
+        k_mutex_unlock(&conn_lock);
+        if (ok || !reused || !not_reached) {
+            // 成功したか、新しい接続でもダメだったか、サーバーに届いたかもしれない
+            if (!ok && (ret >= 0)) {
+                // 途中までの応答は失敗として返す
+                ret = -EIO;
+            }
+            break;
+        }
+    }
+
+    k_work_reschedule(&conn_idle_work, K_SECONDS(CONFIG_SIPF_HTTP_KEEPALIVE_TIMEOUT));
+    return ret;
+}
+
+/**
+ * 維持している接続を全て閉じる(リクエスト中の接続はそのまま)
+ */
+void SipfClientHttpCloseAll(void)
+{
+    k_mutex_lock(&conn_lock, K_FOREVER);
+    for (int i = 0; i < SIPF_HTTP_CONN_CNT; i++) {
+        if (!conns[i].busy) {
+            conn_close(&conns[i]);
+        }
+    }
+    k_mutex_unlock(&conn_lock);
+}
+
+/** リクエストコンテキスト **/
+K_MEM_SLAB_DEFINE_STATIC(http_ctx_slab, sizeof(SipfClientHttpCtx), CONFIG_SIPF_HTTP_CTX_CNT, 4);
+
+/**
+ * HTTPレスポンスコールバック
+ * 最初の断片でレスポンスをコピーして、以降は受信したデータ長だけ足す
+ * body_cbが設定されていればボディの断片を渡す
+ */
+static void http_ctx_response_cb(struct http_response *resp, enum http_final_call final_data, void *user_data)
+{
+    struct http_response *ur = (struct http_response *)user_data;
+    SipfClientHttpCtx *ctx = CONTAINER_OF(ur, SipfClientHttpCtx, res);
+
+    if ((ctx->body_cb != NULL) && (resp->body_frag_start != NULL) && (resp->body_frag_len > 0)) {
+        ctx->body_cb(resp->body_frag_start, resp->body_frag_len, ctx->body_user_data);
+    }
+
+    if (resp->data_len > 0) {
+        if (ur->http_status_code == 0) {
+            memcpy(ur, resp, sizeof(struct http_response));
+        } else {
+            ur->data_len += resp->data_len;
+        }
+        LOG_DBG("HTTP response has come(content-length: %d, data_len: %d)", resp->content_length, resp->data_len);
+    }
+}
+
+/**
+ * リクエストコンテキストを確保する(timeoutまでに空かなければNULL)
+ * 受信バッファとレスポンスコールバックは設定済みなので、呼び出し元はメソッドやパスなどを設定する
+ */
+SipfClientHttpCtx *SipfClientHttpCtxAlloc(k_timeout_t timeout)
+{
+    SipfClientHttpCtx *ctx;
+    if (k_mem_slab_alloc(&http_ctx_slab, (void **)&ctx, timeout) != 0) {
+        LOG_ERR("No free HTTP request context");
+        return NULL;
+    }
+    memset(&ctx->req, 0, sizeof(ctx->req));
+    memset(&ctx->res, 0, sizeof(ctx->res));
+    ctx->timeout = SIPF_HTTP_TIMEOUT_MS;
+    ctx->keep_alive = false;
+    ctx->body_cb = NULL;
+    ctx->body_user_data = NULL;
+    ctx->payload_user_data = NULL;
+    ctx->path[0] = '\0';
+    ctx->req.protocol = "HTTP/1.1";
+    ctx->req.response = http_ctx_response_cb;
+    ctx->req.recv_buf = ctx->res_buff;
+    ctx->req.recv_buf_len = sizeof(ctx->res_buff);
+    return ctx;
+}
+
+void SipfClientHttpCtxFree(SipfClientHttpCtx *ctx)
+{
+    if (ctx != NULL) {
+        k_mem_slab_free(&http_ctx_slab, (void **)&ctx);
+    }
+}
+
+/**
+ * コンテキストのリクエストを実行する(レスポンスはctx->resに入る)
+ */
+int SipfClientHttpCtxRun(SipfClientHttpCtx *ctx, const char *hostname, bool tls)
+{
+    memset(&ctx->res, 0, sizeof(ctx->res));
+    if (ctx->keep_alive) {
+        // ボディを受信しながら渡しているときは、やり直すと前の試行の断片と混ざるのでやり直さない
+        return SipfClientHttpRunRequestKeepAlive(hostname, &ctx->req, ctx->timeout, &ctx->res, tls, ctx->body_cb == NULL);
+    }
+    return SipfClientHttpRunRequest(hostname, &ctx->req, ctx->timeout, &ctx->res, tls);
+}
+
 /**
  * Authorizationヘッダの文字列バッファへのポインタを返す
  */
@@ -8,6 +8,7 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(sipf);
@@ -43,7 +44,6 @@ int SipfObjectParse(uint8_t *raw_buff, const uint16_t raw_len, SipfObjectObject
 
 int SipfObjectCreateObjUpPayload(uint8_t *raw_buff, uint16_t sz_raw_buff, SipfObjectObject *objs, uint8_t obj_qty)
 {
-    static uint8_t work[220];
     if (raw_buff == NULL) {
         return -1;
     }
@@ -55,6 +55,10 @@ int SipfObjectCreateObjUpPayload(uint8_t *raw_buff, uint16_t sz_raw_buff, SipfOb
         if (objs[i].value_len > 220) {
             return -1;
         }
+        if (idx_raw_buff + 3 + objs[i].value_len > sz_raw_buff) {
+            // バッファに入り切らない
+            return -1;
+        }
         raw_buff[idx_raw_buff++] = objs[i].obj_type;
         raw_buff[idx_raw_buff++] = objs[i].obj_tagid;
         raw_buff[idx_raw_buff++] = objs[i].value_len;
@@ -74,126 +78,298 @@ int SipfObjectCreateObjUpPayload(uint8_t *raw_buff, uint16_t sz_raw_buff, SipfOb
                 // データ長が偶数じゃない
                 return -1;
             }
+            // (作業バッファを共有しないように直接書く)
             for (int j = 0; j < objs[i].value_len; j++) {
-                work[j] = objs[i].value[objs[i].value_len - j - 1];
+                raw_buff[idx_raw_buff++] = objs[i].value[objs[i].value_len - j - 1];
             }
-            memcpy(&raw_buff[idx_raw_buff], work, objs[i].value_len);
-            idx_raw_buff += objs[i].value_len;
             break;
         }
     }
     return idx_raw_buff; // バッファに書いたデータ長を返す
 }
 
-/** SIPF_OBJクライアント  **/
+/** OBJECTS_UPのビルダー **/
 
 /**
- * HTTPレスポンスコールバック
+ * TYPE TAG_ID VALUE_LENを書いてVALUEを書く位置を返す(入り切らなければNULL)
  */
-static void http_response_cb(struct http_response *resp, enum http_final_call final_data, void *user_data)
+static uint8_t *builder_put_head(SipfObjectBuilder *builder, uint8_t type, uint8_t tag_id, uint8_t value_len)
 {
-    struct http_response *ur = (struct http_response*)user_data;
-    
-    if (resp->data_len > 0) {
-        if (ur->http_status_code == 0) {
-            memcpy(user_data, resp, sizeof(struct http_response));
-        } else {
-            ur->data_len += resp->data_len;
+    if (builder->err != 0) {
+        return NULL;
+    }
+    if (builder->len + 3 + value_len > builder->sz) {
+        LOG_ERR("Object buffer full: tag_id=0x%02x", tag_id);
+        builder->err = -ENOMEM;
+        return NULL;
+    }
+    uint8_t *p = &builder->buff[builder->len];
+    p[0] = type;
+    p[1] = tag_id;
+    p[2] = value_len;
+    builder->len += 3 + value_len;
+    return &p[3];
+}
+
+/**
+ * リクエストコンテキストのペイロード領域に組み立てを始める
+ */
+int SipfObjectBuilderBegin(SipfObjectBuilder *builder, SipfClientHttpCtx *ctx)
+{
+    if ((builder == NULL) || (ctx == NULL)) {
+        return -EINVAL;
+    }
+    builder->ctx = ctx;
+    builder->buff = SipfObjClientGetObjUpPayloadBuff(ctx, &builder->sz);
+    builder->len = 0;
+    builder->err = 0;
+    return 0;
+}
+
+int SipfObjectBuilderAddU8(SipfObjectBuilder *builder, uint8_t tag_id, uint8_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_UINT8, tag_id, 1);
+    if (p == NULL) {
+        return builder->err;
+    }
+    p[0] = value;
+    return 0;
+}
+
+int SipfObjectBuilderAddI8(SipfObjectBuilder *builder, uint8_t tag_id, int8_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_INT8, tag_id, 1);
+    if (p == NULL) {
+        return builder->err;
+    }
+    p[0] = (uint8_t)value;
+    return 0;
+}
+
+int SipfObjectBuilderAddU16(SipfObjectBuilder *builder, uint8_t tag_id, uint16_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_UINT16, tag_id, 2);
+    if (p == NULL) {
+        return builder->err;
+    }
+    sys_put_be16(value, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddI16(SipfObjectBuilder *builder, uint8_t tag_id, int16_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_INT16, tag_id, 2);
+    if (p == NULL) {
+        return builder->err;
+    }
+    sys_put_be16((uint16_t)value, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddU32(SipfObjectBuilder *builder, uint8_t tag_id, uint32_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_UINT32, tag_id, 4);
+    if (p == NULL) {
+        return builder->err;
+    }
+    sys_put_be32(value, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddI32(SipfObjectBuilder *builder, uint8_t tag_id, int32_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_INT32, tag_id, 4);
+    if (p == NULL) {
+        return builder->err;
+    }
+    sys_put_be32((uint32_t)value, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddU64(SipfObjectBuilder *builder, uint8_t tag_id, uint64_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_UINT64, tag_id, 8);
+    if (p == NULL) {
+        return builder->err;
+    }
+    sys_put_be64(value, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddI64(SipfObjectBuilder *builder, uint8_t tag_id, int64_t value)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_INT64, tag_id, 8);
+    if (p == NULL) {
+        return builder->err;
+    }
+    sys_put_be64((uint64_t)value, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddFloat32(SipfObjectBuilder *builder, uint8_t tag_id, float value)
+{
+    uint32_t bits;
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_FLOAT32, tag_id, 4);
+    if (p == NULL) {
+        return builder->err;
+    }
+    // IEEE754のビット列をそのままBigEndianで書く
+    memcpy(&bits, &value, sizeof(bits));
+    sys_put_be32(bits, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddFloat64(SipfObjectBuilder *builder, uint8_t tag_id, double value)
+{
+    uint64_t bits;
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_FLOAT64, tag_id, 8);
+    if (p == NULL) {
+        return builder->err;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    sys_put_be64(bits, p);
+    return 0;
+}
+
+int SipfObjectBuilderAddBin(SipfObjectBuilder *builder, uint8_t tag_id, const uint8_t *value, uint8_t value_len)
+{
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_BIN, tag_id, value_len);
+    if (p == NULL) {
+        return builder->err;
+    }
+    memcpy(p, value, value_len);
+    return 0;
+}
+
+int SipfObjectBuilderAddStr(SipfObjectBuilder *builder, uint8_t tag_id, const char *value)
+{
+    size_t value_len = strlen(value);
+    if (value_len > 0xff) {
+        // VALUE_LENに書けない
+        LOG_ERR("String is too long: tag_id=0x%02x", tag_id);
+        if (builder->err == 0) {
+            builder->err = -EINVAL;
         }
-        LOG_INF("HTTP response has come(content-length: %d, data_len: %d)", resp->content_length, resp->data_len);
-        
+        return builder->err;
+    }
+    uint8_t *p = builder_put_head(builder, OBJ_TYPE_STR_UTF8, tag_id, value_len);
+    if (p == NULL) {
+        return builder->err;
+    }
+    memcpy(p, value, value_len);
+    return 0;
+}
+
+/**
+ * 組み立てたOBJECTS_UPを送信する(ペイロードはコピーしない)
+ */
+int SipfObjectBuilderFinish(SipfObjectBuilder *builder, SipfObjectOtid *otid)
+{
+    if (builder->err != 0) {
+        return builder->err;
     }
+    return SipfObjClientObjUpCtx(builder->ctx, builder->len, otid);
 }
 
-static int run_connector_http_request(const uint8_t *payload, const int payload_len, struct http_response *http_res)
+/** SIPF_OBJクライアント  **/
+
+static int run_connector_http_request(SipfClientHttpCtx *ctx, const int payload_len)
 {
     char *req_auth_header = SipfClientHttpGetAuthInfo();
     // リクエストを組み立てるよ
     LOG_INF("auth: %s", req_auth_header);
 
-    struct http_request req;
-    memset(&req, 0, sizeof(req));
-    const char *headers[] = {"Connection: Close\r\n", "Content-Type: application/octet-stream\r\n", req_auth_header, NULL};
+    // 接続は維持する(HTTP/1.1なのでConnectionヘッダは付けない)
+    const char *headers[] = {"Content-Type: application/octet-stream\r\n", req_auth_header, NULL};
 
-    memset(httpc_res_buff, 0, sizeof(httpc_res_buff));
+    memset(ctx->res_buff, 0, sizeof(ctx->res_buff));
 
-    req.method = HTTP_POST;
-    req.url = CONFIG_SIPF_CONNECTOR_PATH;
-    req.host = CONFIG_SIPF_CONNECTOR_HTTP_HOST;
-    req.protocol = "HTTP/1.1";
-    req.payload = payload;
-    req.payload_len = payload_len;
-    req.header_fields = headers;
-    req.response = http_response_cb;
-    req.recv_buf = httpc_res_buff;
-    req.recv_buf_len = sizeof(httpc_res_buff);
+    ctx->req.method = HTTP_POST;
+    ctx->req.url = CONFIG_SIPF_CONNECTOR_PATH;
+    ctx->req.host = CONFIG_SIPF_CONNECTOR_HTTP_HOST;
+    ctx->req.payload = ctx->req_buff;
+    ctx->req.payload_len = payload_len;
+    ctx->req.header_fields = headers;
+    ctx->keep_alive = true;
 
 #ifndef CONFIG_SIPF_CONNECTOR_DISABLE_SSL
     bool ssl = true;
 #else
     bool ssl = false;
 #endif
-    return SipfClientHttpRunRequest(CONFIG_SIPF_CONNECTOR_HTTP_HOST, &req, 3 * MSEC_PER_SEC, http_res, ssl);
+    return SipfClientHttpCtxRun(ctx, CONFIG_SIPF_CONNECTOR_HTTP_HOST, ssl);
 }
 
-int SipfObjClientObjUpRaw(uint8_t *payload_buffer, uint16_t size, SipfObjectOtid *otid)
+/**
+ * OBJECTS_UPのペイロードを書く領域(リクエストバッファのヘッダの後ろ)を返す
+ * ここに組み立てたペイロードはSipfObjClientObjUpCtx()でコピーせずに送信する
+ */
+uint8_t *SipfObjClientGetObjUpPayloadBuff(SipfClientHttpCtx *ctx, uint16_t *sz)
+{
+    if (sz != NULL) {
+        *sz = sizeof(ctx->req_buff) - 12 - 1; // HEADER 12を除く(パケット長はBUFF_SZ未満)
+    }
+    return &ctx->req_buff[12];
+}
+
+static int obj_up_ctx(SipfClientHttpCtx *ctx, SipfObjectCommandType command_type, uint16_t size, SipfObjectOtid *otid)
 {
     uint16_t sz_packet = 12 + size; // HEADER 12 + Size
+    uint8_t *req_buff = ctx->req_buff;
 
-    if (sz_packet >= sizeof(httpc_req_buff)) {
+    if (sz_packet >= sizeof(ctx->req_buff)) {
         LOG_ERR("Size is too big %d", size);
         return -1;
     }
 
     // COMMAND_TYPE
-    httpc_req_buff[0] = (uint8_t)OBJECTS_UP;
+    req_buff[0] = (uint8_t)command_type;
     // COMMAND_TIME
-    httpc_req_buff[1] = 0x00;
-    httpc_req_buff[2] = 0x00;
-    httpc_req_buff[3] = 0x00;
-    httpc_req_buff[4] = 0x00;
-    httpc_req_buff[5] = 0x00;
-    httpc_req_buff[6] = 0x00;
-    httpc_req_buff[7] = 0x00;
-    httpc_req_buff[8] = 0x00;
+    req_buff[1] = 0x00;
+    req_buff[2] = 0x00;
+    req_buff[3] = 0x00;
+    req_buff[4] = 0x00;
+    req_buff[5] = 0x00;
+    req_buff[6] = 0x00;
+    req_buff[7] = 0x00;
+    req_buff[8] = 0x00;
     // OPTION_FLAG
-    httpc_req_buff[9] = 0x00;
+    req_buff[9] = 0x00;
 
     // PAYLOAD_SIZE(BigEndian)
     LOG_INF("payload_size: %d", size);
-    httpc_req_buff[10] = size >> 8;
-    httpc_req_buff[11] = size & 0xff;
+    req_buff[10] = size >> 8;
+    req_buff[11] = size & 0xff;
 
-    memcpy(&httpc_req_buff[12], payload_buffer, size);
-    LOG_HEXDUMP_DBG(httpc_req_buff, sz_packet, "request:");
+    LOG_HEXDUMP_DBG(req_buff, sz_packet, "request:");
 
-    static struct http_response http_res;
-    int ret = run_connector_http_request(httpc_req_buff, sz_packet, &http_res);
+    int ret = run_connector_http_request(ctx, sz_packet);
 
     LOG_INF("run_connector_http_request(): %d", ret);
     if (ret < 0) {
         return ret;
     }
 
-    LOG_DBG("Response status %s", http_res.http_status);
-    LOG_DBG("content-length: %d", http_res.content_length);
-    LOG_HEXDUMP_DBG(http_res.body_frag_start, http_res.body_frag_len, "response:");
+    struct http_response *http_res = &ctx->res;
+    LOG_DBG("Response status %s", http_res->http_status);
+    LOG_DBG("content-length: %d", http_res->content_length);
+    LOG_HEXDUMP_DBG(http_res->body_frag_start, http_res->body_frag_len, "response:");
 
     // OBJID_NOTIFICATIONをパース
-    uint8_t *sipf_obj_head = &http_res.body_frag_start[0];
-    uint8_t *sipf_obj_payload = &http_res.body_frag_start[12];
-    if (strcmp(http_res.http_status, "OK") != 0) {
-        LOG_WRN("Invalid HTTP stauts %s", http_res.http_status);
-        if (strcmp(http_res.http_status, "Unauthorized") == 0) {
+    uint8_t *sipf_obj_head = &http_res->body_frag_start[0];
+    uint8_t *sipf_obj_payload = &http_res->body_frag_start[12];
+    if (strcmp(http_res->http_status, "OK") != 0) {
+        LOG_WRN("Invalid HTTP stauts %s", http_res->http_status);
+        if (strcmp(http_res->http_status, "Unauthorized") == 0) {
             return -401;
         }
         // OK以外
         return -1;
     }
 
-    if (http_res.content_length != 30) {
+    if (http_res->content_length != 30) {
         // ペイロード長が合わない
-        LOG_WRN("Invalid HTTP response size %d", http_res.content_length);
+        LOG_WRN("Invalid HTTP response size %d", http_res->content_length);
         return -1;
     }
 
@@ -214,130 +390,252 @@ int SipfObjClientObjUpRaw(uint8_t *payload_buffer, uint16_t size, SipfObjectOtid
     return 0;
 }
 
+/**
+ * ctxのペイロード領域に組み立て済みのOBJECTS_UPを送信する
+ */
+int SipfObjClientObjUpCtx(SipfClientHttpCtx *ctx, uint16_t size, SipfObjectOtid *otid)
+{
+    return obj_up_ctx(ctx, OBJECTS_UP, size, otid);
+}
+
+/**
+ * 一度送れなかったペイロードをOBJECTS_UP_RETRYで送り直す
+ */
+int SipfObjClientObjUpRetryCtx(SipfClientHttpCtx *ctx, uint16_t size, SipfObjectOtid *otid)
+{
+    return obj_up_ctx(ctx, OBJECTS_UP_RETRY, size, otid);
+}
+
+int SipfObjClientObjUpRaw(uint8_t *payload_buffer, uint16_t size, SipfObjectOtid *otid)
+{
+    uint16_t sz_payload;
+
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    if (ctx == NULL) {
+        return -ENOMEM;
+    }
+    uint8_t *payload = SipfObjClientGetObjUpPayloadBuff(ctx, &sz_payload);
+    if (size > sz_payload) {
+        LOG_ERR("Size is too big %d", size);
+        SipfClientHttpCtxFree(ctx);
+        return -1;
+    }
+    memcpy(payload, payload_buffer, size);
+
+    int ret = SipfObjClientObjUpCtx(ctx, size, otid);
+    SipfClientHttpCtxFree(ctx);
+    return ret;
+}
+
+/**
+ * SipfObjectObjectの配列(VALUEはLittleEndianのバイト列)をOBJECTS_UPで送信する
+ *  VALUEはもうバイト列になっていて長さも呼び出し側が決めるので、型ごとの値を取るSipfObjectBuilderは使わずに
+ *  SipfObjectCreateObjUpPayload()でリクエストバッファに直接変換する(値を取り出し直すと余計な変換が増える)
+ *  値を持っている呼び出し側はSipfObjectBuilderを使う
+ */
 int SipfObjClientObjUp(const SipfObjectUp *simp_obj_up, SipfObjectOtid *otid)
 {
+    uint16_t sz_payload;
+
     if (simp_obj_up->objs == NULL){
         return -1;
     }
 
-    uint8_t payload[512];
-    int size = SipfObjectCreateObjUpPayload(payload, sizeof(payload), simp_obj_up->objs, simp_obj_up->obj_qty);
-    return SipfObjClientObjUpRaw(payload, size, otid);
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    if (ctx == NULL) {
+        return -ENOMEM;
+    }
+    // ペイロードはリクエストバッファに直接組み立てる
+    uint8_t *payload = SipfObjClientGetObjUpPayloadBuff(ctx, &sz_payload);
+    int ret = SipfObjectCreateObjUpPayload(payload, sz_payload, simp_obj_up->objs, simp_obj_up->obj_qty);
+    if (ret >= 0) {
+        ret = SipfObjClientObjUpCtx(ctx, ret, otid);
+    }
+    SipfClientHttpCtxFree(ctx);
+    return ret;
 }
 
-int SipfObjClientObjDown(SipfObjectOtid *otid, uint8_t *remains, uint8_t *objqty, uint8_t **p_objs, uint8_t **p_user_send_datetime, uint8_t **p_recv_datetime)
+/** OBJECTS_DOWNのストリームパーサ **/
+#define OBJ_DOWN_HEAD_SZ (12 + 35) // COMMAND HEADER + RESULT〜RESERVED
+
+typedef struct
 {
-    int ret;
+    const SipfObjectDownHandler *handler;
+    uint32_t pos;                     // 受け取ったボディのバイト数
+    uint8_t head[OBJ_DOWN_HEAD_SZ];   // 固定部
+    uint8_t obj[3 + 255];             // 断片をまたいだオブジェクトを組み立てる
+    uint16_t obj_idx;                 // objに組み立てたバイト数
+    int objqty;
+    int err;
+} SipfObjectDownParser;
+
+static int obj_down_parser_head(SipfObjectDownParser *p)
+{
+    uint8_t *sipf_obj_head = &p->head[0];
+    uint8_t *sipf_obj_payload = &p->head[12];
 
-    if (otid == NULL) {
+    if (sipf_obj_head[0] != OBJECTS_DOWN) {
+        // OBJECTS_DOWNじゃない
+        LOG_ERR("Invalid command type: %d", sipf_obj_head[0]);
         return -1;
     }
-    if (objqty == NULL) {
+    if (sipf_obj_payload[0] != 0x00) {
+        // REQEST_RESULTがOK(0x00)じゃない
+        LOG_ERR("REQUEST_RESULT: %d", sipf_obj_payload[0]);
         return -1;
     }
-    if (p_user_send_datetime == NULL) {
+
+    SipfObjectDownHead head;
+    // OTID
+    memcpy(head.otid.value, &sipf_obj_payload[1], sizeof(head.otid.value));
+    // USER_SEND_DATETIME_MS
+    memcpy(head.user_send_datetime, &sipf_obj_payload[17], sizeof(head.user_send_datetime));
+    // RECEIVED_DATETIME_MS
+    memcpy(head.recv_datetime, &sipf_obj_payload[25], sizeof(head.recv_datetime));
+    // REMAINS
+    head.remains = sipf_obj_payload[33];
+    // (RESERVED)
+
+    if (p->handler->on_head != NULL) {
+        return p->handler->on_head(&head, p->handler->user_data);
+    }
+    return 0;
+}
+
+/**
+ * raw(TYPE TAG_ID VALUE_LEN VALUE)のオブジェクトを1つハンドラに渡す
+ */
+static int obj_down_parser_object(SipfObjectDownParser *p, const uint8_t *raw)
+{
+    SipfObjectObject obj;
+    obj.obj_type = raw[0];
+    obj.obj_tagid = raw[1];
+    obj.value_len = raw[2];
+    obj.value = (uint8_t *)&raw[3];
+
+    p->objqty++;
+    if (p->handler->on_object != NULL) {
+        return p->handler->on_object(&obj, p->handler->user_data);
+    }
+    return 0;
+}
+
+/**
+ * 受信したボディの断片を食べる
+ * オブジェクトが断片の中に収まっていればコピーせずにそのまま渡す
+ */
+static void obj_down_parser_feed(const uint8_t *data, size_t len, void *user_data)
+{
+    SipfObjectDownParser *p = (SipfObjectDownParser *)user_data;
+    size_t n;
+
+    while ((len > 0) && (p->err == 0)) {
+        if (p->pos < OBJ_DOWN_HEAD_SZ) {
+            // 固定部
+            n = MIN(len, OBJ_DOWN_HEAD_SZ - p->pos);
+            memcpy(&p->head[p->pos], data, n);
+            if (p->pos + n == OBJ_DOWN_HEAD_SZ) {
+                p->err = obj_down_parser_head(p);
+            }
+        } else if ((p->obj_idx == 0) && (len >= 3) && (len >= 3 + data[2])) {
+            // 断片の中に収まっている
+            n = 3 + data[2];
+            p->err = obj_down_parser_object(p, data);
+        } else {
+            // 断片をまたいでいるので組み立てる
+            uint16_t need = (p->obj_idx < 3) ? (3 - p->obj_idx) : (3 + p->obj[2] - p->obj_idx);
+            n = MIN(len, need);
+            memcpy(&p->obj[p->obj_idx], data, n);
+            p->obj_idx += n;
+            if ((p->obj_idx >= 3) && (p->obj_idx == 3 + p->obj[2])) {
+                p->obj_idx = 0;
+                p->err = obj_down_parser_object(p, p->obj);
+            }
+        }
+        p->pos += n;
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * OBJECTS_DOWN_REQUESTを送信して、受信したOBJECTS_DOWNを順にhandlerに渡す
+ * 受信バッファより大きいレスポンスも断片ごとにパースするので大きさの制限はない
+ * 戻り値: 0以上 オブジェクト数, 負 エラー(-401: 認証失敗)
+ */
+int SipfObjClientObjDown(SipfClientHttpCtx *ctx, const SipfObjectDownHandler *handler)
+{
+    int ret;
+
+    if (ctx == NULL) {
         return -1;
     }
-    if (p_recv_datetime == NULL) {
+    if (handler == NULL) {
         return -1;
     }
 
-    memset(httpc_req_buff, 0x00, BUFF_SZ);
+    uint8_t *req_buff = ctx->req_buff;
+    memset(req_buff, 0x00, sizeof(ctx->req_buff));
 
     // COMMAND_TYPE
-    httpc_req_buff[0] = (uint8_t)OBJECTS_DOWN_REQUEST;
+    req_buff[0] = (uint8_t)OBJECTS_DOWN_REQUEST;
     // COMMAND_TIME
-    httpc_req_buff[1] = 0x00;
-    httpc_req_buff[2] = 0x00;
-    httpc_req_buff[3] = 0x00;
-    httpc_req_buff[4] = 0x00;
-    httpc_req_buff[5] = 0x00;
-    httpc_req_buff[6] = 0x00;
-    httpc_req_buff[7] = 0x00;
-    httpc_req_buff[8] = 0x00;
+    req_buff[1] = 0x00;
+    req_buff[2] = 0x00;
+    req_buff[3] = 0x00;
+    req_buff[4] = 0x00;
+    req_buff[5] = 0x00;
+    req_buff[6] = 0x00;
+    req_buff[7] = 0x00;
+    req_buff[8] = 0x00;
     // OPTION_FLAG
-    httpc_req_buff[9] = 0x00;
+    req_buff[9] = 0x00;
     // PAYLOAD_SIZE(BigEndian)
-    httpc_req_buff[10] = 0x00;
-    httpc_req_buff[11] = 0x01;
+    req_buff[10] = 0x00;
+    req_buff[11] = 0x01;
 
     // OBJECTS_DOWN
-    httpc_req_buff[12] = 0x00; // RESERVED
+    req_buff[12] = 0x00; // RESERVED
+
+    /* レスポンスは受信しながらパースする(body_cbを設定するとやり直さないので、パーサーは1回の応答だけを見る) */
+    SipfObjectDownParser parser;
+    memset(&parser, 0, sizeof(parser));
+    parser.handler = handler;
+    ctx->body_cb = obj_down_parser_feed;
+    ctx->body_user_data = &parser;
 
     /* リクエスト送信 */
-    static struct http_response http_res;
-    memset(&http_res, 0, sizeof(struct http_response));
-    ret = run_connector_http_request(httpc_req_buff, 13, &http_res);
+    ret = run_connector_http_request(ctx, 13);
+    ctx->body_cb = NULL;
 
     LOG_INF("run_connector_http_request(): %d", ret);
     if (ret < 0) {
         return ret;
     }
 
-    LOG_INF("Response status %s(%d)", http_res.http_status, http_res.http_status_code);
-    LOG_INF("data_len: %d content-length: %d", http_res.data_len, http_res.content_length);
-    LOG_HEXDUMP_DBG(http_res.body_frag_start, http_res.body_frag_len, "response:");
+    struct http_response *http_res = &ctx->res;
+    LOG_INF("Response status %s(%d)", http_res->http_status, http_res->http_status_code);
+    LOG_INF("body: %d content-length: %d", parser.pos, http_res->content_length);
     /* レスポンスを処理 */
-    uint8_t *sipf_obj_head = &http_res.body_frag_start[0];
-    uint8_t *sipf_obj_payload = &http_res.body_frag_start[12];
-    if (strcmp(http_res.http_status, "OK") != 0) {
-        if (strcmp(http_res.http_status, "Unauthorized") == 0) {
+    if (strcmp(http_res->http_status, "OK") != 0) {
+        if (strcmp(http_res->http_status, "Unauthorized") == 0) {
             return -401;
         }
         // OK以外
         return -1;
     }
-
-    // OBJECTS_DOWNをパース
-    if ((http_res.content_length < 12) || (http_res.content_length >= 12 + BUFF_SZ)) {
-        // ザイズが仕様の範囲外
-        LOG_ERR("Invalid content_length: %d", http_res.content_length);
-        return -1;
+    if (parser.err != 0) {
+        // ヘッダが不正かハンドラが中断した
+        return parser.err;
     }
-    if (sipf_obj_head[0] != OBJECTS_DOWN) {
-        // OBJECTS_DOWNじゃない
-        LOG_ERR("Invalid command type: %d", sipf_obj_head[0]);
-        return -1;
-    }
-
-    if (sipf_obj_payload[0] != 0x00) {
-        // REQEST_RESULTがOK(0x00)じゃない
-        LOG_ERR("REQUEST_RESULT: %d", sipf_obj_payload[0]);
+    if ((parser.pos < OBJ_DOWN_HEAD_SZ) || (parser.pos != http_res->content_length) || (parser.obj_idx != 0)) {
+        // 途中で切れた
+        LOG_ERR("Truncated OBJECTS_DOWN: %d/%d", parser.pos, http_res->content_length);
         return -1;
     }
-
-    // OTIDをコピー
-    memcpy(&otid->value, &sipf_obj_payload[1], sizeof(otid->value));
-    // USER_SEND_DATETIME_MSへのポインタをコピー
-    *p_user_send_datetime = &sipf_obj_payload[17];
-    // RECEIVED_DATETIME_MSへのポインタをコピー
-    *p_recv_datetime = &sipf_obj_payload[25];
-    // REMAINS
-    *remains = sipf_obj_payload[33];
-    // (RESERVED)
-
-    // obj
-    *objqty = 0;
-    if (http_res.content_length == 12 + 35) {
+    if (parser.objqty == 0) {
         // objなし
         LOG_INF("empty");
-        return 0;
-    }
-    int idx = 35; // objの先頭
-    for (;;) {
-        //オブジェクトの先頭ポインタをリストに追加
-        p_objs[(*objqty)++] = &sipf_obj_payload[idx];
-        //オブジェクト数の上限に達してたら中断
-        if (*objqty >= OBJ_MAX_CNT) {
-            break;
-        }
-        //インデックスを次のオブジェクトの先頭に設定
-        idx += (3 + sipf_obj_payload[idx + 2]);
-        if (idx >= http_res.content_length - 12) {
-            //インデックスが受信データの終端を超えた
-            break;
-        }
     }
-
-    return 0;
-}
\ No newline at end of file
+    return parser.objqty;
+}
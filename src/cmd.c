@@ -6,29 +6,46 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(sipf);
 
 #include "cmd.h"
 #include "cmd_ascii.h"
+#include "cmd_bin.h"
+#include "cmd_job.h"
+#include "rx_queue.h"
+#include "uart_broker.h"
 
 static CmdState state = CMD_STATE_WAIT;
-static uint8_t in_buff[CMD_BUFF_SZ];
+static uint8_t in_buff[CMD_IN_BUFF_SZ];
 static int in_buff_idx;
 static uint8_t out_buff[CMD_BUFF_SZ];
+// 先読みしたメッセージは直接$$RXで受信できるものより小さくしない(サーバーからは受信した時点で消えるので入らないと失われる)
+BUILD_ASSERT(RX_QUEUE_OBJS_SZ >= (CMD_BUFF_SZ - CMD_RX_SINK_SZ), "RX_QUEUE_OBJS_SZ is smaller than $RX");
 static int out_len;
 
 static CmdResponse cmdres;
 
+static int64_t bin_last_ms;
+static int bin_skip; // 長すぎたフレームの読み捨てる残りのバイト数
+
 typedef CmdResponse *(*state_func)(uint8_t b);
 
 static CmdResponse *stateWait(uint8_t b)
 {
     if (b == (uint8_t)'$') {
-        memset(in_buff, 0, CMD_BUFF_SZ);
+        memset(in_buff, 0, sizeof(in_buff));
         in_buff_idx = 0;
         state = CMD_STATE_BUFFERING_ASCII;
+    } else if (b == CMD_BIN_SOF) {
+        // バイナリコマンド開始(SOFを受信した時点でエコーバックは止まってる)
+        UartBrokerSetEcho(false);
+        in_buff_idx = 0;
+        bin_last_ms = k_uptime_get();
+        state = CMD_STATE_BUFFERING_BIN;
     }
     return NULL;
 }
@@ -37,6 +54,8 @@ static CmdResponse *stateBufferingAscii(uint8_t b)
 {
     if ((b == 0x0a) || (b == 0x0d)) {
         state = CMD_STATE_WAIT;
+        // 行の途中にSOFがあって止まったエコーバックを戻す
+        UartBrokerSetEcho(true);
         // 改行がきたらコマンド終端
         out_len = CmdAsciiParse(in_buff, in_buff_idx, out_buff, sizeof(out_buff));
         if (out_len > 0) {
@@ -55,11 +74,21 @@ static CmdResponse *stateBufferingAscii(uint8_t b)
         }
         in_buff_idx--;
     } else {
+        if ((b == ' ') && (memchr(in_buff, ' ', in_buff_idx) == NULL)) {
+            // コマンド名の終端
+            if (CmdAsciiStreamBegin(in_buff, in_buff_idx)) {
+                // 以降はバッファせずにコマンドへ渡す
+                state = CMD_STATE_STREAMING_ASCII;
+                CmdAsciiStreamPut(b);
+                return NULL;
+            }
+        }
         // バッファに追加
         in_buff[in_buff_idx++] = b;
-        if (in_buff_idx > sizeof(in_buff)) {
+        if (in_buff_idx >= sizeof(in_buff)) {
             // バッファオーバー
             state = CMD_STATE_WAIT;
+            UartBrokerSetEcho(true);
             LOG_ERR("CMD BUFFER FULL");
             cmdres.response_len = sprintf((char *)out_buff, "\r\nNG\r\n");
             cmdres.response = out_buff;
@@ -69,13 +98,110 @@ static CmdResponse *stateBufferingAscii(uint8_t b)
     return NULL;
 }
 
+static CmdResponse *stateStreamingAscii(uint8_t b)
+{
+    if ((b == 0x0a) || (b == 0x0d)) {
+        state = CMD_STATE_WAIT;
+        // 行の途中にSOFがあって止まったエコーバックを戻す
+        UartBrokerSetEcho(true);
+        // 改行がきたらコマンド終端
+        out_len = CmdAsciiStreamEnd(out_buff, sizeof(out_buff));
+        if (out_len > 0) {
+            cmdres.response = out_buff;
+            cmdres.response_len = out_len;
+            return &cmdres; // コマンドの応答を返す
+        }
+        return NULL;
+    }
+    if (b == 0x08 /*BS*/) {
+        // デコード済みなので戻せない(改行でパラメータエラーを返す)
+        LOG_WRN("BS is not supported");
+        b = 0x00;
+    }
+    // 失敗しても改行までは読み捨てて、改行でエラーを返す
+    CmdAsciiStreamPut(b);
+    return NULL;
+}
+
+static CmdResponse *stateBufferingBin(uint8_t b)
+{
+    int64_t now = k_uptime_get();
+    if ((now - bin_last_ms) > CMD_BIN_TIMEOUT_MS) {
+        // フレームが途切れたので捨ててコマンド待ちからやり直す
+        LOG_WRN("BIN FRAME TIMEOUT");
+        state = CMD_STATE_WAIT;
+        UartBrokerSetEcho(true);
+        return stateWait(b);
+    }
+    bin_last_ms = now;
+
+    // バッファに追加
+    in_buff[in_buff_idx++] = b;
+    if (in_buff_idx < CMD_BIN_HEADER_SZ) {
+        return NULL;
+    }
+
+    uint16_t len = sys_get_be16(&in_buff[1]);
+    if (len > CMD_BIN_PAYLOAD_MAX) {
+        // 長すぎるのでヘッダだけで応答して、残りのペイロードとCRCは読み捨てる
+        out_len = CmdBinParse(in_buff, CMD_BIN_HEADER_SZ, out_buff, sizeof(out_buff));
+        bin_skip = len + CMD_BIN_CRC_SZ;
+        state = CMD_STATE_SKIPPING_BIN;
+        cmdres.response = out_buff;
+        cmdres.response_len = out_len;
+        return &cmdres;
+    } else if (in_buff_idx < CMD_BIN_HEADER_SZ + len + CMD_BIN_CRC_SZ) {
+        // まだ途中
+        return NULL;
+    }
+
+    // フレーム終端
+    state = CMD_STATE_WAIT;
+    out_len = CmdBinParse(in_buff, in_buff_idx, out_buff, sizeof(out_buff));
+    UartBrokerSetEcho(true);
+    cmdres.response = out_buff;
+    cmdres.response_len = out_len;
+    return &cmdres;
+}
+
+static CmdResponse *stateSkippingBin(uint8_t b)
+{
+    int64_t now = k_uptime_get();
+    if ((now - bin_last_ms) > CMD_BIN_TIMEOUT_MS) {
+        // 途切れたら残りは来ないのでコマンド待ちからやり直す
+        LOG_WRN("BIN FRAME TIMEOUT");
+        state = CMD_STATE_WAIT;
+        UartBrokerSetEcho(true);
+        return stateWait(b);
+    }
+    bin_last_ms = now;
+
+    if (--bin_skip <= 0) {
+        // 長すぎたフレームの終端
+        state = CMD_STATE_WAIT;
+        UartBrokerSetEcho(true);
+    }
+    return NULL;
+}
+
 static state_func bufunc[] = {
     stateWait,           /* STATE_WAIT */
     stateBufferingAscii, /* STATE_BUFFERING_ASCII */
-    NULL,                /* STATE_BUFFERING_BIN */
+    stateBufferingBin,   /* STATE_BUFFERING_BIN */
+    stateStreamingAscii, /* STATE_STREAMING_ASCII */
+    stateSkippingBin,    /* STATE_SKIPPING_BIN */
     NULL,                /* (terminator) */
 };
 
+void CmdInit(void)
+{
+    CmdAsciiInit();
+    CmdJobInit();
+
+    // SOFを受信したらエコーバックを止める
+    UartBrokerSetEchoBreak(CMD_BIN_SOF);
+}
+
 CmdResponse *CmdParse(uint8_t b)
 {
     CmdResponse *cr = NULL;
@@ -7,71 +7,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
 #include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(sipf);
 
 #include "cmd_ascii.h"
+#include "cmd_ascii_table.h"
+#include "cmd_job.h"
+#include "cmd_sink.h"
+#include "hex.h"
+#include "outbox.h"
 #include "registers.h"
+#include "rx_queue.h"
+#include "uart_broker.h"
 #include "xmodem.h"
+#include "xmodem_pipe.h"
 #include "fota/fota_http.h"
 #include "sipf/sipf_client_http.h"
 #include "sipf/sipf_file.h"
-#include "gnss/gnss.h"
+#include "sipf/sipf_object.h"
 
-static uint8_t buff_work[256];
-/**/
-typedef int (*ascii_cmd_func)(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len);
-typedef struct
-{
-    char *cmd_name;
-    ascii_cmd_func cmd_func;
-} CmdAsciiCmd;
-/**/
+/* ストリーム処理中のコマンド */
+static const CmdAsciiCmd *cmd_stream;
 
 static bool is_unlocked = false;
 
-/**
- * 2桁の16進文字列をUINT8に変換する
- */
-static uint8_t hexToUint8(uint8_t *pchars, uint8_t *err)
-{
-    uint8_t ret = 0;
-    if (err) {
-        *err = 0;
-    }
-
-    for (int i = 0; i < 2; i++) {
-        if ((pchars[i] >= (uint8_t)'0') && (pchars[i] <= (uint8_t)'9')) {
-            ret |= (pchars[i] - (uint8_t)'0') << (i == 0 ? 4 : 0);
-        } else if ((pchars[i] >= (uint8_t)'a') && (pchars[i] <= (uint8_t)'f')) {
-            ret |= (pchars[i] - (uint8_t)'a' + 10) << (i == 0 ? 4 : 0);
-        } else if ((pchars[i] >= (uint8_t)'A') && (pchars[i] <= (uint8_t)'F')) {
-            ret |= (pchars[i] - (uint8_t)'A' + 10) << (i == 0 ? 4 : 0);
-        } else {
-            if (err) {
-                ret = 0;
-                *err = 0xff;
-            }
-        }
-    }
-    return ret;
-}
-
-static int cmdCreateResIllParam(uint8_t *out_buff, uint16_t out_buff_len)
+int CmdAsciiResIllParam(uint8_t *out_buff, uint16_t out_buff_len)
 {
     return snprintf(out_buff, out_buff_len, "ILLIGAL PARAMETER\r\nNG\r\n");
 }
 
-static int cmdCreateResOk(uint8_t *out_buff, uint16_t out_buff_len)
+int CmdAsciiResOk(uint8_t *out_buff, uint16_t out_buff_len)
 {
     return snprintf(out_buff, out_buff_len, "OK\r\n");
 }
 
-static int cmdCreateResNg(uint8_t *out_buff, uint16_t out_buff_len)
+int CmdAsciiResNg(uint8_t *out_buff, uint16_t out_buff_len)
 {
     return snprintf(out_buff, out_buff_len, "NG\r\n");
 }
@@ -82,12 +56,12 @@ static int cmdAsciiCmdW(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, ui
 
     if (in_len != 6) {
         // lengthが合わない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
     if (in_buff[3] != 0x20) {
         // ADDRとVALUEの区切りがスペースじゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
     if (in_buff[0] != 0x20) {
@@ -105,33 +79,34 @@ static int cmdAsciiCmdW(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, ui
     addr = strtol((char *)&in_buff[1], &endptr, 16);
     if (*endptr != '\0') {
         // Null文字以外で変換が終わってる
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
     val = strtol((char *)&in_buff[4], &endptr, 16);
     if (*endptr != '\0') {
         // Null文字以外で変換が終わってる
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
     if (RegistersWrite(addr, val) < 0) {
         // 書き込みエラー
-        return cmdCreateResNg(out_buff, out_buff_len);
+        return CmdAsciiResNg(out_buff, out_buff_len);
     }
 
-    return cmdCreateResOk(out_buff, out_buff_len);
+    return CmdAsciiResOk(out_buff, out_buff_len);
 }
+CMD_ASCII_DEFINE(reg_w, CMD_REG_W, cmdAsciiCmdW);
 
 static int cmdAsciiCmdR(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
 {
     is_unlocked = false;
     if (in_len != 3) {
         // lengthが合わない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
     if (in_buff[0] != 0x20) {
         // 先頭がスペースじゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
     //文字列として処理できるように区切りをNull文字にする
     in_buff[3] = 0x00;
@@ -142,16 +117,17 @@ static int cmdAsciiCmdR(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, ui
     addr = strtol((char *)&in_buff[1], &endptr, 16);
     if (*endptr != '\0') {
         // Null文字以外で変換が終わってる
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
     if (RegistersRead(addr, &val) < 0) {
         // 読み出しエラー
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
     return sprintf(out_buff, "%02X\r\nOK\r\n", val);
 }
+CMD_ASCII_DEFINE(reg_r, CMD_REG_R, cmdAsciiCmdR);
 
 static int checkTypeLen(uint8_t type_id, uint16_t len)
 {
@@ -196,217 +172,510 @@ static int checkTypeLen(uint8_t type_id, uint16_t len)
 }
 
 /**
- * OBJECT送信
+ * $$TX/$$TXRAWのストリームパーサ
+ * 1byte受信するごとにHEXをデコードしてSIPFのリクエストバッファ(OBJECTS_UPのペイロード)に直接書く
  */
-static uint8_t tx_buff[1024];
-static int cmdAsciiCmdTx(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+static struct
 {
-    enum
-    {
-        ST_BEGIN,
-        ST_TAG_ID,
-        ST_TYPE,
-        ST_VALUE,
-        ST_END
-    } parse_state = ST_BEGIN;
+    uint8_t *buff;    // デコード先(OBJECTS_UPのペイロード)
+    uint16_t buff_sz; // デコード先のサイズ
+    uint16_t idx;     // デコード先のインデックス
+    uint8_t state;
+    uint8_t nibble; // 1文字目の値(TX_STREAM_NIBBLE_*なら2文字目待ちではない)
+    uint8_t tag_id;
+    uint8_t type_id;
+    uint16_t idx_value_len; // VALUE_LENを書く位置
+    uint16_t value_len;
+    uint8_t size; // $$TXRAWのSIZE
+    bool err;
+    bool busy;              // ジョブかリクエストコンテキストの空きがない
+    CmdJob *job;            // 非同期で実行するときのジョブ(ジョブのバッファにデコードする)
+    SipfClientHttpCtx *ctx; // 同期で実行するときのリクエストコンテキスト(リクエストバッファにデコードする)
+} tx_stream;
+
+enum
+{
+    ST_BEGIN,
+    ST_TAG_ID,
+    ST_TYPE,
+    ST_VALUE,
+    ST_SIZE,
+};
 
-    uint16_t idx_in_buff = 0;
-    uint16_t idx_tx_buff = 0;
+#define TX_STREAM_NIBBLE_NONE (0xff) // 1文字目待ち
+#define TX_STREAM_NIBBLE_SEP (0xfe)  // 2文字そろったので区切り(スペース)待ち
 
-    if (in_len < 8) {
-        // valueまでの長さが無い
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+/**
+ * 16進文字を1文字受け取って2文字そろったらバイトを返す
+ * 戻り値: 0x00-0xff バイト, 1文字目だけ -EAGAIN, 16進文字以外 -EINVAL
+ */
+static int txStreamHex(uint8_t c)
+{
+    int n = HexNibble(c);
+    if (n < 0) {
+        return -EINVAL;
+    }
+    if (tx_stream.nibble == TX_STREAM_NIBBLE_NONE) {
+        tx_stream.nibble = n;
+        return -EAGAIN;
     }
+    n |= tx_stream.nibble << 4;
+    tx_stream.nibble = TX_STREAM_NIBBLE_NONE;
+    return n;
+}
+
+static void txStreamAbort(void)
+{
+    CmdJobFree(tx_stream.job);
+    tx_stream.job = NULL;
+    SipfClientHttpCtxFree(tx_stream.ctx);
+    tx_stream.ctx = NULL;
+}
+
+static void txStreamBegin(void)
+{
+    // 前のコマンドが改行まで来なかったときのジョブを捨てる
+    txStreamAbort();
+
+    tx_stream.busy = false;
+    if (CmdJobIsAsync()) {
+        tx_stream.job = CmdJobAlloc();
+        if (tx_stream.job != NULL) {
+            tx_stream.buff = tx_stream.job->payload;
+            tx_stream.buff_sz = sizeof(tx_stream.job->payload);
+        } else {
+            tx_stream.busy = true;
+        }
+    } else {
+        // UARTの受信中なので待たない(空いていなければ改行でNGを返す)
+        tx_stream.ctx = SipfClientHttpCtxAlloc(K_NO_WAIT);
+        if (tx_stream.ctx != NULL) {
+            tx_stream.buff = SipfObjClientGetObjUpPayloadBuff(tx_stream.ctx, &tx_stream.buff_sz);
+        } else {
+            tx_stream.busy = true;
+        }
+    }
+    tx_stream.idx = 0;
+    tx_stream.state = ST_BEGIN;
+    tx_stream.nibble = TX_STREAM_NIBBLE_NONE;
+    tx_stream.value_len = 0;
+    tx_stream.size = 0;
+    tx_stream.err = tx_stream.busy;
+}
+
+static int txStreamPutByte(uint8_t b)
+{
+    if (tx_stream.idx >= tx_stream.buff_sz) {
+        LOG_ERR("TX: payload buffer full");
+        return -ENOMEM;
+    }
+    tx_stream.buff[tx_stream.idx++] = b;
+    return 0;
+}
+
+/**
+ * OTIDの応答を作る
+ */
+static int cmdAsciiResOtid(const SipfObjectOtid *otid, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    int len = HexEncode(out_buff, otid->value, sizeof(otid->value));
+    len += sprintf(&out_buff[len], "\r\nOK\r\n");
+    return len;
+}
 
-    memset(tx_buff, 0, sizeof(tx_buff));
+/**
+ * デコードしたOBJECTS_UPを送信する
+ * 非同期ならジョブを投入して受付を返す
+ */
+static int txStreamSend(uint8_t *out_buff, uint16_t out_buff_len)
+{
+    if (tx_stream.job != NULL) {
+        CmdJob *job = tx_stream.job;
+        tx_stream.job = NULL;
+        int id = CmdJobSubmitTx(job, tx_stream.idx);
+        return snprintf(out_buff, out_buff_len, "+ACCEPT:%02X\r\nOK\r\n", id);
+    }
 
-    uint8_t tag_id, type_id;
-    uint8_t value_len = 0;
-    uint16_t idx_value_len;
-    uint8_t err;
+    // SIPF_OBJ_UP送信(ペイロードはリクエストバッファに組み立て済み)
     SipfObjectOtid otid;
-    int len = 0;
-    for (;;) {
-        switch (parse_state) {
-        case ST_BEGIN:
-            if (in_buff[idx_in_buff] == ' ') {
-                idx_in_buff++;
-                parse_state = ST_TAG_ID; // TAG_IDのパースへ遷移
-            } else {
-                LOG_ERR("BEGIN: Invalid separater");
-                return cmdCreateResIllParam(out_buff, out_buff_len);
-            }
-            break;
-        case ST_TAG_ID: // TAG_IDのパース
-            if (in_buff[idx_in_buff + 2] == ' ') {
-                in_buff[idx_in_buff + 2] = '\0';
-                // TAG_IDを送信バッファにセット
-                tag_id = hexToUint8(&in_buff[idx_in_buff], &err);
-                LOG_INF("TAG_ID: 0x%02x", tag_id);
-                if (err != 0) {
-                    // 変換失敗
-                    LOG_ERR("TAG_ID: parse failed...");
-                    return cmdCreateResIllParam(out_buff, out_buff_len);
-                }
-                idx_in_buff += 3;      // 入力バッファのインデックスを進める
-                parse_state = ST_TYPE; // TYPEのパースへ遷移
-            } else {
-                LOG_ERR("TAG_ID: Invalid separater");
-                return cmdCreateResIllParam(out_buff, out_buff_len);
+    int err = SipfObjClientObjUpCtx(tx_stream.ctx, tx_stream.idx, &otid);
+    bool queued = false;
+    if (err != 0) {
+        LOG_ERR("SipfClientObjUpRaw() failed: %d", err);
+        // REG_01_OUTBOX=0x01ならフラッシュに溜めて後で送り直す
+        queued = CmdJobStoreOutbox(tx_stream.buff, tx_stream.idx);
+    } else {
+        CmdJobKickOutbox();
+    }
+    SipfClientHttpCtxFree(tx_stream.ctx);
+    tx_stream.ctx = NULL;
+    if (err != 0) {
+        if (queued) {
+            return snprintf(out_buff, out_buff_len, "QUEUED\r\nOK\r\n");
+        }
+        return CmdAsciiResNg(out_buff, out_buff_len);
+    }
+    return cmdAsciiResOtid(&otid, out_buff, out_buff_len);
+}
+
+/**
+ * OBJECT送信
+ * $$TX TT YY VVVV.. [TT YY VVVV..]..
+ */
+static void cmdAsciiCmdTxBegin(void)
+{
+    txStreamBegin();
+}
+
+static int cmdAsciiCmdTxPut(uint8_t c)
+{
+    int ret;
+
+    if (tx_stream.err) {
+        // エラー後は改行まで読み捨てる
+        return -EINVAL;
+    }
+
+    switch (tx_stream.state) {
+    case ST_BEGIN:
+        if (c != ' ') {
+            LOG_ERR("BEGIN: Invalid separater");
+            goto err;
+        }
+        tx_stream.state = ST_TAG_ID; // TAG_IDのパースへ遷移
+        return 0;
+    case ST_TAG_ID: // TAG_IDのパース
+    case ST_TYPE:   // TYPEのパース
+        if (c == ' ') {
+            if (tx_stream.nibble != TX_STREAM_NIBBLE_SEP) {
+                LOG_ERR("TAG_ID/TYPE: Invalid separater");
+                goto err;
             }
-            break;
-        case ST_TYPE: // TYPEのパース
-            if (in_buff[idx_in_buff + 2] == ' ') {
-                in_buff[idx_in_buff + 2] = '\0';
-                // TYPE_IDを送信バッファにセット
-                type_id = hexToUint8(&in_buff[idx_in_buff], &err);
-                LOG_INF("TYPE: 0x%02x", type_id);
-                if (err != 0) {
-                    // 変換失敗
-                    LOG_ERR("TYPE: parse failed...");
-                    return cmdCreateResIllParam(out_buff, out_buff_len);
-                }
-                idx_in_buff += 3; // 入力バッファのインデックスを進める
-                // 送信バッファに積んでVALUEのパースへ
-                tx_buff[idx_tx_buff++] = type_id;
-                tx_buff[idx_tx_buff++] = tag_id;
-                idx_value_len = idx_tx_buff++;
-                value_len = 0;
-                parse_state = ST_VALUE; // VALUEのパースへ遷移
-            } else {
-                LOG_ERR("TYPE: Invalid separater");
-                return cmdCreateResIllParam(out_buff, out_buff_len);
+            tx_stream.nibble = TX_STREAM_NIBBLE_NONE;
+            if (tx_stream.state == ST_TAG_ID) {
+                tx_stream.state = ST_TYPE; // TYPEのパースへ遷移
+                return 0;
             }
-            break;
-        case ST_VALUE:                   // Valueのパース
-            if (idx_in_buff >= in_len) { // 入力の末尾へ到達
-                // TYPEとデータ長が矛盾してたらエラー
-                if (checkTypeLen(type_id, value_len) == false) {
-                    LOG_ERR("VALUE: Value length missmatch...");
-                    return cmdCreateResIllParam(out_buff, out_buff_len);
-                }
-                // パース終了
-                LOG_INF("VALUE_LEN: %d", value_len);
-                tx_buff[idx_value_len] = value_len;
-                parse_state = ST_END;
-                break;
+            // 送信バッファに積んでVALUEのパースへ
+            if ((txStreamPutByte(tx_stream.type_id) < 0) || (txStreamPutByte(tx_stream.tag_id) < 0)) {
+                goto err;
             }
-            if (in_buff[idx_in_buff] == ' ') { // スペースだったら
-                // TYPEとデータ長が矛盾してたらエラー
-                if (checkTypeLen(type_id, value_len) == false) {
-                    LOG_ERR("VALUE: Value length missmatch...");
-                    return cmdCreateResIllParam(out_buff, out_buff_len);
-                }
-                // 次のオブジェクトのパースへ
-                LOG_INF("VALUE_LEN: %d", value_len);
-                tx_buff[idx_value_len] = value_len;
-                idx_in_buff++;
-                parse_state = ST_TAG_ID;
-                break;
+            tx_stream.idx_value_len = tx_stream.idx;
+            if (txStreamPutByte(0) < 0) {
+                goto err;
             }
-            // 2文字ずつ読んでByteに変換
-            tx_buff[idx_tx_buff++] = hexToUint8(&in_buff[idx_in_buff], &err);
-            if (err != 0) {
-                LOG_ERR("VALUE: parse failed...");
-                return cmdCreateResIllParam(out_buff, out_buff_len);
+            tx_stream.value_len = 0;
+            tx_stream.state = ST_VALUE; // VALUEのパースへ遷移
+            return 0;
+        }
+        if (tx_stream.nibble == TX_STREAM_NIBBLE_SEP) {
+            // 3文字目はスペースじゃないとダメ
+            LOG_ERR("TAG_ID/TYPE: Invalid separater");
+            goto err;
+        }
+        ret = txStreamHex(c);
+        if (ret == -EAGAIN) {
+            return 0;
+        }
+        if (ret < 0) {
+            LOG_ERR("TAG_ID/TYPE: parse failed...");
+            goto err;
+        }
+        if (tx_stream.state == ST_TAG_ID) {
+            tx_stream.tag_id = ret;
+            LOG_INF("TAG_ID: 0x%02x", tx_stream.tag_id);
+        } else {
+            tx_stream.type_id = ret;
+            LOG_INF("TYPE: 0x%02x", tx_stream.type_id);
+        }
+        tx_stream.nibble = TX_STREAM_NIBBLE_SEP;
+        return 0;
+    case ST_VALUE: // Valueのパース
+        if (c == ' ') {
+            // TYPEとデータ長が矛盾してたらエラー
+            if ((tx_stream.nibble != TX_STREAM_NIBBLE_NONE) || (checkTypeLen(tx_stream.type_id, tx_stream.value_len) == false)) {
+                LOG_ERR("VALUE: Value length missmatch...");
+                goto err;
             }
-            value_len++;
-            idx_in_buff += 2;
-            break;
-        case ST_END:
-            goto parse_end;
-            break;
-        default:
-            // 想定外のステート
-            return cmdCreateResNg(out_buff, out_buff_len);
+            // 次のオブジェクトのパースへ
+            LOG_INF("VALUE_LEN: %d", tx_stream.value_len);
+            tx_stream.buff[tx_stream.idx_value_len] = tx_stream.value_len;
+            tx_stream.state = ST_TAG_ID;
+            return 0;
+        }
+        // 2文字ずつ読んでByteに変換
+        ret = txStreamHex(c);
+        if (ret == -EAGAIN) {
+            return 0;
+        }
+        if (ret < 0) {
+            LOG_ERR("VALUE: parse failed...");
+            goto err;
+        }
+        if ((tx_stream.value_len >= UINT8_MAX) || (txStreamPutByte(ret) < 0)) {
+            LOG_ERR("VALUE: too long");
+            goto err;
         }
+        tx_stream.value_len++;
+        return 0;
+    default:
+        // 想定外のステート
+        break;
     }
+err:
+    tx_stream.err = true;
+    return -EINVAL;
+}
+
+static int cmdAsciiCmdTx(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    if (tx_stream.busy) {
+        // ジョブかHTTPリクエストのコンテキストの空きがない
+        return CmdAsciiResNg(out_buff, out_buff_len);
+    }
+    if (tx_stream.err || (tx_stream.state != ST_VALUE) || (tx_stream.nibble != TX_STREAM_NIBBLE_NONE)) {
+        // VALUEの途中で終わってない
+        txStreamAbort();
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+    // TYPEとデータ長が矛盾してたらエラー
+    if (checkTypeLen(tx_stream.type_id, tx_stream.value_len) == false) {
+        LOG_ERR("VALUE: Value length missmatch...");
+        txStreamAbort();
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+    // パース終了
+    LOG_INF("VALUE_LEN: %d", tx_stream.value_len);
+    tx_stream.buff[tx_stream.idx_value_len] = tx_stream.value_len;
+
+    return txStreamSend(out_buff, out_buff_len);
+}
+CMD_ASCII_DEFINE_STREAM(tx, CMD_TX, cmdAsciiCmdTxBegin, cmdAsciiCmdTxPut, cmdAsciiCmdTx);
 
-parse_end:
+/**
+ * バイト列送信
+ * $$TXRAW SS VVVV..
+ */
+static void cmdAsciiCmdTxRawBegin(void)
+{
+    is_unlocked = false;
+    txStreamBegin();
+}
 
-    // SIPF_OBJ_UP送信
-    err = SipfObjClientObjUpRaw(tx_buff, idx_tx_buff, &otid);
-    len = 0;
-    if (err == 0) {
-        // OTID取得
-        for (int i = 0; i < sizeof(otid.value); i++) {
-            len += sprintf(&out_buff[i * 2], "%02X", otid.value[i]);
+static int cmdAsciiCmdTxRawPut(uint8_t c)
+{
+    int ret;
+
+    if (tx_stream.err) {
+        // エラー後は改行まで読み捨てる
+        return -EINVAL;
+    }
+
+    switch (tx_stream.state) {
+    case ST_BEGIN:
+        if (c != ' ') {
+            // 先頭がスペースじゃない
+            goto err;
         }
-        len += sprintf(&out_buff[len], "\r\nOK\r\n");
-    } else {
-        LOG_ERR("SipfClientObjUpRaw() failed: %d", err);
-        return cmdCreateResNg(out_buff, out_buff_len);
+        tx_stream.state = ST_SIZE;
+        return 0;
+    case ST_SIZE:
+        if (c == ' ') {
+            if ((tx_stream.nibble != TX_STREAM_NIBBLE_SEP) || (tx_stream.size == 0)) {
+                // SIZEが2文字じゃない
+                goto err;
+            }
+            LOG_DBG("TXRAW Size:%d", tx_stream.size);
+            tx_stream.nibble = TX_STREAM_NIBBLE_NONE;
+            tx_stream.state = ST_VALUE;
+            return 0;
+        }
+        if (tx_stream.nibble == TX_STREAM_NIBBLE_SEP) {
+            // 3文字目はスペースじゃないとダメ
+            goto err;
+        }
+        ret = txStreamHex(c);
+        if (ret == -EAGAIN) {
+            return 0;
+        }
+        if (ret < 0) {
+            goto err;
+        }
+        tx_stream.size = ret;
+        tx_stream.nibble = TX_STREAM_NIBBLE_SEP;
+        return 0;
+    case ST_VALUE:
+        ret = txStreamHex(c);
+        if (ret == -EAGAIN) {
+            return 0;
+        }
+        if (ret < 0) {
+            LOG_WRN("Invalid charctor");
+            goto err;
+        }
+        if ((tx_stream.idx >= tx_stream.size) || (txStreamPutByte(ret) < 0)) {
+            // 文字があまっている
+            LOG_WRN("Invalid length");
+            goto err;
+        }
+        return 0;
+    default:
+        // 想定外のステート
+        break;
     }
-    return len;
+err:
+    tx_stream.err = true;
+    return -EINVAL;
 }
 
 static int cmdAsciiCmdTxRaw(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
 {
-    // $TXRAW XX YYYYYYYYYY..
-    is_unlocked = false;
+    if (tx_stream.busy) {
+        // ジョブかHTTPリクエストのコンテキストの空きがない
+        return CmdAsciiResNg(out_buff, out_buff_len);
+    }
+    if (tx_stream.err || (tx_stream.state != ST_VALUE) || (tx_stream.nibble != TX_STREAM_NIBBLE_NONE) || (tx_stream.idx != tx_stream.size)) {
+        // SIZEとVALUEの長さが合わない
+        LOG_WRN("Invalid length");
+        txStreamAbort();
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+
+    return txStreamSend(out_buff, out_buff_len);
+}
+CMD_ASCII_DEFINE_STREAM(txraw, CMD_TXRAW, cmdAsciiCmdTxRawBegin, cmdAsciiCmdTxRawPut, cmdAsciiCmdTxRaw);
 
-    if (in_len < 5) {
-        // valueまでの長さが無い
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+/**
+ * $$OUTBOXコマンド
+ * パラメータなし
+ * 応答: 溜まっている件数(2桁) 一番古いものを保存してからの秒数(8桁)
+ */
+static int cmdAsciiCmdOutbox(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    if (in_len != 0) {
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
+    return snprintf(out_buff, out_buff_len, "%02X\r\n%08X\r\nOK\r\n", OutboxDepth(), (uint32_t)OutboxOldestAge());
+}
+CMD_ASCII_DEFINE(outbox, CMD_OUTBOX, cmdAsciiCmdOutbox);
+
+/**
+ * $$TLSSTATコマンド
+ * パラメータなし
+ * 応答: CONNECTORとAUTHのTLSセッションキャッシュのヒット回数(8桁) ミス回数(8桁)を1行ずつ
+ */
+static int cmdAsciiCmdTlsStat(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    uint32_t hit[2] = {0}, miss[2] = {0};
 
-    if (in_buff[0] != 0x20 || in_buff[3] != 0x20) {
-        // 先頭がスペースじゃない or SizeとValueの間がスペースじゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+    if (in_len != 0) {
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
+    // まだ接続していないホストは0
+    (void)SipfClientHttpTlsSessionStats(CONFIG_SIPF_CONNECTOR_HTTP_HOST, &hit[0], &miss[0]);
+    (void)SipfClientHttpTlsSessionStats(CONFIG_SIPF_AUTH_HOST, &hit[1], &miss[1]);
+    return snprintf(out_buff, out_buff_len, "%08X %08X\r\n%08X %08X\r\nOK\r\n", hit[0], miss[0], hit[1], miss[1]);
+}
+CMD_ASCII_DEFINE(tlsstat, CMD_TLSSTAT, cmdAsciiCmdTlsStat);
 
-    in_buff[0] = '\0';
-    in_buff[3] = '\0';
+/**
+ * $$RXの受信オブジェクト置き場
+ * 応答はOBJQTYがOBJECTSより先なので、受信したオブジェクトをTYPE TAG_ID VALUE_LEN VALUEのまま溜めておく
+ */
 
-    uint8_t size;
-    uint8_t buffer[256];
-    char *endptr;
+typedef struct
+{
+    SipfObjectDownHead head;
+    uint8_t *buff;
+    uint16_t sz;
+    uint16_t len;
+} CmdAsciiRxStage;
 
-    size = strtol((char *)&in_buff[1], &endptr, 16);
-    if (*endptr != '\0') {
-        // Null文字以外で変換が終わってる
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
+static int cmdAsciiRxOnHead(const SipfObjectDownHead *head, void *user_data)
+{
+    CmdAsciiRxStage *stage = (CmdAsciiRxStage *)user_data;
+    memcpy(&stage->head, head, sizeof(stage->head));
+    return 0;
+}
 
-    LOG_DBG("TXRAW Size:%d", size);
+static int cmdAsciiRxOnObject(const SipfObjectObject *obj, void *user_data)
+{
+    CmdAsciiRxStage *stage = (CmdAsciiRxStage *)user_data;
+    if (stage->len + 3 + obj->value_len > stage->sz) {
+        LOG_ERR("RX: object buffer full");
+        return -ENOMEM;
+    }
+    stage->buff[stage->len++] = obj->obj_type;
+    stage->buff[stage->len++] = obj->obj_tagid;
+    stage->buff[stage->len++] = obj->value_len;
+    memcpy(&stage->buff[stage->len], obj->value, obj->value_len);
+    stage->len += obj->value_len;
+    return 0;
+}
 
-    uint8_t *head = &in_buff[4];
-    int i;
-    for (i = 0; i < size; i++) {
-        if (!isxdigit(*head) || !isxdigit(*(head + 1))) {
-            LOG_WRN("Invalid charctor");
-            return cmdCreateResIllParam(out_buff, out_buff_len);
-        }
+/**
+ * $$RXの応答を組み立てながらUARTへ流す
+ * objsはTYPE TAG_ID VALUE_LEN VALUEの並び(out_buffのCMD_RX_SINK_SZより後ろにあってもいい)
+ */
+static int cmdAsciiRxRes(const SipfObjectDownHead *head, uint8_t remains, uint8_t objqty, const uint8_t *objs, uint16_t objs_len, uint8_t *out_buff)
+{
+    CmdSink sink;
+    CmdSinkInit(&sink, out_buff, CMD_RX_SINK_SZ);
+    // OTID
+    CmdSinkHex(&sink, head->otid.value, sizeof(head->otid.value));
+    CmdSinkPuts(&sink, "\r\n");
+    // USER_SEND_DATETIME_MS
+    CmdSinkHex(&sink, head->user_send_datetime, sizeof(head->user_send_datetime));
+    CmdSinkPuts(&sink, "\r\n");
+    // RECEIVE_DATETIME_MS
+    CmdSinkHex(&sink, head->recv_datetime, sizeof(head->recv_datetime));
+    CmdSinkPuts(&sink, "\r\n");
+    // REMAINS
+    CmdSinkPrintf(&sink, "%02X\r\n", remains);
+    // OBJQTY
+    CmdSinkPrintf(&sink, "%02X\r\n", objqty);
+    // OBJECTS
+    for (uint16_t idx = 0; idx < objs_len;) {
+        const uint8_t *obj = &objs[idx];
+        // TAG_ID TYPE VALUE_LEN VALUE
+        uint8_t obj_head[10];
+        HexEncode(&obj_head[0], &obj[1], 1);
+        obj_head[2] = ' ';
+        HexEncode(&obj_head[3], &obj[0], 1);
+        obj_head[5] = ' ';
+        HexEncode(&obj_head[6], &obj[2], 1);
+        obj_head[8] = ' ';
+        CmdSinkWrite(&sink, obj_head, 9);
+        CmdSinkHex(&sink, &obj[3], obj[2]);
+        CmdSinkPuts(&sink, "\r\n");
+        idx += 3 + obj[2];
+    }
+    CmdSinkPuts(&sink, "OK\r\n");
+
+    return CmdSinkEnd(&sink);
+}
 
-        uint8_t hexBuff[3] = {*head, *(head + 1), 0x00};
-        uint8_t value = strtol((char *)hexBuff, &endptr, 16);
-        if (*endptr != '\0') {
-            // Null文字以外で変換が終わってる
-            LOG_WRN("Convert error");
-            return cmdCreateResIllParam(out_buff, out_buff_len);
-        }
-        buffer[i] = value;
-        head += 2;
+/**
+ * 先読みしたキューから$$RXに応答する
+ * 溜まっていなければその場で受信する(先読みのジョブとは順番を守る)
+ */
+static int cmdAsciiRxFromQueue(uint8_t *out_buff, uint16_t out_buff_len)
+{
+    RxQueueMsg *msg;
+    if (RxQueueHead(&msg) < 0) {
+        return CmdAsciiResNg(out_buff, out_buff_len);
     }
-
-    if (*head != '\0' && *head != '\r' && *head != '\n') {
-        // 文字があまっている
-        LOG_WRN("Invalid length");
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+    if (msg == NULL) {
+        LOG_INF("EMPTY");
+        return CmdAsciiResOk(out_buff, out_buff_len);
     }
 
-    SipfObjectOtid otid;
-    uint8_t err = SipfObjClientObjUpRaw(buffer, size, &otid);
-    int len = 0;
-    if (err == 0) {
-        for (int i = 0; i < sizeof(otid.value); i++) {
-            len += sprintf(&out_buff[i * 2], "%02X", otid.value[i]);
-        }
-        len += sprintf(&out_buff[len], "\r\nOK\r\n");
-    } else {
-        LOG_ERR("SipfClientObjUpRaw() failed: %d", err);
-        return cmdCreateResNg(out_buff, out_buff_len);
-    }
+    int remains = RxQueueRemains();
+    int len = cmdAsciiRxRes(&msg->head, (remains > 0xff) ? 0xff : remains, msg->objqty, msg->objs, msg->len, out_buff);
+    RxQueuePop();
+
+    // 空いた分をまた先読みする
+    CmdJobKickPrefetch();
     return len;
 }
 
@@ -418,67 +687,45 @@ static int cmdAsciiCmdRx(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, u
 {
     if (in_len != 0) {
         // なにかパラメータが指定されてる。
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
-    uint8_t err;
-    SipfObjectOtid otid;
-    uint8_t remains, objqty;
-    uint8_t *p_snd_datetime, *p_rcv_datetime;
-    static uint8_t *p_objs[OBJ_MAX_CNT];
+    if (RxQueueIsEnabled() || (RxQueueDepth() > 0)) {
+        return cmdAsciiRxFromQueue(out_buff, out_buff_len);
+    }
 
-    err = SipfObjClientObjDown(&otid, &remains, &objqty, p_objs, &p_snd_datetime, &p_rcv_datetime);
+    // 出力バッファの後ろにオブジェクトを溜める
+    CmdAsciiRxStage stage = {.buff = &out_buff[CMD_RX_SINK_SZ], .sz = out_buff_len - CMD_RX_SINK_SZ, .len = 0};
+    SipfObjectDownHandler handler = {.on_head = cmdAsciiRxOnHead, .on_object = cmdAsciiRxOnObject, .user_data = &stage};
 
-    if (err != 0) {
-        LOG_ERR("SipfObjClientObjDown():%d", err);
-        return cmdCreateResNg(out_buff, out_buff_len);
+    // 非同期で実行中のジョブとは別のリクエストコンテキストで受信する
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    if (ctx == NULL) {
+        return CmdAsciiResNg(out_buff, out_buff_len);
+    }
+    int objqty = SipfObjClientObjDown(ctx, &handler);
+    SipfClientHttpCtxFree(ctx);
+
+    if (objqty < 0) {
+        LOG_ERR("SipfObjClientObjDown():%d", objqty);
+        return CmdAsciiResNg(out_buff, out_buff_len);
     }
 
-    LOG_INF("remains=%d, objqty=%d", remains, objqty);
+    LOG_INF("remains=%d, objqty=%d", stage.head.remains, objqty);
 
     if (objqty == 0) {
         LOG_INF("EMPTY");
-        return cmdCreateResOk(out_buff, out_buff_len);
+        return CmdAsciiResOk(out_buff, out_buff_len);
     }
-
-    int idx = 0;
-    // OTID
-    for (int i = 0; i < 16; i++) {
-        idx += sprintf(&out_buff[idx], "%02X", otid.value[i]);
+    if (objqty > OBJ_MAX_CNT) {
+        // OBJQTYに書けない
+        LOG_ERR("Too many objects: %d", objqty);
+        return CmdAsciiResNg(out_buff, out_buff_len);
     }
-    idx += sprintf(&out_buff[idx], "\r\n");
-    // USER_SEND_DATETIME_MS
-    for (int i = 0; i < 8; i++) {
-        idx += sprintf(&out_buff[idx], "%02X", p_snd_datetime[i]);
-    }
-    idx += sprintf(&out_buff[idx], "\r\n");
-    // RECEIVE_DATETIME_MS
-    for (int i = 0; i < 8; i++) {
-        idx += sprintf(&out_buff[idx], "%02X", p_rcv_datetime[i]);
-    }
-    idx += sprintf(&out_buff[idx], "\r\n");
-    // REMAINS
-    idx += sprintf(&out_buff[idx], "%02X\r\n", remains);
-    // OBJQTY
-    idx += sprintf(&out_buff[idx], "%02X\r\n", objqty);
-    // OBJECTS
-    for (int i = 0; i < objqty; i++) {
-        SipfObjectObject obj;
-        obj.value = buff_work;
-        if (SipfObjectParse(p_objs[i], sizeof(buff_work), &obj) != 0) {
-            LOG_ERR("SipfObjectParse() failed...");
-            return cmdCreateResNg(out_buff, out_buff_len);
-        }
-        idx += sprintf(&out_buff[idx], "%02X %02X %02X ", obj.obj_tagid, obj.obj_type, obj.value_len);
-        for (int j = 0; j < obj.value_len; j++) {
-            idx += sprintf(&out_buff[idx], "%02X", obj.value[j]);
-        }
-        idx += sprintf(&out_buff[idx], "\r\n");
-    }
-    idx += sprintf(&out_buff[idx], "OK\r\n");
 
-    return idx;
+    return cmdAsciiRxRes(&stage.head, stage.head.remains, objqty, stage.buff, stage.len, out_buff);
 }
+CMD_ASCII_DEFINE(rx, CMD_RX, cmdAsciiCmdRx);
 
 /*** ファイル送受信コマンド ***/
 static int cmdFputOkRes(int file_size, uint8_t *out_buff, int out_buff_len)
@@ -500,167 +747,205 @@ static int cmdFgetNgRes(uint8_t *out_buff, int out_buff_len)
 /**
  * $$FPUTコマンド
  */
-static uint8_t xmodem_block[132];
+static uint8_t xmodem_block[XMODEM_SZ_BLOCK_BUFF];
+static uint16_t sz_xmodem_block; // 受信したブロックのデータ長
 static uint32_t sz_fput_file;
+static bool fput_is_batch; // YMODEM(-G)で受信する
+static uint8_t fput_bn; // 最初のブロックのBlock number
+static bool fput_pipe_started; // 受信スレッドを開始した
+static char fput_file_id[XMODEM_SZ_BLOCK]; // YMODEMのヘッダのファイル名
 
-static int sendChunkedData(int sock, uint8_t *chunk)
+static int sendChunkedData(SipfFileUploadWriter *writer, uint8_t *chunk, uint16_t sz_chunk, int total_sent)
 {
-    int len = 0, ret;
-
-    LOG_HEXDUMP_INF(chunk, 128, "chunk:");
-
-    ret = send(sock, &xmodem_block[3], 128, 0);
-    if (ret < 0) {
-        LOG_ERR("send[1]() failed: %d", errno);
-        return -errno;
+    // 最後のブロックのパディングはファイルサイズを超えたぶん送らない
+    if (total_sent + sz_chunk > sz_fput_file) {
+        sz_chunk = (total_sent < sz_fput_file) ? (sz_fput_file - total_sent) : 0;
+    }
+    if (sz_chunk == 0) {
+        return 0;
     }
-    len += ret;
-    return len;
-}
 
-static int sendChunkedEnd(int sock)
-{
-    return 0;
+    LOG_HEXDUMP_DBG(chunk, sz_chunk, "chunk:");
+
+    // まとめてからsend()する
+    return SipfFileUploadWrite(writer, chunk, sz_chunk);
 }
 
-static int cmdFputSendCb(int sock, struct http_request *req, void *user_data)
+/**
+ * 受信スレッドが溜めたブロックを順番にアップロードのデータとして書く
+ * UARTでの受信とネットワークへの送信はパイプラインで並行する
+ * 受信スレッドは接続してボディを送れるようになってから開始する(それまでは最初のブロックにACKを返さずに待たせる)
+ */
+static int cmdFputSendCb(SipfFileUploadWriter *writer)
 {
     int ret;
     int total_sent = 0;
-    uint8_t bn = 1;
+    XmodemPipeBlock *blk;
 
-    //最初のブロックを送る
-    ret = sendChunkedData(sock, &xmodem_block[3]);
+    ret = XmodemPipeStart(xmodem_block, sz_xmodem_block, fput_bn, fput_is_batch);
     if (ret < 0) {
-        LOG_ERR("sendChunkedData() failed: %d", ret);
-        return -ret;
+        LOG_ERR("XmodemPipeStart() failed: %d", ret);
+        return ret;
+    }
+    fput_pipe_started = true;
+
+    while ((blk = XmodemPipeGet()) != NULL) {
+        // 送信するよ
+        ret = sendChunkedData(writer, &blk->block[3], blk->sz_data, total_sent);
+        XmodemPipeFree(blk);
+        if (ret < 0) {
+            LOG_ERR("sendChunkedData() failed: %d", ret);
+            // 受信スレッドはXmodemPipeStop()でCANを送ってやめる
+            return ret;
+        }
+        total_sent += ret;
+    }
+    ret = XmodemPipeStop();
+    if ((ret < 0) && (ret != -ECANCELED)) {
+        LOG_ERR("XmodemPipeStop() failed: %d", ret);
+        return -1;
+    }
+
+    LOG_DBG("content-length: %d, total_sent: %d", sz_fput_file, total_sent);
+    if (sz_fput_file > total_sent) {
+        // 送信予定のファイルサイズに満たなかった(リクエストをやめて接続を閉じる)
+        return -ECANCELED;
+    }
+
+    return 0;
+}
+
+/**
+ * UARTのフロー制御が効いているか(効いていなければYMODEM-Gは溢れるので使わない)
+ */
+static bool cmdFputIsFlowCtrl(void)
+{
+    struct uart_config cfg;
+    if (UartBrokerGetConfig(&cfg) != 0) {
+        return false;
     }
-    total_sent += ret;
-    XmodemReceiveReqNextBlock();
+    return cfg.flow_ctrl == UART_CFG_FLOW_CTRL_RTS_CTS;
+}
 
+/**
+ * YMODEMのヘッダブロックを受信してファイル名とサイズを読む
+ * file_idがNULLならヘッダのファイル名を使う
+ */
+static int cmdFputRecvHeader(uint8_t *bn, char **file_id, uint32_t *file_size)
+{
     enum xmodem_recv_ret xret;
-    uint8_t *chunk;
     int cnt_retry = 0;
     for (;;) {
-        xret = XmodemReceiveBlock(&bn, xmodem_block, 1000);
+        xret = XmodemReceiveBlock(bn, xmodem_block, &sz_xmodem_block, 3000);
         if (xret == XMODEM_RECV_RET_OK) {
-            chunk = &xmodem_block[3];
-            // 送信するよ
-            ret = sendChunkedData(sock, chunk);
-            if (ret < 0) {
-                LOG_ERR("sendChunkedData() failed: %d", ret);
-                XmodemTransmitCancel();
-                return ret;
-            }
-            total_sent += ret;
-            // 次ブロック要求
-            cnt_retry = 0;
-            XmodemReceiveReqNextBlock();
-        } else if (xret == XMODEM_RECV_RET_FINISHED) {
-            LOG_INF("XmodemReceiveBlock() finished.");
             break;
-        } else if (xret == XMODEM_RECV_RET_RETRY) {
-            if (cnt_retry++ > 10) {
-                LOG_ERR("XmodemReceiveBlock() retry over.");
-                XmodemTransmitCancel();
-                return -1;
-            }
-            LOG_INF("XmodemReceiveBlock() retry.");
-            // 再送要求
+        } else if ((xret == XMODEM_RECV_RET_RETRY) && (cnt_retry++ < 10)) {
+            LOG_INF("Retry");
             XmodemReceiveReqCurrentBlock();
-        } else if (xret == XMODEM_RECV_RET_CANCELED) {
-            LOG_INF("XmodemReceiveBlock() canceled.");
-            break;
+        } else {
+            LOG_ERR("XmodemReceiveBlock() failed: %d", xret);
+            return -1;
         }
     }
-    ret = sendChunkedEnd(sock);
-    if (ret < 0) {
-        LOG_ERR("sendChunkedEnd() failed: %d", ret);
-        return ret;
+
+    char *name;
+    if (XmodemParseHeader(&xmodem_block[3], sz_xmodem_block, &name, file_size) != 0) {
+        LOG_ERR("Invalid header block.");
+        return -1;
     }
-    total_sent += ret;
-    LOG_DBG("content-length: %d, total_sent: %d", sz_fput_file, total_sent);
-    if (sz_fput_file > total_sent) {
-        // 送信予定のファイルサイズに満たなかった
-        (void)close(sock);
+    LOG_INF("YMODEM: name=%s size=%d", name, *file_size);
+    if ((name[0] == 0x00) || (*file_size == 0)) {
+        // 送るものがないかサイズが分からない
+        return -1;
     }
-
-    return total_sent;
+    if (*file_id == NULL) {
+        strncpy(fput_file_id, name, sizeof(fput_file_id) - 1);
+        fput_file_id[sizeof(fput_file_id) - 1] = 0x00;
+        *file_id = fput_file_id;
+    }
+    return 0;
 }
 
 static int cmdAsciiCmdFput(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
 {
     int ret;
+    char *file_id = NULL;
+    uint32_t file_size = 0;
 
-    if (in_buff[0] != 0x20) {
-        // 先頭がスペースじゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
-    if (in_len < 2) {
-        // file_idが空
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
+    // file_sizeがなければYMODEMで受信して、ヘッダのサイズを使う(file_idもなければヘッダのファイル名を使う)
+    fput_is_batch = false;
+    if (in_len == 0) {
+        fput_is_batch = true;
+    } else {
+        if (in_buff[0] != 0x20) {
+            // 先頭がスペースじゃない
+            return CmdAsciiResIllParam(out_buff, out_buff_len);
+        }
+        if (in_len < 2) {
+            // file_idが空
+            return CmdAsciiResIllParam(out_buff, out_buff_len);
+        }
 
-    // file_idとfile_sizeの区切りを探す
-    char *str_file_size = NULL;
-    for (int i = 1; i < in_len; i++) {
-        if (in_buff[i] == 0x20) {
-            in_buff[i] = 0x00;
-            str_file_size = (char *)&in_buff[i + 1];
+        // file_idとfile_sizeの区切りを探す
+        char *str_file_size = NULL;
+        for (int i = 1; i < in_len; i++) {
+            if (in_buff[i] == 0x20) {
+                in_buff[i] = 0x00;
+                str_file_size = (char *)&in_buff[i + 1];
+            }
         }
-    }
-    if (str_file_size == NULL) {
-        // 区切りが見つからなかった
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
 
-    // file_size
-    uint8_t err;
-    uint32_t file_size;
-    if (strlen(str_file_size) != 8) {
-        // 32bit(=4Byte)じゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
-    file_size = hexToUint8(&str_file_size[0], &err) << 24;
-    if (err) {
-        // 変換失敗
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
-    file_size += hexToUint8(&str_file_size[2], &err) << 16;
-    if (err) {
-        // 変換失敗
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
-    file_size += hexToUint8(&str_file_size[4], &err) << 8;
-    if (err) {
-        // 変換失敗
-        return cmdCreateResIllParam(out_buff, out_buff_len);
-    }
-    file_size += hexToUint8(&str_file_size[6], &err);
-    if (err) {
-        // 変換失敗
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        // file_id
+        file_id = (char *)&in_buff[1];
+
+        if (str_file_size == NULL) {
+            // 区切りが見つからなかった
+            fput_is_batch = true;
+        } else {
+            // file_size
+            uint8_t str_file_size_bin[4];
+            if (strlen(str_file_size) != 8) {
+                // 32bit(=4Byte)じゃない
+                return CmdAsciiResIllParam(out_buff, out_buff_len);
+            }
+            if (HexDecode(str_file_size_bin, (uint8_t *)str_file_size, sizeof(str_file_size_bin)) != 0) {
+                // 変換失敗
+                return CmdAsciiResIllParam(out_buff, out_buff_len);
+            }
+            file_size = sys_get_be32(str_file_size_bin);
+        }
     }
 
-    // file_id
-    char *file_id = (char *)&in_buff[1];
+    // XMODEMの転送中に非同期の完了通知が割り込まないように、受け付けたジョブが終わるのを待つ
+    CmdJobDrain();
 
     k_msleep(10);
 
     // XMODEM開始
     XmodemBegin();
-    // 受信開始
-    ret = XmodemReceiveStart();
+    // 受信開始(YMODEM-Gはフロー制御が効いているときだけ)
+    ret = fput_is_batch ? XmodemReceiveStartBatch(cmdFputIsFlowCtrl()) : XmodemReceiveStart();
     if (ret < 0) {
         LOG_ERR("XmodemReceiveStart() failed: %d", ret);
         return ret;
     }
+    uint8_t bn = 0;
+    if (fput_is_batch) {
+        // YMODEM: 最初はヘッダブロック(BN=0)
+        bn = 0xff;
+        if (cmdFputRecvHeader(&bn, &file_id, &file_size) != 0) {
+            XmodemTransmitCancel();
+            ret = CmdAsciiResNg(out_buff, out_buff_len);
+            goto fput_end;
+        }
+        // データを要求する
+        XmodemReceiveReqNextBlock();
+    }
     // 最初のレコードを受信
     enum xmodem_recv_ret xret;
     int cnt_retry = 0;
-    uint8_t bn = 0;
     for (;;) {
-        xret = XmodemReceiveBlock(&bn, xmodem_block, 3000);
+        xret = XmodemReceiveBlock(&bn, xmodem_block, &sz_xmodem_block, 3000);
         if (xret == XMODEM_RECV_RET_OK) {
             break;
         } else if (xret == XMODEM_RECV_RET_RETRY) {
@@ -671,19 +956,28 @@ static int cmdAsciiCmdFput(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff,
                 LOG_ERR("Retry over.");
                 XmodemTransmitCancel();
                 XmodemEnd();
-                return cmdCreateResNg(out_buff, out_buff_len);
+                return CmdAsciiResNg(out_buff, out_buff_len);
             }
         } else {
             LOG_ERR("XmodemReceiveBlock() failed: %d", xret);
-            ret = cmdCreateResNg(out_buff, out_buff_len);
+            ret = CmdAsciiResNg(out_buff, out_buff_len);
             goto fput_end;
         }
     }
     sz_fput_file = file_size; // コールバック関数でfile_sizeを参照したい
+    fput_bn = bn;
+    fput_pipe_started = false;
     ret = SipfFileUpload(file_id, NULL, cmdFputSendCb, file_size);
+    if (fput_pipe_started) {
+        // コールバック関数の途中で失敗したときは受信をやめる
+        (void)XmodemPipeStop();
+    } else if (ret < 0) {
+        // コールバック関数が呼ばれずに失敗したので転送をやめる
+        XmodemTransmitCancel();
+    }
     if (ret < 0) {
         LOG_ERR("SipfFileUpload() failed: %d", ret);
-        ret = cmdCreateResNg(out_buff, out_buff_len);
+        ret = CmdAsciiResNg(out_buff, out_buff_len);
     } else {
         ret = cmdFputOkRes(file_size, out_buff, out_buff_len);
     }
@@ -694,22 +988,46 @@ fput_end:
 
     return ret;
 }
+CMD_ASCII_DEFINE(fput, CMD_FPUT, cmdAsciiCmdFput);
 
 /**
  * $$FGETコマンド
  */
 static uint8_t fget_bn;
+static const char *fget_file_id;
 #define FPUT_BLOCK_SEND_RETRY (3)
+
+/**
+ * YMODEM-Gならデータの前にヘッダブロックを送る(fget_bnが0のとき)
+ */
+static int cmdFgetSendHeader(void)
+{
+    if (fget_bn != 0) {
+        return 0;
+    }
+    XmodemSendRet xret = XmodemSendHeader(fget_file_id, SipfFileDownloadFileSize(), 3000);
+    if (xret != XMODEM_SEND_RET_OK) {
+        LOG_ERR("XmodemSendHeader() failed: %d", xret);
+        return -1;
+    }
+    fget_bn = 1;
+    return 0;
+}
+
 static int cmdFgetCb(uint8_t *buff, size_t len)
 {
     XmodemSendRet xret;
     int payload_len;
-    for (int idx = 0; idx < len; idx += XMODEM_SZ_BLOCK) {
+    if (cmdFgetSendHeader() != 0) {
+        return -1;
+    }
+    int sz_block = XmodemSendBlockSize(); // 相手が'C'で要求してきたら1024Byteずつ送る
+    for (int idx = 0; idx < len; idx += sz_block) {
         for (int i = 0; i < FPUT_BLOCK_SEND_RETRY; i++) {
-            if ((len - idx) < XMODEM_SZ_BLOCK) {
-                payload_len = len % XMODEM_SZ_BLOCK;
+            if ((len - idx) < sz_block) {
+                payload_len = len % sz_block;
             } else {
-                payload_len = XMODEM_SZ_BLOCK;
+                payload_len = sz_block;
             }
             xret = XmodemSendBlock(&fget_bn, &buff[idx], payload_len, 500);
             if (xret == XMODEM_SEND_RET_FAILED) {
@@ -743,15 +1061,18 @@ static int cmdAsciiCmdFget(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff,
 
     if (in_buff[0] != 0x20) {
         // 先頭がスペースじゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
     if (in_len < 2) {
         // file_idが空
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
     // file_id
     char *file_id = (char *)&in_buff[1];
 
+    // XMODEMの転送中に非同期の完了通知が割り込まないように、受け付けたジョブが終わるのを待つ
+    CmdJobDrain();
+
     k_msleep(10);
 
     // XMODEM開始
@@ -764,10 +1085,12 @@ static int cmdAsciiCmdFget(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff,
         ret = cmdFgetNgRes(out_buff, out_buff_len);
         goto fget_end;
     }
-    fget_bn = 1; // ブロック番号を初期化
+    // ブロック番号を初期化(YMODEM-Gなら最初のデータでヘッダブロック(BN=0)から送る)
+    fget_bn = XmodemSendIsStream() ? 0 : 1;
+    fget_file_id = file_id;
 
     // ファイルのダウンロードを開始
-    ret = SipfFileDownload(file_id, NULL, XMODEM_SZ_BLOCK * 8, cmdFgetCb);
+    ret = SipfFileDownload(file_id, NULL, XMODEM_SZ_BLOCK_1K, cmdFgetCb);
     if (ret < 0) {
         LOG_ERR("SipfFileDownload() failed: %d", ret);
         XmodemTransmitCancel();
@@ -775,6 +1098,12 @@ static int cmdAsciiCmdFget(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff,
         goto fget_end;
     }
     LOG_INF("SipfFileDownload: ret=%d", ret);
+    if (cmdFgetSendHeader() != 0) {
+        // 空のファイルでもヘッダブロックは送る
+        XmodemTransmitCancel();
+        ret = cmdFgetNgRes(out_buff, out_buff_len);
+        goto fget_end;
+    }
     // XMODEM: 送信終了
     xret = XmodemSendEnd(500);
     if (xret == XMODEM_SEND_RET_TIMEOUT) {
@@ -789,6 +1118,10 @@ static int cmdAsciiCmdFget(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff,
         ret = cmdFgetNgRes(out_buff, out_buff_len);
         goto fget_end;
     }
+    if (XmodemSendIsStream() && (XmodemSendBatchEnd(3000) != XMODEM_SEND_RET_OK)) {
+        // ファイルは送り終わっている
+        LOG_WRN("XmodemSendBatchEnd() failed.");
+    }
     ret = cmdFgetOkRes(ret, out_buff, out_buff_len);
 
 fget_end:
@@ -797,6 +1130,7 @@ fget_end:
     k_msleep(10);
     return ret;
 }
+CMD_ASCII_DEFINE(fget, CMD_FGET, cmdAsciiCmdFget);
 
 /*** 管理コマンド ***/
 
@@ -808,24 +1142,25 @@ static int cmdAsciiCmdUnlock(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buf
 {
     if (in_buff[0] != 0x20) {
         // 先頭がスペースじゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
     if (in_len != 7) {
         // パラメータ長が違う
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
     int res_len = 0;
     if (memcmp(" UNLOCK", in_buff, 7) == 0) {
         is_unlocked = true;
-        res_len = cmdCreateResOk(out_buff, out_buff_len);
+        res_len = CmdAsciiResOk(out_buff, out_buff_len);
     } else {
         // パラメータが”UNLOCK”じゃない
         is_unlocked = false;
-        res_len = cmdCreateResIllParam(out_buff, out_buff_len);
+        res_len = CmdAsciiResIllParam(out_buff, out_buff_len);
     }
     return res_len;
 }
+CMD_ASCII_DEFINE(unlock, CMD_UNLOCK, cmdAsciiCmdUnlock);
 
 /**
  * $$UPDATEコマンド
@@ -835,165 +1170,219 @@ static int cmdAsciiCmdUpdate(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buf
 {
     if (is_unlocked == false) {
         // UNLOCKされてない
-        return cmdCreateResNg(out_buff, out_buff_len);
+        return CmdAsciiResNg(out_buff, out_buff_len);
     }
     if (in_len < 7) {
         // パラメータ長が違う
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
+    // 成功するとリセットされるので非同期で受け付けたジョブを先に終わらせる
+    CmdJobDrain();
     if (memcmp(" UPDATE", in_buff, 7) == 0) {
         if (in_len != 7) {
-            return cmdCreateResIllParam(out_buff, out_buff_len);
+            return CmdAsciiResIllParam(out_buff, out_buff_len);
         }
         if (FotaHttpRun("app_update.bin") != 0) {
             // FOTA失敗した
-            return cmdCreateResNg(out_buff, out_buff_len);
+            return CmdAsciiResNg(out_buff, out_buff_len);
         }
         // FOTA成功ならリセットかかるからここには来ないはず
-        return cmdCreateResOk(out_buff, out_buff_len);
+        return CmdAsciiResOk(out_buff, out_buff_len);
     } else if (memcmp(" VERSION ", in_buff, 9) == 0) {
         // パラメータが"VERSION"だった
         if (in_len < 10) {
             // サフィックスがしていされていない
-            return cmdCreateResIllParam(out_buff, out_buff_len);
+            return CmdAsciiResIllParam(out_buff, out_buff_len);
         }
         in_buff[in_len] = 0x00; //文字列として扱うために末尾をNULL文字にする
         if (FotaHttpRun(&in_buff[9]) != 0) {
             // FOTA失敗した
-            return cmdCreateResNg(out_buff, out_buff_len);
+            return CmdAsciiResNg(out_buff, out_buff_len);
         }
         // FOTA成功ならリセットかかるからここには来ないはず
-        return cmdCreateResOk(out_buff, out_buff_len);
+        return CmdAsciiResOk(out_buff, out_buff_len);
     } else {
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 }
-
-/*** GNSSコマンド ***/
+CMD_ASCII_DEFINE(update, CMD_UPDATE, cmdAsciiCmdUpdate);
 
 /**
- * $$GNSSEN コマンド
+ * $$BAUDコマンド
  * in_buff: コマンド名より後ろを格納してるバッファ
+ * $$BAUD <ボーレート(10進)> [<フロー制御 0:無効 1:RTS/CTS>]
+ *
+ * 旧設定でOKを返した後に新しい設定へ切り替え、ホストからのACK(0x06)を待つ。
+ * CMD_BAUD_ACK_TIMEOUT_MS以内にACKが来なければ元の設定に戻してNGを返す。
  */
-static int cmdAsciiCmdGnssEnable(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+#define CMD_BAUD_ACK_TIMEOUT_MS (3000)
+static const uint32_t baudrates[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000};
+
+static int cmdAsciiCmdBaud(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
 {
-    if (in_buff[0] != 0x20) {
+    int ret;
+
+    if ((in_len < 2) || (in_buff[0] != 0x20)) {
         // 先頭がスペースじゃない
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
-    if (in_len != 2) {
-        // パラメータ長が違う
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+    in_buff[in_len] = 0x00; //文字列として扱うために末尾をNULL文字にする
+
+    char *endptr;
+    uint32_t baudrate = strtoul((char *)&in_buff[1], &endptr, 10);
+    bool flow_ctrl = false;
+    if (*endptr == ' ') {
+        if (strcmp(endptr, " 1") == 0) {
+            flow_ctrl = true;
+        } else if (strcmp(endptr, " 0") != 0) {
+            return CmdAsciiResIllParam(out_buff, out_buff_len);
+        }
+    } else if (*endptr != '\0') {
+        // Null文字以外で変換が終わってる
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
     }
 
-    if (in_buff[1] == '0') {
-        // GPS無効
-        if (gnss_stop() != 0) {
-            return cmdCreateResNg(out_buff, out_buff_len);
+    bool valid = false;
+    for (int i = 0; i < ARRAY_SIZE(baudrates); i++) {
+        if (baudrates[i] == baudrate) {
+            valid = true;
+            break;
         }
-    } else if (in_buff[1] == '1') {
-        // GPS有効
-        if (gnss_start() != 0) {
-            return cmdCreateResNg(out_buff, out_buff_len);
+    }
+    if (!valid) {
+        // 未対応のボーレート
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+#ifndef CONFIG_BOARD_SCM_LTEM1NRF_NRF9160_NS
+    if (flow_ctrl) {
+        // RTS/CTSが配線されていない
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+#endif
+
+    struct uart_config cfg_old, cfg_new;
+    if (UartBrokerGetConfig(&cfg_old) != 0) {
+        return CmdAsciiResNg(out_buff, out_buff_len);
+    }
+    cfg_new = cfg_old;
+    cfg_new.baudrate = baudrate;
+    cfg_new.flow_ctrl = flow_ctrl ? UART_CFG_FLOW_CTRL_RTS_CTS : UART_CFG_FLOW_CTRL_NONE;
+
+    // 旧設定で受け付けた旨を返してから切り替える
+    UartBrokerSetEcho(false);
+    UartBrokerPuts("OK\r\n");
+    ret = UartBrokerSetConfig(&cfg_new);
+    if (ret != 0) {
+        LOG_ERR("UartBrokerSetConfig() failed: %d", ret);
+        UartBrokerSetConfig(&cfg_old);
+        UartBrokerSetEcho(true);
+        return CmdAsciiResNg(out_buff, out_buff_len);
+    }
+    UartBrokerClearRecveiveQueue();
+
+    // 新しい設定でACKが来るのを待つ
+    int64_t deadline = k_uptime_get() + CMD_BAUD_ACK_TIMEOUT_MS;
+    uint8_t b;
+    bool acked = false;
+    while (k_uptime_get() < deadline) {
+        if ((UartBrokerGetByteTm(&b, 100) == 0) && (b == 0x06)) {
+            acked = true;
+            break;
         }
-    } else {
-        return cmdCreateResIllParam(out_buff, out_buff_len);
     }
-
-    return cmdCreateResOk(out_buff, out_buff_len);
+    if (!acked) {
+        // ACKが来ないので元に戻す
+        LOG_WRN("BAUD: no ACK, fallback to %d", cfg_old.baudrate);
+        UartBrokerSetConfig(&cfg_old);
+        UartBrokerClearRecveiveQueue();
+        UartBrokerSetEcho(true);
+        return CmdAsciiResNg(out_buff, out_buff_len);
+    }
+    LOG_INF("BAUD: %d, flow_ctrl: %d", baudrate, flow_ctrl);
+    UartBrokerSetEcho(true);
+    return CmdAsciiResOk(out_buff, out_buff_len);
 }
+CMD_ASCII_DEFINE(baud, CMD_BAUD, cmdAsciiCmdBaud);
 
 /**
- * $$GNSSSTAT コマンド
- * in_buff: コマンド名より後ろを格納してるバッファ
+ * CMD_ASCII_DEFINE()で登録されたコマンドからハッシュテーブルを作る
+ * 戻り値: 0, -ENOSPC テーブルに載らないコマンドがある
  */
-static int cmdAsciiCmdGnssStatus(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+int CmdAsciiInit(void)
 {
-    if (in_len != 0) {
-        // パラメータ長が違う
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+    int ret = 0;
+    CmdAsciiTableClear();
+    STRUCT_SECTION_FOREACH(CmdAsciiCmd, cmd)
+    {
+        int err = CmdAsciiTableAdd(cmd);
+        if (err == -EEXIST) {
+            LOG_ERR("Duplicate command: %s", cmd->cmd_name);
+        } else if (err < 0) {
+            LOG_ERR("Command table full: %s", cmd->cmd_name);
+            ret = err;
+        }
     }
+    return ret;
+}
 
-    struct nrf_modem_gnss_pvt_data_frame pvt;
-    gnss_get_data(&pvt);
-
-    uint8_t *buff = out_buff;
-
-    buff += sprintf(buff, "Fix valid: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_FIX_VALID) != 0 ? "true" : "false");
-    buff += sprintf(buff, "Leap second valid: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_LEAP_SECOND_VALID) != 0 ? "true" : "false");
-    buff += sprintf(buff, "Sleep between PVT: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_SLEEP_BETWEEN_PVT) != 0 ? "true" : "false");
-    buff += sprintf(buff, "Deadline missed: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_DEADLINE_MISSED) != 0 ? "true" : "false");
-    buff += sprintf(buff, "Insuf. time window: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_NOT_ENOUGH_WINDOW_TIME) != 0 ? "true" : "false");
-    buff += sprintf(buff, "Velocity estimate valid: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_VELOCITY_VALID) != 0 ? "true" : "false");
+int CmdAsciiParse(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    // コマンド名(区切り文字(スペース)か終端まで)を切り出す
+    uint16_t name_len = 0;
+    while ((name_len < in_len) && (in_buff[name_len] != ' ')) {
+        name_len++;
+    }
+
+    const CmdAsciiCmd *cmd = CmdAsciiTableLookup(in_buff, name_len);
+    if ((cmd != NULL) && (cmd->stream_put != NULL)) {
+        // ストリーム処理するコマンドは行をまとめて流し込む
+        CmdAsciiStreamBegin(in_buff, name_len);
+        for (uint16_t i = name_len; i < in_len; i++) {
+            CmdAsciiStreamPut(in_buff[i]);
+        }
+        return CmdAsciiStreamEnd(out_buff, out_buff_len);
+    }
+    if (cmd != NULL) {
+        //コマンド名の次から末尾までのバッファを渡す
+        return cmd->cmd_func(&in_buff[name_len], in_len - name_len, out_buff, out_buff_len);
+    }
 
-    buff += sprintf(buff, "OK\n");
-    return (int)(buff - out_buff);
+    // 未定義のコマンド
+    return CmdAsciiResNg(out_buff, out_buff_len);
 }
 
 /**
- * $$GNSSLOC コマンド
- * in_buff: コマンド名より後ろを格納してるバッファ
+ * コマンド名がストリーム処理するコマンドならストリーム処理を開始する
+ * 戻り値: ストリーム処理を開始したら1, しなかったら0
  */
-static int cmdAsciiCmdGnssLocation(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+int CmdAsciiStreamBegin(const uint8_t *name, uint16_t name_len)
 {
-    if (in_len != 0) {
-        // パラメータ長が違う
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+    const CmdAsciiCmd *cmd = CmdAsciiTableLookup(name, name_len);
+    if ((cmd == NULL) || (cmd->stream_put == NULL)) {
+        cmd_stream = NULL;
+        return 0;
     }
-
-    bool got_fix;
-    struct nrf_modem_gnss_pvt_data_frame pvt;
-    got_fix = gnss_get_data(&pvt);
-
-    uint8_t *buff = out_buff;
-
-    if (!got_fix) {
-        // NOTFIXED
-        buff += sprintf(buff, "V,");
-    } else {
-        // FIXED
-        buff += sprintf(buff, "A,");
+    cmd_stream = cmd;
+    if (cmd_stream->stream_begin != NULL) {
+        cmd_stream->stream_begin();
     }
-    buff += sprintf(buff, "%.6f,%.6f,%f,%f,%f,%04u-%02u-%02uT%02u:%02u:%02uZ", pvt.longitude, pvt.latitude, pvt.altitude, pvt.speed, pvt.heading, pvt.datetime.year, pvt.datetime.month, pvt.datetime.day, pvt.datetime.hour, pvt.datetime.minute, pvt.datetime.seconds);
-    buff += sprintf(buff, "\r\nOK\r\n");
-    return (int)(buff - out_buff);
+    return 1;
 }
 
-/**
- * $$GNSSNMEA コマンド
- * in_buff: コマンド名より後ろを格納してるバッファ
- */
-static int cmdAsciiCmdGnssNmea(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+int CmdAsciiStreamPut(uint8_t c)
 {
-    if (in_len != 0) {
-        // パラメータ長が違う
-        return cmdCreateResIllParam(out_buff, out_buff_len);
+    if (cmd_stream == NULL) {
+        return -EINVAL;
     }
-    uint8_t *buff = out_buff;
-    buff += gnss_strcpy_nmea((char *)out_buff);
-    buff += sprintf(buff, "\r\nOK\r\n");
-    return (int)(buff - out_buff);
+    return cmd_stream->stream_put(c);
 }
 
-static CmdAsciiCmd cmdfunc[] = {{CMD_REG_W, cmdAsciiCmdW}, {CMD_REG_R, cmdAsciiCmdR}, {CMD_TXRAW, cmdAsciiCmdTxRaw}, {CMD_TX, cmdAsciiCmdTx}, {CMD_RX, cmdAsciiCmdRx}, {CMD_FPUT, cmdAsciiCmdFput}, {CMD_FGET, cmdAsciiCmdFget}, {CMD_UNLOCK, cmdAsciiCmdUnlock}, {CMD_UPDATE, cmdAsciiCmdUpdate}, {CMD_GNSS_ENABLE, cmdAsciiCmdGnssEnable}, {CMD_GNSS_GET_LOCATION, cmdAsciiCmdGnssLocation}, {CMD_GNSS_GET_NMEA, cmdAsciiCmdGnssNmea}, {CMD_GNSS_GET_STATUS, cmdAsciiCmdGnssStatus}, {NULL, NULL}};
-
-int CmdAsciiParse(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+int CmdAsciiStreamEnd(uint8_t *out_buff, uint16_t out_buff_len)
 {
-    int idx = 0;
-    // コマンドリストを探す
-    while (cmdfunc[idx].cmd_func) {
-        //コマンド名に対応する関数を呼ぶ
-        int name_len = strlen(cmdfunc[idx].cmd_name);
-        if (memcmp(in_buff, cmdfunc[idx].cmd_name, name_len) == 0) {
-            //コマンド名の後は区切り文字(スペース)か終端？
-            if ((in_len == name_len) || (in_buff[name_len] == ' ')) {
-                //コマンド名の次から末尾までのバッファを渡す
-                return cmdfunc[idx].cmd_func(&in_buff[name_len], in_len - name_len, out_buff, out_buff_len);
-            }
-        }
-        idx++;
+    const CmdAsciiCmd *cmd = cmd_stream;
+    cmd_stream = NULL;
+    if (cmd == NULL) {
+        return CmdAsciiResNg(out_buff, out_buff_len);
     }
-
-    // 未定義のコマンド
-    return cmdCreateResNg(out_buff, out_buff_len);
+    return cmd->cmd_func(NULL, 0, out_buff, out_buff_len);
 }
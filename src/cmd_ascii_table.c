@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "cmd_ascii_table.h"
+
+/*
+ * コマンド名のハッシュテーブル
+ *  Zephyrに依存しないのでホストでもテストできる(tests/cmd_ascii)
+ *  名前の長さも持っておいて、探すときにstrlen()しない
+ */
+typedef struct
+{
+    const CmdAsciiCmd *cmd;
+    uint16_t len;
+} CmdAsciiSlot;
+
+static CmdAsciiSlot cmd_hash[CMD_ASCII_HASH_SZ];
+
+static uint32_t cmdAsciiHash(const uint8_t *name, uint16_t len)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ name[i]) * 16777619u;
+    }
+    return h;
+}
+
+void CmdAsciiTableClear(void)
+{
+    memset(cmd_hash, 0, sizeof(cmd_hash));
+}
+
+/**
+ * コマンドをテーブルに載せる
+ * 戻り値: 0, -EEXIST 同じ名前が登録済み, -ENOSPC テーブルが一杯
+ */
+int CmdAsciiTableAdd(const CmdAsciiCmd *cmd)
+{
+    const uint8_t *name = (const uint8_t *)cmd->cmd_name;
+    uint16_t len = strlen(cmd->cmd_name);
+    if (CmdAsciiTableLookup(name, len) != NULL) {
+        return -EEXIST;
+    }
+    uint32_t idx = cmdAsciiHash(name, len) & (CMD_ASCII_HASH_SZ - 1);
+    for (int i = 0; i < CMD_ASCII_HASH_SZ; i++) {
+        if (cmd_hash[idx].cmd == NULL) {
+            cmd_hash[idx].cmd = cmd;
+            cmd_hash[idx].len = len;
+            return 0;
+        }
+        idx = (idx + 1) & (CMD_ASCII_HASH_SZ - 1);
+    }
+    return -ENOSPC;
+}
+
+const CmdAsciiCmd *CmdAsciiTableLookup(const uint8_t *name, uint16_t len)
+{
+    uint32_t idx = cmdAsciiHash(name, len) & (CMD_ASCII_HASH_SZ - 1);
+    for (int i = 0; i < CMD_ASCII_HASH_SZ; i++) {
+        const CmdAsciiSlot *slot = &cmd_hash[idx];
+        if (slot->cmd == NULL) {
+            // 登録されていない
+            return NULL;
+        }
+        if ((slot->len == len) && (memcmp(slot->cmd->cmd_name, name, len) == 0)) {
+            return slot->cmd;
+        }
+        idx = (idx + 1) & (CMD_ASCII_HASH_SZ - 1);
+    }
+    return NULL;
+}
+
+/**
+ * テーブルのidx番目に載っているコマンド(空ならNULL, テスト用)
+ */
+const CmdAsciiCmd *CmdAsciiTableSlot(int idx)
+{
+    if ((idx < 0) || (idx >= CMD_ASCII_HASH_SZ)) {
+        return NULL;
+    }
+    return cmd_hash[idx].cmd;
+}
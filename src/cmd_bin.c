@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2021 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "cmd_bin.h"
+#include "cmd_job.h"
+#include "registers.h"
+#include "rx_queue.h"
+#include "sipf/sipf_object.h"
+
+/**/
+typedef int (*bin_cmd_func)(uint8_t *payload, uint16_t len, uint8_t *res, uint16_t res_len);
+typedef struct
+{
+    uint8_t opcode;
+    bin_cmd_func cmd_func;
+} CmdBinCmd;
+/**/
+
+/**
+ * 応答フレームを組み立てる
+ * 応答データはout_buff[1 + CMD_BIN_HEADER_SZ + 1](ステータスの次)から入っている前提
+ */
+static int cmdBinCreateRes(uint8_t opcode, uint8_t status, uint16_t data_len, uint8_t *out_buff)
+{
+    uint16_t len = 1 + data_len; // STATUS + DATA
+
+    out_buff[0] = CMD_BIN_SOF;
+    out_buff[1] = opcode | CMD_BIN_OP_RES;
+    sys_put_be16(len, &out_buff[2]);
+    out_buff[4] = status;
+    sys_put_be16(crc16_itu_t(0xffff, &out_buff[1], CMD_BIN_HEADER_SZ + len), &out_buff[1 + CMD_BIN_HEADER_SZ + len]);
+
+    return 1 + CMD_BIN_HEADER_SZ + len + CMD_BIN_CRC_SZ;
+}
+
+/**
+ * レジスタ書き込み
+ * PAYLOAD: ADDR(1) VALUE(1)
+ */
+static int cmdBinCmdW(uint8_t *payload, uint16_t len, uint8_t *res, uint16_t res_len)
+{
+    if (len != 2) {
+        return -CMD_BIN_RES_ILLPARM;
+    }
+    if (RegistersWrite(payload[0], payload[1]) < 0) {
+        return -CMD_BIN_RES_CMDFAIL;
+    }
+    return 0;
+}
+
+/**
+ * レジスタ読み出し
+ * PAYLOAD: ADDR(1)
+ * 応答: VALUE(1)
+ */
+static int cmdBinCmdR(uint8_t *payload, uint16_t len, uint8_t *res, uint16_t res_len)
+{
+    if (len != 1) {
+        return -CMD_BIN_RES_ILLPARM;
+    }
+    if (RegistersRead(payload[0], &res[0]) < 0) {
+        return -CMD_BIN_RES_ILLPARM;
+    }
+    return 1;
+}
+
+/**
+ * OBJECT送信
+ * PAYLOAD: OBJECTS_UPのペイロード(TYPE TAG_ID VALUE_LEN VALUE ...)
+ * 応答: OTID(16)
+ */
+static int cmdBinCmdTx(uint8_t *payload, uint16_t len, uint8_t *res, uint16_t res_len)
+{
+    SipfObjectOtid otid;
+
+    if (len == 0) {
+        return -CMD_BIN_RES_ILLPARM;
+    }
+    int err = SipfObjClientObjUpRaw(payload, len, &otid);
+    if (err != 0) {
+        LOG_ERR("SipfObjClientObjUpRaw() failed: %d", err);
+        return -CMD_BIN_RES_CMDFAIL;
+    }
+    memcpy(res, otid.value, sizeof(otid.value));
+    return sizeof(otid.value);
+}
+
+/**
+ * OBJECT受信
+ * PAYLOAD: なし
+ * 応答: OTID(16) USER_SEND_DATETIME_MS(8) RECEIVE_DATETIME_MS(8) REMAINS(1) OBJQTY(1) OBJECTS
+ */
+typedef struct
+{
+    uint8_t *res;
+    uint16_t res_len;
+    uint16_t idx;
+} CmdBinRxRes;
+
+static int cmdBinRxOnHead(const SipfObjectDownHead *head, void *user_data)
+{
+    CmdBinRxRes *rx = (CmdBinRxRes *)user_data;
+    uint8_t *res = rx->res;
+    int idx = 0;
+
+    memcpy(&res[idx], head->otid.value, sizeof(head->otid.value));
+    idx += sizeof(head->otid.value);
+    memcpy(&res[idx], head->user_send_datetime, 8);
+    idx += 8;
+    memcpy(&res[idx], head->recv_datetime, 8);
+    idx += 8;
+    res[idx++] = head->remains;
+    res[idx++] = 0; // OBJQTY(受信し終わってから書く)
+    rx->idx = idx;
+    return 0;
+}
+
+static int cmdBinRxOnObject(const SipfObjectObject *obj, void *user_data)
+{
+    CmdBinRxRes *rx = (CmdBinRxRes *)user_data;
+    // OBJECTSは受信しながら応答に直接書く
+    if (rx->idx + 3 + obj->value_len > rx->res_len) {
+        LOG_ERR("Response buffer full: %d", rx->idx + 3 + obj->value_len);
+        return -ENOMEM;
+    }
+    rx->res[rx->idx++] = obj->obj_type;
+    rx->res[rx->idx++] = obj->obj_tagid;
+    rx->res[rx->idx++] = obj->value_len;
+    memcpy(&rx->res[rx->idx], obj->value, obj->value_len);
+    rx->idx += obj->value_len;
+    return 0;
+}
+
+/**
+ * 先読みしたキューからRXに応答する($$RXと同じキューから順番に返す)
+ */
+static int cmdBinRxFromQueue(uint8_t *res, uint16_t res_len)
+{
+    RxQueueMsg *msg;
+    if (RxQueueHead(&msg) < 0) {
+        return -CMD_BIN_RES_CMDFAIL;
+    }
+    if (msg == NULL) {
+        // 空
+        return 0;
+    }
+    if (16 + 8 + 8 + 1 + 1 + msg->len > res_len) {
+        // 取り出さずに残しておく
+        LOG_ERR("Response buffer full: %d", 16 + 8 + 8 + 1 + 1 + msg->len);
+        return -CMD_BIN_RES_CMDFAIL;
+    }
+
+    int remains = RxQueueRemains();
+    SipfObjectDownHead head = msg->head;
+    head.remains = (remains > 0xff) ? 0xff : remains;
+    CmdBinRxRes rx = {.res = res, .res_len = res_len, .idx = 0};
+    cmdBinRxOnHead(&head, &rx);
+    res[16 + 8 + 8 + 1] = msg->objqty;
+    memcpy(&res[rx.idx], msg->objs, msg->len);
+    rx.idx += msg->len;
+    RxQueuePop();
+
+    // 空いた分をまた先読みする
+    CmdJobKickPrefetch();
+    return rx.idx;
+}
+
+static int cmdBinCmdRx(uint8_t *payload, uint16_t len, uint8_t *res, uint16_t res_len)
+{
+    CmdBinRxRes rx = {.res = res, .res_len = res_len, .idx = 0};
+    SipfObjectDownHandler handler = {.on_head = cmdBinRxOnHead, .on_object = cmdBinRxOnObject, .user_data = &rx};
+
+    if (len != 0) {
+        return -CMD_BIN_RES_ILLPARM;
+    }
+    if (res_len < 16 + 8 + 8 + 1 + 1) {
+        return -CMD_BIN_RES_CMDFAIL;
+    }
+    if (RxQueueIsEnabled() || (RxQueueDepth() > 0)) {
+        return cmdBinRxFromQueue(res, res_len);
+    }
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    if (ctx == NULL) {
+        return -CMD_BIN_RES_CMDFAIL;
+    }
+    int objqty = SipfObjClientObjDown(ctx, &handler);
+    SipfClientHttpCtxFree(ctx);
+    if ((objqty < 0) || (objqty > OBJ_MAX_CNT)) {
+        LOG_ERR("SipfObjClientObjDown(): %d", objqty);
+        return -CMD_BIN_RES_CMDFAIL;
+    }
+    // OBJQTY
+    res[16 + 8 + 8 + 1] = objqty;
+    return rx.idx;
+}
+
+static CmdBinCmd cmdfunc[] = {{CMD_BIN_OP_REG_W, cmdBinCmdW}, {CMD_BIN_OP_REG_R, cmdBinCmdR}, {CMD_BIN_OP_TX, cmdBinCmdTx}, {CMD_BIN_OP_RX, cmdBinCmdRx}, {0, NULL}};
+
+/**
+ * バイナリコマンドを処理して応答フレームを返す
+ * in_buff: SOFより後ろ(OPCODE〜CRC)を格納してるバッファ
+ */
+int CmdBinParse(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    uint8_t opcode = in_buff[0];
+    uint16_t len = sys_get_be16(&in_buff[1]);
+    uint8_t *payload = &in_buff[CMD_BIN_HEADER_SZ];
+
+    // 応答データはSOF + HEADER + STATUSの後ろに置く
+    uint8_t *res = &out_buff[1 + CMD_BIN_HEADER_SZ + 1];
+    uint16_t res_len = out_buff_len - (1 + CMD_BIN_HEADER_SZ + 1 + CMD_BIN_CRC_SZ);
+
+    if (in_len != CMD_BIN_HEADER_SZ + len + CMD_BIN_CRC_SZ) {
+        return cmdBinCreateRes(opcode, CMD_BIN_RES_ILLPARM, 0, out_buff);
+    }
+    uint16_t crc = sys_get_be16(&payload[len]);
+    if (crc16_itu_t(0xffff, in_buff, CMD_BIN_HEADER_SZ + len) != crc) {
+        // CRCが一致しない
+        LOG_ERR("CRC miss match.");
+        return cmdBinCreateRes(opcode, CMD_BIN_RES_CRC, 0, out_buff);
+    }
+
+    for (int i = 0; cmdfunc[i].cmd_func; i++) {
+        if (cmdfunc[i].opcode == opcode) {
+            int ret = cmdfunc[i].cmd_func(payload, len, res, res_len);
+            if (ret < 0) {
+                return cmdBinCreateRes(opcode, -ret, 0, out_buff);
+            }
+            return cmdBinCreateRes(opcode, CMD_BIN_RES_OK, ret, out_buff);
+        }
+    }
+
+    // 未定義のコマンド
+    return cmdBinCreateRes(opcode, CMD_BIN_RES_UNKNOWN, 0, out_buff);
+}
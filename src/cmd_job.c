@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "cmd_job.h"
+#include "hex.h"
+#include "outbox.h"
+#include "registers.h"
+#include "rx_queue.h"
+#include "uart_broker.h"
+#include "sipf/sipf_object.h"
+
+K_THREAD_STACK_DEFINE(cmd_job_stack, CMD_JOB_STACK_SZ);
+static struct k_work_q cmd_job_workq;
+
+K_MEM_SLAB_DEFINE_STATIC(cmd_job_slab, sizeof(CmdJob), CMD_JOB_CNT, 4);
+
+static uint8_t job_id;
+
+// CmdJobDrain()の間はワークキューに積めないので、積めなかったものを覚えておいて後でやり直す
+#define CMD_JOB_LOST_OUTBOX BIT(0)
+#define CMD_JOB_LOST_PREFETCH BIT(1)
+static atomic_t kick_lost;
+
+/**
+ * $$TXの結果を通知する
+ * otidがNULLなら、アウトボックスに溜めたときは "QUEUED" そうでなければ "NG"
+ */
+static void cmd_job_notify_tx(uint8_t id, const SipfObjectOtid *otid, bool queued)
+{
+    // "+TX:XX," + OTID + "\r\n"
+    uint8_t res[7 + sizeof(otid->value) * 2 + 3];
+    int len;
+
+    if (otid != NULL) {
+        len = sprintf(res, "+TX:%02X,", id);
+        len += HexEncode(&res[len], otid->value, sizeof(otid->value));
+        len += sprintf(&res[len], "\r\n");
+    } else {
+        len = sprintf(res, "+TX:%02X,%s\r\n", id, queued ? "QUEUED" : "NG");
+    }
+    UartBrokerPut(res, len);
+}
+
+/** アウトボックスの再送(ワークキューで実行する) **/
+static void cmd_job_outbox_drain(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(outbox_work, cmd_job_outbox_drain);
+
+static void cmd_job_outbox_drain(struct k_work *work)
+{
+    int err = OutboxDrain();
+    if (err != 0) {
+        LOG_WRN("OutboxDrain() failed: %d", err);
+    }
+    if (OutboxDepth() > 0) {
+        // 残っていれば後でやり直す
+        k_work_reschedule_for_queue(&cmd_job_workq, &outbox_work, K_SECONDS(CONFIG_SIPF_OUTBOX_RETRY_INTERVAL));
+    }
+}
+
+/**
+ * 送れなかったペイロードをアウトボックスに溜める(REG_01_OUTBOX=0x01のとき)
+ * 戻り値: 溜めたらtrue
+ */
+bool CmdJobStoreOutbox(const uint8_t *payload, uint16_t len)
+{
+    if (!OutboxIsEnabled()) {
+        return false;
+    }
+    if (OutboxPut(payload, len) != 0) {
+        return false;
+    }
+    k_work_schedule_for_queue(&cmd_job_workq, &outbox_work, K_SECONDS(CONFIG_SIPF_OUTBOX_RETRY_INTERVAL));
+    return true;
+}
+
+/**
+ * アウトボックスに溜まっていればすぐに送り直す(接続できたときに呼ぶ)
+ */
+void CmdJobKickOutbox(void)
+{
+    if (OutboxDepth() > 0) {
+        if (k_work_reschedule_for_queue(&cmd_job_workq, &outbox_work, K_NO_WAIT) < 0) {
+            atomic_or(&kick_lost, CMD_JOB_LOST_OUTBOX);
+        }
+    }
+}
+
+/** 受信の先読み(ワークキューで実行する) **/
+static void cmd_job_prefetch(struct k_work *work)
+{
+    int queued_cnt = 0;
+
+    while (RxQueueIsEnabled()) {
+        bool queued;
+        int remains = RxQueueFetch(&queued);
+        if (remains < 0) {
+            // 一杯か失敗したら次の$$RXまで待つ
+            if (remains != -ENOSPC) {
+                LOG_WRN("RxQueueFetch() failed: %d", remains);
+            }
+            break;
+        }
+        if (queued) {
+            queued_cnt++;
+        }
+        if (remains == 0) {
+            break;
+        }
+    }
+
+    if ((queued_cnt > 0) && RxQueueIsNotify()) {
+        uint8_t res[12];
+        int len = sprintf(res, "+RX:%02X\r\n", RxQueueDepth() & 0xff);
+        UartBrokerPut(res, len);
+    }
+}
+static K_WORK_DEFINE(prefetch_work, cmd_job_prefetch);
+
+/**
+ * 受信の先読みを始める(REG_01_PREFETCHが0x00以外のとき)
+ * サーバーに残っているか、キューに空きができたときに呼ぶ
+ */
+void CmdJobKickPrefetch(void)
+{
+    if (RxQueueIsEnabled() && (RxQueueRemains() > 0)) {
+        if (k_work_submit_to_queue(&cmd_job_workq, &prefetch_work) < 0) {
+            atomic_or(&kick_lost, CMD_JOB_LOST_PREFETCH);
+        }
+    }
+}
+
+/** バッチ送信(ワークキューのスレッドからだけ触る) **/
+static struct
+{
+    SipfClientHttpCtx *ctx; // まとめたペイロードを書くリクエストコンテキスト(NULL: 空)
+    uint8_t *payload;
+    uint16_t sz;
+    uint16_t len;
+    uint8_t ids[CMD_JOB_BATCH_MAX];
+    uint8_t cnt;
+} batch;
+
+static void cmd_job_batch_flush(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(batch_flush_work, cmd_job_batch_flush);
+
+static bool cmd_job_batch_enabled(void)
+{
+    return *REG_01_BATCH_WINDOW != 0x00;
+}
+
+/**
+ * まとめたペイロードを送信して、まとめた$$TXそれぞれに結果を通知する
+ */
+static void cmd_job_batch_send(void)
+{
+    SipfObjectOtid otid;
+
+    if (batch.ctx == NULL) {
+        return;
+    }
+    LOG_DBG("Send batch: cnt=%d len=%d", batch.cnt, batch.len);
+    int err = SipfObjClientObjUpCtx(batch.ctx, batch.len, &otid);
+    bool queued = false;
+    if (err != 0) {
+        LOG_ERR("SipfObjClientObjUpCtx() failed: %d", err);
+        queued = CmdJobStoreOutbox(batch.payload, batch.len);
+    } else {
+        CmdJobKickOutbox();
+    }
+    for (int i = 0; i < batch.cnt; i++) {
+        cmd_job_notify_tx(batch.ids[i], (err == 0) ? &otid : NULL, queued);
+    }
+    SipfClientHttpCtxFree(batch.ctx);
+    batch.ctx = NULL;
+    batch.len = 0;
+    batch.cnt = 0;
+}
+
+static void cmd_job_batch_flush(struct k_work *work)
+{
+    cmd_job_batch_send();
+}
+
+/**
+ * ジョブのペイロードをバッチに追加する
+ */
+static void cmd_job_batch_add(CmdJob *job)
+{
+    if ((batch.ctx != NULL) && (batch.len + job->len > batch.sz)) {
+        // 入り切らないので先に送る
+        cmd_job_batch_send();
+    }
+    if (batch.ctx == NULL) {
+        batch.ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+        if (batch.ctx == NULL) {
+            cmd_job_notify_tx(job->id, NULL, CmdJobStoreOutbox(job->payload, job->len));
+            return;
+        }
+        batch.payload = SipfObjClientGetObjUpPayloadBuff(batch.ctx, &batch.sz);
+        // 最初の$$TXから待つ時間を数える
+        k_work_reschedule_for_queue(&cmd_job_workq, &batch_flush_work, K_MSEC(*REG_01_BATCH_WINDOW * 10));
+    }
+    memcpy(&batch.payload[batch.len], job->payload, job->len);
+    batch.len += job->len;
+    batch.ids[batch.cnt++] = job->id;
+
+    uint8_t max_cnt = *REG_01_BATCH_CNT;
+    if ((max_cnt == 0x00) || (max_cnt > CMD_JOB_BATCH_MAX)) {
+        max_cnt = CMD_JOB_BATCH_MAX;
+    }
+    uint16_t max_sz = *REG_01_BATCH_SZ * 16;
+    if ((batch.cnt >= max_cnt) || ((max_sz != 0) && (batch.len >= max_sz))) {
+        // しきい値に達したので待たずに送る
+        k_work_cancel_delayable(&batch_flush_work);
+        cmd_job_batch_send();
+    }
+}
+
+/**
+ * $$TX/$$TXRAWのジョブ
+ */
+static void cmd_job_tx(struct k_work *work)
+{
+    CmdJob *job = CONTAINER_OF(work, CmdJob, work);
+    SipfObjectOtid otid;
+
+    if (cmd_job_batch_enabled() || (batch.ctx != NULL)) {
+        cmd_job_batch_add(job);
+    } else {
+        int err = SipfObjClientObjUpRaw(job->payload, job->len, &otid);
+        bool queued = false;
+        if (err != 0) {
+            LOG_ERR("SipfClientObjUpRaw() failed: %d", err);
+            queued = CmdJobStoreOutbox(job->payload, job->len);
+        } else {
+            CmdJobKickOutbox();
+        }
+        cmd_job_notify_tx(job->id, (err == 0) ? &otid : NULL, queued);
+    }
+
+    CmdJobFree(job);
+}
+
+void CmdJobInit(void)
+{
+    struct k_work_queue_config cfg = {.name = "cmd_job"};
+    k_work_queue_init(&cmd_job_workq);
+    k_work_queue_start(&cmd_job_workq, cmd_job_stack, K_THREAD_STACK_SIZEOF(cmd_job_stack), CMD_JOB_PRIORITY, &cfg);
+
+    // アウトボックスが使えなくても送信はできる
+    int err = OutboxInit();
+    if (err != 0) {
+        LOG_ERR("OutboxInit() failed: %d", err);
+    }
+}
+
+/**
+ * 非同期で実行するか
+ */
+bool CmdJobIsAsync(void)
+{
+    return *REG_01_ASYNC == 0x01;
+}
+
+/**
+ * ジョブを確保する(空きがなければNULL)
+ */
+CmdJob *CmdJobAlloc(void)
+{
+    CmdJob *job;
+    if (k_mem_slab_alloc(&cmd_job_slab, (void **)&job, K_NO_WAIT) != 0) {
+        LOG_WRN("No free job");
+        return NULL;
+    }
+    job->len = 0;
+    return job;
+}
+
+void CmdJobFree(CmdJob *job)
+{
+    if (job != NULL) {
+        k_mem_slab_free(&cmd_job_slab, (void **)&job);
+    }
+}
+
+/**
+ * payloadに組み立てたOBJECTS_UPを送信するジョブを投入する
+ * 戻り値: ジョブのID
+ */
+int CmdJobSubmitTx(CmdJob *job, uint16_t len)
+{
+    job->id = job_id++;
+    job->len = len;
+    k_work_init(&job->work, cmd_job_tx);
+    k_work_submit_to_queue(&cmd_job_workq, &job->work);
+    return job->id;
+}
+
+/**
+ * 受け付けたジョブが全て終わるまで待つ
+ */
+void CmdJobDrain(void)
+{
+    // まとめて送るのを待っているペイロードもすぐに送る
+    k_work_reschedule_for_queue(&cmd_job_workq, &batch_flush_work, K_NO_WAIT);
+    k_work_queue_drain(&cmd_job_workq, false);
+
+    // 待っている間に積めなかったものをやり直す
+    atomic_val_t lost = atomic_clear(&kick_lost);
+    if (lost & CMD_JOB_LOST_OUTBOX) {
+        CmdJobKickOutbox();
+    } else if ((OutboxDepth() > 0) && !k_work_delayable_is_pending(&outbox_work)) {
+        // 待っている間に再送のタイマーが切れた
+        k_work_schedule_for_queue(&cmd_job_workq, &outbox_work, K_SECONDS(CONFIG_SIPF_OUTBOX_RETRY_INTERVAL));
+    }
+    if (lost & CMD_JOB_LOST_PREFETCH) {
+        CmdJobKickPrefetch();
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "cmd_sink.h"
+#include "hex.h"
+#include "uart_broker.h"
+
+static void cmd_sink_tx_done(const uint8_t *data, int len, void *user_data)
+{
+    k_sem_give((struct k_sem *)user_data);
+}
+
+void CmdSinkInit(CmdSink *sink, uint8_t *buff, uint16_t buff_len)
+{
+    sink->sz = buff_len / 2;
+    sink->buff[0] = buff;
+    sink->buff[1] = buff + sink->sz;
+    sink->len = 0;
+    sink->cur = 0;
+    sink->total = 0;
+    sink->err = 0;
+    // buff[0]に書くところから始める
+    k_sem_init(&sink->sem_done[0], 0, 1);
+    k_sem_init(&sink->sem_done[1], 1, 1);
+}
+
+/**
+ * 書き込み中のバッファを送信して、もう片方のバッファに切り替える
+ */
+int CmdSinkFlush(CmdSink *sink)
+{
+    if (sink->err == -ETIMEDOUT) {
+        // 送信が止まっているので残りは捨てる
+        sink->len = 0;
+    }
+    if (sink->len > 0) {
+        int ret = UartBrokerPutRef(sink->buff[sink->cur], sink->len, cmd_sink_tx_done, &sink->sem_done[sink->cur]);
+        if (ret != 0) {
+            LOG_ERR("UartBrokerPutRef() failed: %d", ret);
+            sink->err = ret;
+            k_sem_give(&sink->sem_done[sink->cur]);
+        } else {
+            sink->total += sink->len;
+        }
+        sink->cur ^= 1;
+        sink->len = 0;
+        // 切り替えたバッファの送信が終わるのを待つ(送信が進まなければ取り消して失敗にする)
+        if (UartBrokerPutRefWait(&sink->sem_done[sink->cur]) != 0) {
+            sink->err = -ETIMEDOUT;
+        }
+    }
+    return sink->err;
+}
+
+int CmdSinkWrite(CmdSink *sink, const void *data, uint16_t len)
+{
+    const uint8_t *p = data;
+    while (len > 0) {
+        uint16_t n = MIN(len, sink->sz - sink->len);
+        memcpy(&sink->buff[sink->cur][sink->len], p, n);
+        sink->len += n;
+        p += n;
+        len -= n;
+        if (sink->len == sink->sz) {
+            CmdSinkFlush(sink);
+        }
+    }
+    return sink->err;
+}
+
+int CmdSinkPuts(CmdSink *sink, const char *str)
+{
+    return CmdSinkWrite(sink, str, strlen(str));
+}
+
+int CmdSinkPrintf(CmdSink *sink, const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    for (int i = 0; i < 2; i++) {
+        uint16_t room = sink->sz - sink->len;
+        va_start(ap, fmt);
+        ret = vsnprintf(&sink->buff[sink->cur][sink->len], room, fmt, ap);
+        va_end(ap);
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret < room) {
+            // 収まった(NULL文字は含めない)
+            sink->len += ret;
+            return sink->err;
+        }
+        if (sink->len == 0) {
+            // 空のバッファにも収まらない
+            break;
+        }
+        // 収まらなかったので送ってから書き直す
+        CmdSinkFlush(sink);
+    }
+    LOG_ERR("CmdSinkPrintf: too long(%d)", ret);
+    return -ENOMEM;
+}
+
+/**
+ * バイト列を16進文字列にして書く
+ */
+int CmdSinkHex(CmdSink *sink, const uint8_t *data, uint16_t len)
+{
+    while (len > 0) {
+        // HexEncode()は終端にNULL文字を書くので1byte余裕をみる
+        uint16_t n = MIN(len, (sink->sz - sink->len - 1) / 2);
+        if (n == 0) {
+            CmdSinkFlush(sink);
+            continue;
+        }
+        sink->len += HexEncode(&sink->buff[sink->cur][sink->len], data, n);
+        data += n;
+        len -= n;
+    }
+    return sink->err;
+}
+
+/**
+ * 残りを送信して送り終わるまで待つ
+ * 戻り値: 0(応答は送信済み), 送信に失敗していたら負
+ */
+int CmdSinkEnd(CmdSink *sink)
+{
+    CmdSinkFlush(sink);
+    // 最後に送ったバッファ(送っていなければ空き)を待つ(取り消すまでbuffとsem_doneを参照されている)
+    if (UartBrokerPutRefWait(&sink->sem_done[sink->cur ^ 1]) != 0) {
+        sink->err = -ETIMEDOUT;
+    }
+    k_sem_give(&sink->sem_done[sink->cur ^ 1]);
+    return (sink->err < 0) ? sink->err : 0;
+}
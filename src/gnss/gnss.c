@@ -158,6 +158,14 @@ int gnss_log_dbg_nmea()
     return nmea_string_cnt;
 }
 
+const char *gnss_get_nmea(int idx)
+{
+    if ((idx < 0) || (idx >= nmea_string_cnt)) {
+        return NULL;
+    }
+    return nmea_strings[idx];
+}
+
 int gnss_strcpy_nmea(char *dest)
 {
     int ret = 0;
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include "cmd_ascii.h"
+#include "cmd_sink.h"
+#include "gnss/gnss.h"
+
+/*** GNSSコマンド ***/
+
+/**
+ * $$GNSSEN コマンド
+ * in_buff: コマンド名より後ろを格納してるバッファ
+ */
+static int cmdAsciiCmdGnssEnable(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    if (in_buff[0] != 0x20) {
+        // 先頭がスペースじゃない
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+    if (in_len != 2) {
+        // パラメータ長が違う
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+
+    if (in_buff[1] == '0') {
+        // GPS無効
+        if (gnss_stop() != 0) {
+            return CmdAsciiResNg(out_buff, out_buff_len);
+        }
+    } else if (in_buff[1] == '1') {
+        // GPS有効
+        if (gnss_start() != 0) {
+            return CmdAsciiResNg(out_buff, out_buff_len);
+        }
+    } else {
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+
+    return CmdAsciiResOk(out_buff, out_buff_len);
+}
+CMD_ASCII_DEFINE(gnss_enable, CMD_GNSS_ENABLE, cmdAsciiCmdGnssEnable);
+
+/**
+ * $$GNSSSTAT コマンド
+ * in_buff: コマンド名より後ろを格納してるバッファ
+ */
+static int cmdAsciiCmdGnssStatus(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    if (in_len != 0) {
+        // パラメータ長が違う
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+
+    struct nrf_modem_gnss_pvt_data_frame pvt;
+    gnss_get_data(&pvt);
+
+    CmdSink sink;
+    CmdSinkInit(&sink, out_buff, out_buff_len);
+
+    CmdSinkPrintf(&sink, "Fix valid: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_FIX_VALID) != 0 ? "true" : "false");
+    CmdSinkPrintf(&sink, "Leap second valid: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_LEAP_SECOND_VALID) != 0 ? "true" : "false");
+    CmdSinkPrintf(&sink, "Sleep between PVT: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_SLEEP_BETWEEN_PVT) != 0 ? "true" : "false");
+    CmdSinkPrintf(&sink, "Deadline missed: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_DEADLINE_MISSED) != 0 ? "true" : "false");
+    CmdSinkPrintf(&sink, "Insuf. time window: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_NOT_ENOUGH_WINDOW_TIME) != 0 ? "true" : "false");
+    CmdSinkPrintf(&sink, "Velocity estimate valid: %s\n", (pvt.flags & NRF_MODEM_GNSS_PVT_FLAG_VELOCITY_VALID) != 0 ? "true" : "false");
+
+    CmdSinkPrintf(&sink, "OK\n");
+    return CmdSinkEnd(&sink);
+}
+CMD_ASCII_DEFINE(gnss_status, CMD_GNSS_GET_STATUS, cmdAsciiCmdGnssStatus);
+
+/**
+ * $$GNSSLOC コマンド
+ * in_buff: コマンド名より後ろを格納してるバッファ
+ */
+static int cmdAsciiCmdGnssLocation(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    if (in_len != 0) {
+        // パラメータ長が違う
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+
+    bool got_fix;
+    struct nrf_modem_gnss_pvt_data_frame pvt;
+    got_fix = gnss_get_data(&pvt);
+
+    CmdSink sink;
+    CmdSinkInit(&sink, out_buff, out_buff_len);
+
+    if (!got_fix) {
+        // NOTFIXED
+        CmdSinkPrintf(&sink, "V,");
+    } else {
+        // FIXED
+        CmdSinkPrintf(&sink, "A,");
+    }
+    CmdSinkPrintf(&sink, "%.6f,%.6f,%f,%f,%f,%04u-%02u-%02uT%02u:%02u:%02uZ", pvt.longitude, pvt.latitude, pvt.altitude, pvt.speed, pvt.heading, pvt.datetime.year, pvt.datetime.month, pvt.datetime.day, pvt.datetime.hour, pvt.datetime.minute, pvt.datetime.seconds);
+    CmdSinkPrintf(&sink, "\r\nOK\r\n");
+    return CmdSinkEnd(&sink);
+}
+CMD_ASCII_DEFINE(gnss_location, CMD_GNSS_GET_LOCATION, cmdAsciiCmdGnssLocation);
+
+/**
+ * $$GNSSNMEA コマンド
+ * in_buff: コマンド名より後ろを格納してるバッファ
+ */
+static int cmdAsciiCmdGnssNmea(uint8_t *in_buff, uint16_t in_len, uint8_t *out_buff, uint16_t out_buff_len)
+{
+    if (in_len != 0) {
+        // パラメータ長が違う
+        return CmdAsciiResIllParam(out_buff, out_buff_len);
+    }
+    // 応答は組み立てながらUARTへ流す
+    CmdSink sink;
+    CmdSinkInit(&sink, out_buff, out_buff_len);
+    const char *nmea;
+    for (int i = 0; (nmea = gnss_get_nmea(i)) != NULL; i++) {
+        CmdSinkPuts(&sink, nmea);
+    }
+    CmdSinkPuts(&sink, "\r\nOK\r\n");
+    return CmdSinkEnd(&sink);
+}
+CMD_ASCII_DEFINE(gnss_nmea, CMD_GNSS_GET_NMEA, cmdAsciiCmdGnssNmea);
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hex.h"
+
+/* 16進文字 -> 値のテーブル(16進文字以外はHEX_INVALID) */
+#define HEX_INVALID (0x80)
+#define HEX_DEC_DIGIT(c) [(c)] = (c) - '0'
+#define HEX_DEC_ALPHA(c) [(c)] = (c) - 'A' + 10, [(c) + 0x20] = (c) - 'A' + 10
+static const uint8_t hex_dec_tbl[256] = {
+    [0 ... 255] = HEX_INVALID,
+    HEX_DEC_DIGIT('0'),
+    HEX_DEC_DIGIT('1'),
+    HEX_DEC_DIGIT('2'),
+    HEX_DEC_DIGIT('3'),
+    HEX_DEC_DIGIT('4'),
+    HEX_DEC_DIGIT('5'),
+    HEX_DEC_DIGIT('6'),
+    HEX_DEC_DIGIT('7'),
+    HEX_DEC_DIGIT('8'),
+    HEX_DEC_DIGIT('9'),
+    HEX_DEC_ALPHA('A'),
+    HEX_DEC_ALPHA('B'),
+    HEX_DEC_ALPHA('C'),
+    HEX_DEC_ALPHA('D'),
+    HEX_DEC_ALPHA('E'),
+    HEX_DEC_ALPHA('F'),
+};
+
+/* 値 -> 16進文字2文字のテーブル(メモリ上の並びが上位桁, 下位桁になるように詰める) */
+#define HEX_CH(n) ((n) < 10 ? '0' + (n) : 'A' + (n)-10)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HEX_PAIR(b) (uint16_t)(HEX_CH((b) >> 4) | (HEX_CH((b)&0x0f) << 8))
+#else
+#define HEX_PAIR(b) (uint16_t)((HEX_CH((b) >> 4) << 8) | HEX_CH((b)&0x0f))
+#endif
+#define HEX_ROW(h) HEX_PAIR((h) + 0x0), HEX_PAIR((h) + 0x1), HEX_PAIR((h) + 0x2), HEX_PAIR((h) + 0x3), HEX_PAIR((h) + 0x4), HEX_PAIR((h) + 0x5), HEX_PAIR((h) + 0x6), HEX_PAIR((h) + 0x7), HEX_PAIR((h) + 0x8), HEX_PAIR((h) + 0x9), HEX_PAIR((h) + 0xa), HEX_PAIR((h) + 0xb), HEX_PAIR((h) + 0xc), HEX_PAIR((h) + 0xd), HEX_PAIR((h) + 0xe), HEX_PAIR((h) + 0xf)
+static const uint16_t hex_enc_tbl[256] = {
+    HEX_ROW(0x00), HEX_ROW(0x10), HEX_ROW(0x20), HEX_ROW(0x30), HEX_ROW(0x40), HEX_ROW(0x50), HEX_ROW(0x60), HEX_ROW(0x70), HEX_ROW(0x80), HEX_ROW(0x90), HEX_ROW(0xa0), HEX_ROW(0xb0), HEX_ROW(0xc0), HEX_ROW(0xd0), HEX_ROW(0xe0), HEX_ROW(0xf0),
+};
+
+/**
+ * 16進文字を値に変換する
+ * 戻り値: 0-15 値, 16進文字以外 -EINVAL
+ */
+int HexNibble(uint8_t c)
+{
+    uint8_t v = hex_dec_tbl[c];
+    if (v & HEX_INVALID) {
+        return -EINVAL;
+    }
+    return v;
+}
+
+/**
+ * 2桁の16進文字列をUINT8に変換する
+ * 戻り値: 0x00-0xff 値, 16進文字以外 -EINVAL
+ */
+int HexToUint8(const uint8_t *src)
+{
+    uint8_t hi = hex_dec_tbl[src[0]];
+    uint8_t lo = hex_dec_tbl[src[1]];
+    if ((hi | lo) & HEX_INVALID) {
+        return -EINVAL;
+    }
+    return (hi << 4) | lo;
+}
+
+/**
+ * バイト列を大文字の16進文字列に変換する(sprintf("%02X")の置き換え)
+ * dstにはlen * 2 + 1(終端のNULL文字)の領域が必要
+ * 戻り値: 書き込んだ文字数(NULL文字を含まない)
+ */
+size_t HexEncode(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+    uint16_t w[4];
+
+    // 4Byteずつ変換して8文字まとめて書く
+    for (; i + 4 <= len; i += 4) {
+        w[0] = hex_enc_tbl[src[i + 0]];
+        w[1] = hex_enc_tbl[src[i + 1]];
+        w[2] = hex_enc_tbl[src[i + 2]];
+        w[3] = hex_enc_tbl[src[i + 3]];
+        memcpy(&dst[i * 2], w, sizeof(w));
+    }
+    // 端数
+    for (; i < len; i++) {
+        memcpy(&dst[i * 2], &hex_enc_tbl[src[i]], sizeof(uint16_t));
+    }
+    dst[len * 2] = '\0';
+    return len * 2;
+}
+
+/**
+ * 16進文字列(len * 2文字)をバイト列(lenバイト)に変換する
+ * 戻り値: 0 成功, 16進文字以外が含まれていたら -EINVAL(dstの内容は不定)
+ */
+int HexDecode(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+    uint8_t invalid = 0;
+
+    // 8文字ずつ変換して不正な文字のチェックはまとめて行う
+    for (; i + 4 <= len; i += 4) {
+        const uint8_t *s = &src[i * 2];
+        uint8_t v0 = hex_dec_tbl[s[0]], v1 = hex_dec_tbl[s[1]];
+        uint8_t v2 = hex_dec_tbl[s[2]], v3 = hex_dec_tbl[s[3]];
+        uint8_t v4 = hex_dec_tbl[s[4]], v5 = hex_dec_tbl[s[5]];
+        uint8_t v6 = hex_dec_tbl[s[6]], v7 = hex_dec_tbl[s[7]];
+        invalid |= v0 | v1 | v2 | v3 | v4 | v5 | v6 | v7;
+        dst[i + 0] = (v0 << 4) | v1;
+        dst[i + 1] = (v2 << 4) | v3;
+        dst[i + 2] = (v4 << 4) | v5;
+        dst[i + 3] = (v6 << 4) | v7;
+    }
+    // 端数
+    for (; i < len; i++) {
+        uint8_t hi = hex_dec_tbl[src[i * 2]];
+        uint8_t lo = hex_dec_tbl[src[i * 2 + 1]];
+        invalid |= hi | lo;
+        dst[i] = (hi << 4) | lo;
+    }
+    if (invalid & HEX_INVALID) {
+        return -EINVAL;
+    }
+    return 0;
+}
@@ -23,11 +23,14 @@
 #include <zephyr/sys/reboot.h>
 
 #include "cmd.h"
+#include "cmd_job.h"
 #include "fota/fota_http.h"
 #include "sipf/sipf_client_http.h"
 #include "sipf/sipf_auth.h"
 #include "gnss/gnss.h"
 #include "uart_broker.h"
+#include "uart_print_bench.h"
+#include "xmodem_recv_bench.h"
 
 #include "registers.h"
 #include "version.h"
@@ -48,7 +51,7 @@ static const struct gpio_dt_spec WAKE_IN = GPIO_DT_SPEC_GET(DT_ALIAS(wake_in), g
 /** TLS **/
 #define TLS_SEC_TAG 42
 static const char cert[] = {
-#include "sipf/cert/sipf.iot.sakura.ad.jp"
+#include CONFIG_SIPF_TLS_CA_CERT_FILE
 };
 BUILD_ASSERT(sizeof(cert) < KB(4), "Certificate too large");
 /*********/
@@ -216,6 +219,9 @@ static int cert_provision(void)
         LOG_ERR("Failed to provision certificate, err %d", err);
         return err;
     }
+    // 証明書が変わったのでキャッシュしているTLSセッションと維持している接続は使わない
+    SipfClientHttpTlsSessionPurge();
+    SipfClientHttpCloseAll();
 
     return 0;
 }
@@ -233,8 +239,14 @@ static void lte_handler(const struct lte_lc_evt *const evt)
         if ((evt->nw_reg_status == LTE_LC_NW_REG_REGISTERED_HOME) || (evt->nw_reg_status == LTE_LC_NW_REG_REGISTERED_ROAMING)) {
             UartBrokerPrint("REGISTERD\r\n");
             k_sem_give(&lte_connected);
+            // 送れずに溜めていたOBJECTS_UPを送り直す
+            CmdJobKickOutbox();
             break;
         }
+        if ((evt->nw_reg_status == LTE_LC_NW_REG_NOT_REGISTERED) || (evt->nw_reg_status == LTE_LC_NW_REG_REGISTRATION_DENIED) || (evt->nw_reg_status == LTE_LC_NW_REG_UNKNOWN)) {
+            // 圏外になったら維持している接続は使えないので閉じておく(次のリクエストでやり直さずに接続する)
+            SipfClientHttpCloseAll();
+        }
         break;
     case LTE_LC_EVT_CELL_UPDATE:
         LOG_DBG("- mcc=%d, mnc=%d", evt->cell.mcc, evt->cell.mnc);
@@ -360,6 +372,11 @@ static int init_modem_and_lte(void)
                 LOG_ERR("modem_info_init() failed, err: %d", err);
             }
 
+            // 接続先を名前解決しておく
+            SipfClientHttpPreResolve(CONFIG_SIPF_CONNECTOR_HTTP_HOST);
+            SipfClientHttpPreResolve(CONFIG_SIPF_AUTH_HOST);
+            SipfClientHttpPreResolve(CONFIG_SIPF_FILE_REQ_URL_HOST);
+
             return 0;
         } else {
             //
@@ -384,6 +401,13 @@ int main(void)
     // UartBrokerの初期化(以降、Debug系の出力も可能)
     uart_dev =  DEVICE_DT_GET(DT_NODELABEL(uart0));
     UartBrokerInit(uart_dev);
+#ifdef CONFIG_SIPF_UART_PRINT_BENCH
+    UartPrintBench();
+#endif
+#ifdef CONFIG_SIPF_XMODEM_RECV_BENCH
+    XmodemRecvBench();
+#endif
+    CmdInit();
     UartBrokerPrint("*** SIPF Client(Type%02x) v.%d.%d.%d ***\r\n", *REG_CMN_FW_TYPE, *REG_CMN_VER_MJR, *REG_CMN_VER_MNR, *REG_CMN_VER_REL);
 #ifdef CONFIG_LTE_LOCK_PLMN
     UartBrokerPuts("* PLMN: " CONFIG_LTE_LOCK_PLMN_STRING "\r\n");
@@ -451,7 +475,7 @@ int main(void)
             CmdResponse *cr = CmdParse(b);
             if (cr != NULL) {
                 // UARTにレスポンスを返す
-                UartBrokerPut(cr->response, cr->response_len);
+                UartBrokerPutZeroCopy(cr->response, cr->response_len);
             }
         }
 
@@ -464,6 +488,8 @@ int main(void)
 
         if ((*REG_00_MODE == 0x01) && (prev_auth_mode == 0x00)) {
             // 認証モードがIPアドレス認証に切り替えられた
+            // (非同期で受け付けたジョブが認証情報を使い終わるのを待つ)
+            CmdJobDrain();
             err = SipfAuthRequest(user_name, sizeof(user_name), password, sizeof(user_name));
             LOG_DBG("SipfAuthRequest(): %d", err);
             if (err < 0) {
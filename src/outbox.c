@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "outbox.h"
+#include "registers.h"
+#include "sipf/sipf_object.h"
+
+#define OUTBOX_ID_META (1)
+#define OUTBOX_ID_HEAD_BASE (0x100) // +インデックス: エントリのヘッダ
+#define OUTBOX_ID_DATA_BASE (0x200) // +インデックス: エントリのペイロード(送るときにリクエストバッファへ直接読む)
+
+typedef struct
+{
+    uint32_t head; // 次に送るエントリの通し番号
+    uint32_t tail; // 次に書くエントリの通し番号
+    uint32_t boot; // 起動回数(前の起動で保存したエントリの経過時間を区別する)
+} OutboxMeta;
+
+typedef struct
+{
+    uint32_t seq;
+    uint32_t boot;
+    uint32_t stored_s; // 保存したときの起動からの秒数
+    uint32_t crc;      // ペイロードのCRC32
+    uint16_t len;
+} OutboxEntryHead;
+
+static struct nvs_fs fs;
+static bool is_mounted;
+static OutboxMeta meta;
+static K_MUTEX_DEFINE(outbox_lock);
+
+static int outbox_write_meta(void)
+{
+    int err = nvs_write(&fs, OUTBOX_ID_META, &meta, sizeof(meta));
+    if (err < 0) {
+        LOG_ERR("Outbox: nvs_write(meta) failed: %d", err);
+        return err;
+    }
+    return 0;
+}
+
+static void outbox_remove(uint32_t seq)
+{
+    uint16_t idx = seq % CONFIG_SIPF_OUTBOX_CNT;
+    (void)nvs_delete(&fs, OUTBOX_ID_HEAD_BASE + idx);
+    (void)nvs_delete(&fs, OUTBOX_ID_DATA_BASE + idx);
+}
+
+/**
+ * 先頭のエントリのヘッダを読む(outbox_lockを取ってから呼ぶ)
+ */
+static int outbox_read_head(uint32_t seq, OutboxEntryHead *eh)
+{
+    uint16_t idx = seq % CONFIG_SIPF_OUTBOX_CNT;
+    if (nvs_read(&fs, OUTBOX_ID_HEAD_BASE + idx, eh, sizeof(OutboxEntryHead)) != sizeof(OutboxEntryHead)) {
+        return -ENOENT;
+    }
+    if ((eh->seq != seq) || (eh->len == 0) || (eh->len > OUTBOX_ENTRY_SZ)) {
+        return -EBADMSG;
+    }
+    return 0;
+}
+
+/**
+ * ストレージパーティションにNVSをマウントする
+ */
+int OutboxInit(void)
+{
+    const struct flash_area *fa;
+    struct flash_pages_info info;
+
+    int err = flash_area_open(FIXED_PARTITION_ID(storage_partition), &fa);
+    if (err != 0) {
+        LOG_ERR("Outbox: flash_area_open() failed: %d", err);
+        return err;
+    }
+    fs.flash_device = fa->fa_dev;
+    fs.offset = fa->fa_off;
+    err = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+    if (err != 0) {
+        LOG_ERR("Outbox: flash_get_page_info_by_offs() failed: %d", err);
+        flash_area_close(fa);
+        return err;
+    }
+    fs.sector_size = info.size;
+    fs.sector_count = fa->fa_size / info.size;
+    flash_area_close(fa);
+
+    err = nvs_mount(&fs);
+    if (err != 0) {
+        LOG_ERR("Outbox: nvs_mount() failed: %d", err);
+        return err;
+    }
+
+    k_mutex_lock(&outbox_lock, K_FOREVER);
+    if (nvs_read(&fs, OUTBOX_ID_META, &meta, sizeof(meta)) != sizeof(meta)) {
+        // 初めて使う
+        memset(&meta, 0, sizeof(meta));
+    }
+    meta.boot++;
+    err = outbox_write_meta();
+    k_mutex_unlock(&outbox_lock);
+    if (err != 0) {
+        return err;
+    }
+
+    is_mounted = true;
+    LOG_INF("Outbox: depth=%d", OutboxDepth());
+    return 0;
+}
+
+/**
+ * 送れなかったペイロードを保存するか
+ */
+bool OutboxIsEnabled(void)
+{
+    return is_mounted && (*REG_01_OUTBOX == 0x01);
+}
+
+/**
+ * ペイロードを保存する(一杯なら一番古いものを捨てる)
+ */
+int OutboxPut(const uint8_t *payload, uint16_t len)
+{
+    int err;
+
+    if (!is_mounted) {
+        return -ENODEV;
+    }
+    if ((len == 0) || (len > OUTBOX_ENTRY_SZ)) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&outbox_lock, K_FOREVER);
+    if (meta.tail - meta.head >= CONFIG_SIPF_OUTBOX_CNT) {
+        LOG_WRN("Outbox: full, drop the oldest entry(%d)", meta.head);
+        outbox_remove(meta.head);
+        meta.head++;
+    }
+
+    uint16_t idx = meta.tail % CONFIG_SIPF_OUTBOX_CNT;
+    OutboxEntryHead eh = {.seq = meta.tail, .boot = meta.boot, .stored_s = k_uptime_get() / MSEC_PER_SEC, .crc = crc32_ieee(payload, len), .len = len};
+    // ペイロードを先に書く(ヘッダがあればペイロードもある)
+    err = nvs_write(&fs, OUTBOX_ID_DATA_BASE + idx, payload, len);
+    if (err >= 0) {
+        err = nvs_write(&fs, OUTBOX_ID_HEAD_BASE + idx, &eh, sizeof(eh));
+    }
+    if (err < 0) {
+        LOG_ERR("Outbox: nvs_write() failed: %d", err);
+        k_mutex_unlock(&outbox_lock);
+        return err;
+    }
+    meta.tail++;
+    err = outbox_write_meta();
+    LOG_INF("Outbox: stored %d bytes, depth=%d", len, meta.tail - meta.head);
+    k_mutex_unlock(&outbox_lock);
+    return err;
+}
+
+/**
+ * 溜まっているペイロードをリクエストバッファに入るだけまとめてOBJECTS_UP_RETRYで送る
+ * 空になるか送信に失敗するまで繰り返す
+ * 戻り値: 0 空になった, 負 送信に失敗した(残りは次の機会に送る)
+ */
+int OutboxDrain(void)
+{
+    SipfObjectOtid otid;
+    uint16_t sz;
+
+    if (!is_mounted) {
+        return 0;
+    }
+    while (OutboxDepth() > 0) {
+        SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+        if (ctx == NULL) {
+            return -ENOMEM;
+        }
+        uint8_t *payload = SipfObjClientGetObjUpPayloadBuff(ctx, &sz);
+        uint16_t len = 0;
+
+        k_mutex_lock(&outbox_lock, K_FOREVER);
+        uint32_t head = meta.head;
+        uint32_t seq;
+        for (seq = meta.head; seq != meta.tail; seq++) {
+            OutboxEntryHead eh;
+            uint16_t idx = seq % CONFIG_SIPF_OUTBOX_CNT;
+            if (outbox_read_head(seq, &eh) != 0) {
+                // 壊れたエントリは読み飛ばして消す
+                LOG_WRN("Outbox: broken entry(%d)", seq);
+                continue;
+            }
+            if (len + eh.len > sz) {
+                // 残りは次のリクエストで送る
+                break;
+            }
+            if ((nvs_read(&fs, OUTBOX_ID_DATA_BASE + idx, &payload[len], eh.len) != eh.len) || (crc32_ieee(&payload[len], eh.len) != eh.crc)) {
+                LOG_WRN("Outbox: CRC error(%d)", seq);
+                continue;
+            }
+            len += eh.len;
+        }
+        k_mutex_unlock(&outbox_lock);
+
+        int err = 0;
+        if (len > 0) {
+            err = SipfObjClientObjUpRetryCtx(ctx, len, &otid);
+        }
+        SipfClientHttpCtxFree(ctx);
+        if (err != 0) {
+            LOG_WRN("Outbox: SipfObjClientObjUpRetryCtx() failed: %d", err);
+            return err;
+        }
+        LOG_INF("Outbox: sent %d entries(%d bytes)", seq - head, len);
+
+        k_mutex_lock(&outbox_lock, K_FOREVER);
+        // 送っている間に一杯になって捨てられた分は消さなくていい
+        if (meta.head - head < seq - head) {
+            for (uint32_t s = meta.head; s != seq; s++) {
+                outbox_remove(s);
+            }
+            meta.head = seq;
+        }
+        err = outbox_write_meta();
+        k_mutex_unlock(&outbox_lock);
+        if (err != 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 溜まっている件数
+ */
+int OutboxDepth(void)
+{
+    if (!is_mounted) {
+        return 0;
+    }
+    k_mutex_lock(&outbox_lock, K_FOREVER);
+    int depth = meta.tail - meta.head;
+    k_mutex_unlock(&outbox_lock);
+    return depth;
+}
+
+/**
+ * 一番古いエントリを保存してからの秒数(空なら0)
+ * 前の起動で保存したエントリは、今回の起動からの秒数を返す
+ */
+int64_t OutboxOldestAge(void)
+{
+    OutboxEntryHead eh;
+    int64_t now_s = k_uptime_get() / MSEC_PER_SEC;
+    int64_t age = 0;
+
+    if (!is_mounted) {
+        return 0;
+    }
+    k_mutex_lock(&outbox_lock, K_FOREVER);
+    if ((meta.tail != meta.head) && (outbox_read_head(meta.head, &eh) == 0)) {
+        age = (eh.boot == meta.boot) ? (now_s - eh.stored_s) : now_s;
+    }
+    k_mutex_unlock(&outbox_lock);
+    return age;
+}
@@ -48,10 +48,37 @@ static int bank00_read(const uint8_t addr, uint8_t *value)
 }
 /**/
 
+/* BANK01 */
+uint8_t bank01[240];
+static int bank01_reset(void)
+{
+    memset(bank01, 0, sizeof(bank01));
+    return 0;
+}
+static int bank01_write(const uint8_t addr, const uint8_t value)
+{
+    if (addr >= 0xf0) {
+        //共通レジスタに書こうとした
+        return -1;
+    }
+    bank01[addr] = value;
+    return value;
+}
+static int bank01_read(const uint8_t addr, uint8_t *value)
+{
+    if (addr >= 0xf0) {
+        //共通レジスタを読もうとした
+        return -1;
+    }
+    *value = bank01[addr];
+    return *value;
+}
+/**/
+
 /**
  * バンクリスト
  */
-static RegistersBankFuncs bank_func[] = {{bank00_reset, bank00_write, bank00_read}, {NULL, NULL, NULL}};
+static RegistersBankFuncs bank_func[] = {{bank00_reset, bank00_write, bank00_read}, {bank01_reset, bank01_write, bank01_read}, {NULL, NULL, NULL}};
 
 /* 共通レジスタ */
 /**
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "registers.h"
+#include "rx_queue.h"
+
+static RxQueueMsg msgs[CONFIG_SIPF_RX_QUEUE_CNT];
+static uint32_t q_head; // 次に$$RXで返すメッセージの通し番号
+static uint32_t q_tail; // 次に受信するメッセージの通し番号
+static uint8_t last_remains; // 最後に受信したときのREMAINS
+static K_MUTEX_DEFINE(q_lock);
+static K_MUTEX_DEFINE(fetch_lock); // 受信の順番を守るため、OBJECTS_DOWNは1つずつ実行する
+
+static SipfObjectOtid otid_hist[RX_QUEUE_OTID_HIST];
+static uint8_t otid_hist_idx;
+
+static int rx_queue_on_head(const SipfObjectDownHead *head, void *user_data)
+{
+    RxQueueMsg *msg = (RxQueueMsg *)user_data;
+    memcpy(&msg->head, head, sizeof(msg->head));
+    return 0;
+}
+
+static int rx_queue_on_object(const SipfObjectObject *obj, void *user_data)
+{
+    RxQueueMsg *msg = (RxQueueMsg *)user_data;
+    if (msg->len + 3 + obj->value_len > sizeof(msg->objs)) {
+        LOG_ERR("RxQueue: object buffer full");
+        return -ENOMEM;
+    }
+    msg->objs[msg->len++] = obj->obj_type;
+    msg->objs[msg->len++] = obj->obj_tagid;
+    msg->objs[msg->len++] = obj->value_len;
+    memcpy(&msg->objs[msg->len], obj->value, obj->value_len);
+    msg->len += obj->value_len;
+    return 0;
+}
+
+/**
+ * 最近受信したOTIDか(fetch_lockを取ってから呼ぶ)
+ */
+static bool rx_queue_is_dup(const SipfObjectOtid *otid)
+{
+    for (int i = 0; i < RX_QUEUE_OTID_HIST; i++) {
+        if (memcmp(&otid_hist[i], otid, sizeof(SipfObjectOtid)) == 0) {
+            return true;
+        }
+    }
+    memcpy(&otid_hist[otid_hist_idx], otid, sizeof(SipfObjectOtid));
+    otid_hist_idx = (otid_hist_idx + 1) % RX_QUEUE_OTID_HIST;
+    return false;
+}
+
+/**
+ * 先読みするか
+ */
+bool RxQueueIsEnabled(void)
+{
+    return (*REG_01_PREFETCH == 0x01) || (*REG_01_PREFETCH == 0x02);
+}
+
+/**
+ * 先読みしたら "+RX:<件数>" を通知するか
+ */
+bool RxQueueIsNotify(void)
+{
+    return *REG_01_PREFETCH == 0x02;
+}
+
+/**
+ * OBJECTS_DOWNを1回実行して、受信したメッセージをキューに入れる
+ * queued: キューに入れたらtrue(空だったときと重複していたときはfalse)
+ * 戻り値: REMAINS, 負 失敗した(-ENOSPC キューが一杯)
+ */
+int RxQueueFetch(bool *queued)
+{
+    *queued = false;
+
+    k_mutex_lock(&fetch_lock, K_FOREVER);
+    k_mutex_lock(&q_lock, K_FOREVER);
+    bool is_full = (q_tail - q_head) >= CONFIG_SIPF_RX_QUEUE_CNT;
+    k_mutex_unlock(&q_lock);
+    if (is_full) {
+        k_mutex_unlock(&fetch_lock);
+        return -ENOSPC;
+    }
+
+    // 末尾のメッセージはfetch_lockを取っている間は$$RXから見えない
+    RxQueueMsg *msg = &msgs[q_tail % CONFIG_SIPF_RX_QUEUE_CNT];
+    memset(&msg->head, 0, sizeof(msg->head));
+    msg->len = 0;
+    SipfObjectDownHandler handler = {.on_head = rx_queue_on_head, .on_object = rx_queue_on_object, .user_data = msg};
+
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    if (ctx == NULL) {
+        k_mutex_unlock(&fetch_lock);
+        return -ENOMEM;
+    }
+    int objqty = SipfObjClientObjDown(ctx, &handler);
+    SipfClientHttpCtxFree(ctx);
+    if (objqty < 0) {
+        LOG_ERR("RxQueue: SipfObjClientObjDown() failed: %d", objqty);
+        k_mutex_unlock(&fetch_lock);
+        return objqty;
+    }
+    if (objqty > OBJ_MAX_CNT) {
+        LOG_ERR("RxQueue: too many objects: %d", objqty);
+        k_mutex_unlock(&fetch_lock);
+        return -EBADMSG;
+    }
+
+    k_mutex_lock(&q_lock, K_FOREVER);
+    last_remains = msg->head.remains;
+    if (objqty == 0) {
+        // 空
+    } else if (rx_queue_is_dup(&msg->head.otid)) {
+        LOG_WRN("RxQueue: duplicated OTID, dropped");
+    } else {
+        msg->objqty = objqty;
+        q_tail++;
+        *queued = true;
+    }
+    int remains = last_remains;
+    k_mutex_unlock(&q_lock);
+    k_mutex_unlock(&fetch_lock);
+
+    LOG_INF("RxQueue: remains=%d, objqty=%d, depth=%d", remains, objqty, RxQueueDepth());
+    return remains;
+}
+
+/**
+ * 先頭のメッセージを取り出す($$RXとバイナリのRXで使う)
+ * 溜まっていなければその場で受信する(先読みのジョブとは順番を守る)
+ * [out]msg: 先頭のメッセージ(空ならNULL), RxQueuePop()するまで有効
+ * 戻り値: 0, 負 受信に失敗した
+ */
+int RxQueueHead(RxQueueMsg **msg)
+{
+    *msg = RxQueuePeek();
+    if (*msg != NULL) {
+        return 0;
+    }
+    // 重複したOTIDを捨てた場合はREMAINSが残っていれば次を受信する(空のOKを返さない)
+    for (int i = 0; i < RX_QUEUE_OTID_HIST; i++) {
+        bool queued;
+        int ret = RxQueueFetch(&queued);
+        if (ret < 0) {
+            LOG_ERR("RxQueueFetch():%d", ret);
+            return ret;
+        }
+        *msg = RxQueuePeek();
+        if ((*msg != NULL) || (ret == 0)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 先頭のメッセージ(空ならNULL)
+ * RxQueuePop()するまで有効
+ */
+RxQueueMsg *RxQueuePeek(void)
+{
+    RxQueueMsg *msg = NULL;
+    k_mutex_lock(&q_lock, K_FOREVER);
+    if (q_tail != q_head) {
+        msg = &msgs[q_head % CONFIG_SIPF_RX_QUEUE_CNT];
+    }
+    k_mutex_unlock(&q_lock);
+    return msg;
+}
+
+void RxQueuePop(void)
+{
+    k_mutex_lock(&q_lock, K_FOREVER);
+    if (q_tail != q_head) {
+        q_head++;
+    }
+    k_mutex_unlock(&q_lock);
+}
+
+/**
+ * 溜まっている件数
+ */
+int RxQueueDepth(void)
+{
+    k_mutex_lock(&q_lock, K_FOREVER);
+    int depth = q_tail - q_head;
+    k_mutex_unlock(&q_lock);
+    return depth;
+}
+
+/**
+ * 先頭のメッセージの後に残っている件数(キューに溜まっている分とサーバーに残っている分)
+ */
+int RxQueueRemains(void)
+{
+    k_mutex_lock(&q_lock, K_FOREVER);
+    int remains = last_remains;
+    if (q_tail != q_head) {
+        remains += q_tail - q_head - 1;
+    }
+    k_mutex_unlock(&q_lock);
+    return remains;
+}
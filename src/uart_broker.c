@@ -4,66 +4,366 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/uart.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/cbprintf.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/logging/log.h>
+#include <nrfx.h>
+
+LOG_MODULE_DECLARE(sipf);
 
 #include "uart_broker.h"
 
-#define PRIORITY (7)
-#define STACK_UB_SZ (1024)
+/* 受信DMAバッファ(ダブルバッファ) */
+#define UART_RX_DMA_BUF_SZ (128)
+#define UART_RX_DMA_BUF_CNT (2)
+/* 受信が途切れてからRX_RDYを通知するまでの時間[us] */
+#define UART_RX_TIMEOUT_US (500)
+
+/* 1回のuart_tx()で送る最大長 */
+#define UART_TX_DMA_MAX_SZ (UART_TX_BUF_SZ / 2)
+/* 呼び出し元のバッファを1回のuart_tx()で送る最大長 */
+#define UART_TX_REF_MAX_SZ (4096)
+/* 送信バッファに空きができるのを待つ時間[ms] */
+#define UART_TX_PUT_TIMEOUT_MS (100)
+/* これより短いデータはコピーして送る */
+#define UART_TX_ZC_MIN_SZ (32)
+/* 呼び出し元のバッファの送信が進まなくなってから取り消すまでの時間[ms](送信中の区間を送る時間は別に待つ) */
+#define UART_TX_REF_STALL_MS (1000)
+/* UartBrokerPrint()が1回に整形する最大長 */
+#define UART_PRINT_CHUNK_SZ (32)
 
-static uint8_t tx_buff[UART_TX_BUF_SZ];
-static uint8_t rx_buff[UART_RX_BUF_SZ];
+static const struct device *uart_dev;
 
-static bool is_echo = true;
-K_MUTEX_DEFINE(mutex_is_echo);
+RING_BUF_DECLARE(ring_tx, UART_TX_BUF_SZ);
+static struct k_spinlock lock_tx;
+static K_SEM_DEFINE(sem_tx, 0, 1);
+static bool tx_busy;
+
+/* 送信キュー(リングバッファの区間と呼び出し元のバッファを順番通りに並べる) */
+typedef struct
+{
+    const uint8_t *data; // NULLならリングバッファの区間
+    int len;
+    UartBrokerTxDoneCb cb;
+    void *user_data;
+    bool cancel; // 取り消された(送信中ならTX_ABORTEDで、まだなら順番が来たら捨てる)
+} UartBrokerTxDesc;
+static UartBrokerTxDesc tx_desc[UART_TX_DESC_CNT];
+static uint8_t tx_desc_head, tx_desc_cnt;
+static int tx_desc_off;      // 先頭ディスクリプタの送信済みバイト数
+static uint32_t tx_inflight; // uart_tx()に渡して送信中のバイト数
+static uint32_t tx_progress; // TX_DONEの回数(送信が進んでいるかを見る)
+static uint32_t tx_baudrate = 115200;
 
-static struct k_msgq msgq_tx, msgq_rx;
+static uint8_t rx_dma_buff[UART_RX_DMA_BUF_CNT][UART_RX_DMA_BUF_SZ];
+static uint8_t rx_dma_idx;
 
-K_THREAD_STACK_DEFINE(stack_ub, STACK_UB_SZ);
-static struct k_thread thread_ub;
-static k_tid_t tid_ub;
+RING_BUF_DECLARE(ring_rx, UART_RX_BUF_SZ);
+static struct k_spinlock lock_rx;
+static K_SEM_DEFINE(sem_rx, 0, 1);
+static atomic_t rx_dropped;
+static atomic_t rx_reconfig;
+static bool rx_flow_ctrl; // RTS/CTSのフロー制御が効いている
+// 受信リングバッファが一杯でDMAバッファを渡さずに受信を止めている(RTSが落ちて相手が送信を待つ)
+#define UART_RX_HOLD_NONE (0)
+#define UART_RX_HOLD_REQ (1)      // BUF_REQUESTに応えなかった(RX_DISABLEDを待っている)
+#define UART_RX_HOLD_DISABLED (2) // 受信が止まった(空きができたら再開する)
+static atomic_t rx_hold;
+static K_SEM_DEFINE(sem_rx_disabled, 0, 1);
 
-static void uart_broker_fifo_cb(const struct device *uart, void *user_data)
+static atomic_t is_echo = ATOMIC_INIT(1);
+static atomic_t echo_break = ATOMIC_INIT(-1);
+
+/**
+ * 送信キューの先頭から送信を開始する
+ * lock_txを取得した状態で呼ぶこと
+ */
+static void uart_broker_tx_kick(void)
 {
-    ARG_UNUSED(user_data);
+    const uint8_t *data;
+    uint32_t len;
 
-    if (uart_irq_update(uart) != 1) {
+    if (tx_busy) {
+        // 送信中ならTX_DONEで続きを送る
+        return;
+    }
+    while ((tx_desc_cnt > 0) && tx_desc[tx_desc_head].cancel) {
+        // 送る前に取り消された
+        tx_desc_off = 0;
+        tx_desc_head = (tx_desc_head + 1) % UART_TX_DESC_CNT;
+        tx_desc_cnt--;
+    }
+    if (tx_desc_cnt == 0) {
+        // 送るものがない
+        return;
+    }
+
+    UartBrokerTxDesc *d = &tx_desc[tx_desc_head];
+    if (d->data == NULL) {
+        // リングバッファの区間
+        uint8_t *p;
+        len = ring_buf_get_claim(&ring_tx, &p, MIN(d->len, UART_TX_DMA_MAX_SZ));
+        data = p;
+    } else {
+        // 呼び出し元のバッファをそのまま送る
+        data = &d->data[tx_desc_off];
+        len = MIN(d->len - tx_desc_off, UART_TX_REF_MAX_SZ);
+    }
+    if (len == 0) {
         return;
     }
+    if (uart_tx(uart_dev, data, len, SYS_FOREVER_US) == 0) {
+        tx_busy = true;
+        tx_inflight = len;
+    } else if (d->data == NULL) {
+        // 次の送信かTX_DONEか送信待ちの人がもう一度呼ぶ
+        ring_buf_get_finish(&ring_tx, 0);
+    }
+}
+
+/**
+ * 送信キューの末尾にディスクリプタを追加する
+ * lock_txを取得した状態で呼ぶこと
+ */
+static int uart_broker_tx_desc_push(const uint8_t *data, int len, UartBrokerTxDoneCb cb, void *user_data)
+{
+    if (tx_desc_cnt >= UART_TX_DESC_CNT) {
+        return -ENOMEM;
+    }
+    UartBrokerTxDesc *d = &tx_desc[(tx_desc_head + tx_desc_cnt) % UART_TX_DESC_CNT];
+    d->data = data;
+    d->len = len;
+    d->cb = cb;
+    d->user_data = user_data;
+    d->cancel = false;
+    tx_desc_cnt++;
+    return 0;
+}
+
+/**
+ * 送信キュー末尾のリングバッファの区間を返す(無ければ追加する)
+ * lock_txを取得した状態で呼ぶこと
+ */
+static UartBrokerTxDesc *uart_broker_tx_ring_tail(void)
+{
+    UartBrokerTxDesc *tail;
+
+    if (tx_desc_cnt > 0) {
+        tail = &tx_desc[(tx_desc_head + tx_desc_cnt - 1) % UART_TX_DESC_CNT];
+        if (tail->data == NULL) {
+            // 末尾がリングバッファの区間なら延長する
+            return tail;
+        }
+    }
+    if (uart_broker_tx_desc_push(NULL, 0, NULL, NULL) != 0) {
+        return NULL;
+    }
+    return &tx_desc[(tx_desc_head + tx_desc_cnt - 1) % UART_TX_DESC_CNT];
+}
+
+/**
+ * リングバッファに積んだlenバイトを末尾の区間に加える
+ * lock_txを取得した状態で呼ぶこと
+ */
+static void uart_broker_tx_ring_commit(UartBrokerTxDesc *tail, uint32_t len)
+{
+    tail->len += len;
+    if (tail->len == 0) {
+        // 空の区間は捨てる
+        tx_desc_cnt--;
+    }
+}
+
+/**
+ * 送信リングバッファに積めるだけ積む(待たない)
+ * return: 積めたバイト数
+ */
+static uint32_t uart_broker_tx_put(const uint8_t *data, uint32_t len)
+{
+    uint32_t put = 0;
+    k_spinlock_key_t key = k_spin_lock(&lock_tx);
+
+    UartBrokerTxDesc *tail = uart_broker_tx_ring_tail();
+    if (tail != NULL) {
+        put = ring_buf_put(&ring_tx, data, len);
+        uart_broker_tx_ring_commit(tail, put);
+    }
+    uart_broker_tx_kick();
+
+    k_spin_unlock(&lock_tx, key);
+    return put;
+}
 
-    if (uart_irq_rx_ready(uart) == 1) {
-        bool e;
-        uint8_t b;
-        uart_fifo_read(uart, &b, 1);
-        k_msgq_put(&msgq_rx, &b, K_NO_WAIT);
+static void uart_broker_tx_done(size_t len)
+{
+    UartBrokerTxDesc done = {0};
+
+    k_spinlock_key_t key = k_spin_lock(&lock_tx);
+    UartBrokerTxDesc *d = &tx_desc[tx_desc_head];
+    if (d->data == NULL) {
+        ring_buf_get_finish(&ring_tx, len);
+        d->len -= len;
+        if (d->len == 0) {
+            tx_desc_head = (tx_desc_head + 1) % UART_TX_DESC_CNT;
+            tx_desc_cnt--;
+        }
+    } else {
+        tx_desc_off += len;
+        if ((tx_desc_off >= d->len) || d->cancel) {
+            // 送り終わった(取り消された)ので呼び出し元に返す
+            done = *d;
+            tx_desc_off = 0;
+            tx_desc_head = (tx_desc_head + 1) % UART_TX_DESC_CNT;
+            tx_desc_cnt--;
+        }
+    }
+    tx_busy = false;
+    tx_inflight = 0;
+    tx_progress++;
+    uart_broker_tx_kick();
+    k_spin_unlock(&lock_tx, key);
+
+    if (done.cb != NULL) {
+        done.cb(done.data, done.len, done.user_data);
+    }
+
+    // 空きができたので待ってる人を起こす
+    k_sem_give(&sem_tx);
+}
+
+static int uart_broker_rx_start(const struct device *uart)
+{
+    rx_dma_idx = 1; // 次のBUF_REQUESTで渡すバッファ
+    return uart_rx_enable(uart, rx_dma_buff[0], UART_RX_DMA_BUF_SZ, UART_RX_TIMEOUT_US);
+}
+
+/**
+ * 受信中のDMAバッファと次に渡すDMAバッファの分だけ受信リングバッファに空きがあるか
+ */
+static bool uart_broker_rx_has_room(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock_rx);
+    uint32_t space = ring_buf_space_get(&ring_rx);
+    k_spin_unlock(&lock_rx, key);
+    return space >= (UART_RX_DMA_BUF_SZ * UART_RX_DMA_BUF_CNT);
+}
+
+/**
+ * 受信リングバッファから読み出したら呼ぶ
+ * 空きを待って止めていた受信を再開する
+ */
+static void uart_broker_rx_resume(void)
+{
+    if ((atomic_get(&rx_hold) != UART_RX_HOLD_DISABLED) || !uart_broker_rx_has_room()) {
+        return;
+    }
+    if (atomic_cas(&rx_hold, UART_RX_HOLD_DISABLED, UART_RX_HOLD_NONE)) {
+        int ret = uart_broker_rx_start(uart_dev);
+        if (ret != 0) {
+            LOG_ERR("uart_rx_enable() failed: %d", ret);
+        }
+    }
+}
+
+static void uart_broker_rx_rdy(const uint8_t *data, size_t len)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock_rx);
+    uint32_t put = ring_buf_put(&ring_rx, data, len);
+    k_spin_unlock(&lock_rx, key);
+
+    if (put < len) {
+        // 受信リングバッファが溢れた
+        atomic_add(&rx_dropped, len - put);
+    }
+    k_sem_give(&sem_rx);
+
+    if (atomic_get(&is_echo)) {
         // ECHO BACK
-        k_mutex_lock(&mutex_is_echo, K_FOREVER);
-        e = is_echo;
-        k_mutex_unlock(&mutex_is_echo);
-        if (e) {
-            uart_poll_out(uart, b); // ECHO BACK
+        int brk = atomic_get(&echo_break);
+        if (brk >= 0) {
+            // エコー停止バイトが来たらそこから先はエコーしない
+            const uint8_t *p = memchr(data, brk, len);
+            if (p != NULL) {
+                len = p - data;
+                atomic_set(&is_echo, 0);
+            }
         }
+        uart_broker_tx_put(data, len);
     }
 }
 
-static void uart_broker_thread(void *dev, void *arg2, void *arg3)
+static void uart_broker_async_cb(const struct device *uart, struct uart_event *evt, void *user_data)
 {
-    const struct device *uart = (struct device *)dev;
-    uint8_t b;
+    ARG_UNUSED(user_data);
 
-    uart_irq_callback_set(uart, uart_broker_fifo_cb);
-    uart_irq_rx_enable(uart);
+    switch (evt->type) {
+    case UART_TX_DONE:
+    case UART_TX_ABORTED:
+        // 送れた分だけ解放して続きを送る
+        uart_broker_tx_done(evt->data.tx.len);
+        break;
+    case UART_RX_RDY:
+        uart_broker_rx_rdy(&evt->data.rx.buf[evt->data.rx.offset], evt->data.rx.len);
+        break;
+    case UART_RX_BUF_REQUEST:
+        if (rx_flow_ctrl && !uart_broker_rx_has_room()) {
+            // 溢れそうなら次のDMAバッファを渡さずに受信を止める(RTSを落として相手を待たせる)
+            atomic_set(&rx_hold, UART_RX_HOLD_REQ);
+            break;
+        }
+        // 次のDMAバッファを渡す
+        uart_rx_buf_rsp(uart, rx_dma_buff[rx_dma_idx], UART_RX_DMA_BUF_SZ);
+        rx_dma_idx = (rx_dma_idx + 1) % UART_RX_DMA_BUF_CNT;
+        break;
+    case UART_RX_STOPPED:
+        LOG_WRN("UART RX stopped: reason=%d", evt->data.rx_stop.reason);
+        break;
+    case UART_RX_DISABLED:
+        if (atomic_get(&rx_reconfig)) {
+            // 設定変更のために止めた
+            k_sem_give(&sem_rx_disabled);
+            break;
+        }
+        if (atomic_cas(&rx_hold, UART_RX_HOLD_REQ, UART_RX_HOLD_DISABLED)) {
+            // 受信リングバッファが空くのを待つ(止めている間に読み出されていたらすぐ再開する)
+            uart_broker_rx_resume();
+            break;
+        }
+        // エラー等で受信が止まったら再開する
+        uart_broker_rx_start(uart);
+        break;
+    default:
+        break;
+    }
+}
 
+/**
+ * 受信バッファにデータが入るまで待つ
+ * deadline(k_uptime_get()基準)までに受信できなければ-EAGAINを返す
+ */
+static int uart_broker_wait_rx(int64_t deadline)
+{
     for (;;) {
-        // TX
-        while (k_msgq_get(&msgq_tx, &b, K_USEC(1)) == 0) {
-            // 送信キューになにか入ってた
-            uart_poll_out(uart, b);
+        k_spinlock_key_t key = k_spin_lock(&lock_rx);
+        bool empty = ring_buf_is_empty(&ring_rx);
+        k_spin_unlock(&lock_rx, key);
+        if (!empty) {
+            return 0;
+        }
+        int64_t remain = deadline - k_uptime_get();
+        if (remain < 0) {
+            return -EAGAIN;
+        }
+        if (k_sem_take(&sem_rx, K_MSEC(remain)) != 0) {
+            return -EAGAIN;
         }
     }
 }
@@ -71,71 +371,450 @@ static void uart_broker_thread(void *dev, void *arg2, void *arg3)
 /** Interface **/
 int UartBrokerPutByte(uint8_t byte)
 {
-    return k_msgq_put(&msgq_tx, &byte, K_MSEC(10));
+    if (UartBrokerPut(&byte, 1) != 1) {
+        return -EAGAIN;
+    }
+    return 0;
 }
 
+/**
+ * 送信リングバッファにまとめて積む
+ * 空きが無いときは送信が進むのを待つ
+ * return: 積めたバイト数
+ */
 int UartBrokerPut(uint8_t *data, int len)
 {
     int cnt = 0;
-    int ret;
-    for (int i = 0; i < len; i++) {
-        ret = UartBrokerPutByte(data[i]);
-        if (ret != 0) {
+    while (cnt < len) {
+        uint32_t put = uart_broker_tx_put(&data[cnt], len - cnt);
+        cnt += put;
+        if (cnt >= len) {
+            break;
+        }
+        if (k_is_in_isr()) {
+            // 割り込みからは待てない
+            break;
+        }
+        if ((put == 0) && (k_sem_take(&sem_tx, K_MSEC(UART_TX_PUT_TIMEOUT_MS)) != 0)) {
+            // 送信が進まない
             break;
         }
-        cnt++;
     }
     return cnt;
 }
 
+/**
+ * 呼び出し元のバッファをコピーせずに送信キューに積む
+ * 送信が終わるとcbが(割り込みコンテキストで)呼ばれるので、それまでdataを書き換えないこと
+ */
+int UartBrokerPutRef(const uint8_t *data, int len, UartBrokerTxDoneCb cb, void *user_data)
+{
+    int ret;
+
+    if (len <= 0) {
+        return -EINVAL;
+    }
+    for (;;) {
+        k_spinlock_key_t key = k_spin_lock(&lock_tx);
+        ret = uart_broker_tx_desc_push(data, len, cb, user_data);
+        if (ret == 0) {
+            uart_broker_tx_kick();
+        }
+        k_spin_unlock(&lock_tx, key);
+        if (ret == 0) {
+            return 0;
+        }
+        if (k_is_in_isr()) {
+            // 割り込みからは待てない
+            return ret;
+        }
+        // キューが空くのを待つ
+        if (k_sem_take(&sem_tx, K_MSEC(UART_TX_PUT_TIMEOUT_MS)) != 0) {
+            return -EAGAIN;
+        }
+    }
+}
+
+static void uart_broker_tx_sem_give(const uint8_t *data, int len, void *user_data)
+{
+    k_sem_give((struct k_sem *)user_data);
+}
+
+/**
+ * user_dataで積んだ呼び出し元のバッファの送信を取り消す
+ * lock_txを取得した状態で呼ぶこと
+ * return: 送信中なのでuart_tx_abort()が要る
+ */
+static bool uart_broker_tx_cancel(void *user_data)
+{
+    for (int i = 0; i < tx_desc_cnt; i++) {
+        UartBrokerTxDesc *d = &tx_desc[(tx_desc_head + i) % UART_TX_DESC_CNT];
+        if ((d->data == NULL) || (d->user_data != user_data)) {
+            continue;
+        }
+        d->cancel = true;
+        if ((i == 0) && tx_busy) {
+            // TX_ABORTEDで呼び出し元に返す
+            return true;
+        }
+        // まだ送っていないので呼び出し元には返さない
+        d->cb = NULL;
+        d->user_data = NULL;
+        break;
+    }
+    return false;
+}
+
+/**
+ * UartBrokerPutRef()でuser_dataにsemを渡して積んだバッファの送信が終わるのを待つ
+ * uart_tx()に失敗していたら送り直して、送信が進まなくなったら取り消す(フロー制御で相手が止めたままなど)
+ * return: 0 送り終わった, -ETIMEDOUT 取り消した(途中まで送ったかもしれない)
+ */
+int UartBrokerPutRefWait(struct k_sem *sem)
+{
+    uint32_t progress = UINT32_MAX;
+    int64_t stall_since = k_uptime_get();
+
+    for (;;) {
+        if (k_sem_take(sem, K_MSEC(UART_TX_PUT_TIMEOUT_MS)) == 0) {
+            return 0;
+        }
+
+        k_spinlock_key_t key = k_spin_lock(&lock_tx);
+        if (tx_progress != progress) {
+            progress = tx_progress;
+            stall_since = k_uptime_get();
+        }
+        // uart_tx()に失敗して止まっていたら送り直す
+        uart_broker_tx_kick();
+        // 送信中の区間を送り切る時間(10bit/Byte)は待つ
+        int64_t limit = UART_TX_REF_STALL_MS + ((int64_t)tx_inflight * 10 * 1000) / tx_baudrate;
+        if ((k_uptime_get() - stall_since) <= limit) {
+            k_spin_unlock(&lock_tx, key);
+            continue;
+        }
+        LOG_ERR("UART TX stalled, cancel.");
+        bool abort = uart_broker_tx_cancel(sem);
+        k_spin_unlock(&lock_tx, key);
+
+        if (abort) {
+            uart_tx_abort(uart_dev);
+            if (k_sem_take(sem, K_MSEC(UART_TX_PUT_TIMEOUT_MS)) != 0) {
+                // TX_ABORTEDが来ないので呼び出し元に返さないようにする
+                key = k_spin_lock(&lock_tx);
+                for (int i = 0; i < tx_desc_cnt; i++) {
+                    UartBrokerTxDesc *d = &tx_desc[(tx_desc_head + i) % UART_TX_DESC_CNT];
+                    if (d->user_data == sem) {
+                        d->cb = NULL;
+                        d->user_data = NULL;
+                    }
+                }
+                k_spin_unlock(&lock_tx, key);
+            }
+        } else {
+            // 取り消す前に送り終わっていたかもしれない
+            if (k_sem_take(sem, K_NO_WAIT) == 0) {
+                return 0;
+            }
+        }
+        return -ETIMEDOUT;
+    }
+}
+
+/**
+ * 呼び出し元のバッファをコピーせずに送信し、送り終わるまで待つ
+ * return: 送信したバイト数(送信が進まなくて取り消したら0)
+ */
+int UartBrokerPutZeroCopy(const uint8_t *data, int len)
+{
+    if ((len < UART_TX_ZC_MIN_SZ) || k_is_in_isr() || !nrfx_is_in_ram(data)) {
+        // 短いものはコピーした方が速い(RAMに無いものはEasyDMAで送れない)
+        return UartBrokerPut((uint8_t *)data, len);
+    }
+
+    struct k_sem sem_done;
+    k_sem_init(&sem_done, 0, 1);
+    if (UartBrokerPutRef(data, len, uart_broker_tx_sem_give, &sem_done) != 0) {
+        return 0;
+    }
+    // dataを参照しているので送り終わるか取り消すまで戻れない
+    if (UartBrokerPutRefWait(&sem_done) != 0) {
+        return 0;
+    }
+    return len;
+}
+
 int UartBrokerPuts(const char *msg)
 {
-    return UartBrokerPut((uint8_t *)msg, strlen(msg));
+    return UartBrokerPutZeroCopy((const uint8_t *)msg, strlen(msg));
+}
+
+/** 書式付き出力 **/
+typedef struct
+{
+    uint8_t chunk[UART_PRINT_CHUNK_SZ]; // 整形中のチャンク(スタック上)
+    int used;
+    int total;
+    bool err;
+} UartBrokerPrintCtx;
+
+/**
+ * 整形したチャンクを送信リングバッファにコピーして送信を開始する
+ * lock_txはコピーする間だけ取る(整形している間はエコーバックを止めない)
+ */
+static void uart_broker_print_flush(UartBrokerPrintCtx *pc)
+{
+    if (pc->used == 0) {
+        return;
+    }
+    int put = UartBrokerPut(pc->chunk, pc->used);
+    pc->total += put;
+    if (put < pc->used) {
+        // 送信が進まない
+        pc->err = true;
+    }
+    pc->used = 0;
+}
+
+static int uart_broker_print_out(int c, void *ctx)
+{
+    UartBrokerPrintCtx *pc = (UartBrokerPrintCtx *)ctx;
+
+    if (pc->err) {
+        return -EAGAIN;
+    }
+    pc->chunk[pc->used++] = (uint8_t)c;
+    if (pc->used >= sizeof(pc->chunk)) {
+        uart_broker_print_flush(pc);
+    }
+    return c;
+}
+
+/**
+ * 書式付き文字列をUART_PRINT_CHUNK_SZずつ整形して送信リングバッファに積む
+ * return: 積んだ文字数
+ */
+int UartBrokerPrint(const char *fmt, ...)
+{
+    UartBrokerPrintCtx pc;
+    va_list ap;
+
+    pc.used = 0;
+    pc.total = 0;
+    pc.err = false;
+    va_start(ap, fmt);
+    cbvprintf((cbprintf_cb)uart_broker_print_out, &pc, fmt, ap);
+    va_end(ap);
+    uart_broker_print_flush(&pc);
+
+    return pc.total;
 }
 
 int UartBrokerGetByte(uint8_t *byte)
 {
-    return k_msgq_get(&msgq_rx, byte, K_MSEC(1));
+    return UartBrokerGetByteTm(byte, 1);
 }
 
 int UartBrokerGetByteTm(uint8_t *byte, int timeout_ms)
 {
-    return k_msgq_get(&msgq_rx, byte, K_MSEC(timeout_ms));
+    int ret = uart_broker_wait_rx(k_uptime_get() + timeout_ms);
+    if (ret != 0) {
+        return ret;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock_rx);
+    ring_buf_get(&ring_rx, byte, 1);
+    k_spin_unlock(&lock_rx, key);
+    uart_broker_rx_resume();
+    return 0;
 }
 
 void UartBrokerClearRecveiveQueue(void)
 {
-    k_msgq_purge(&msgq_rx);
+    k_spinlock_key_t key = k_spin_lock(&lock_rx);
+    ring_buf_reset(&ring_rx);
+    k_spin_unlock(&lock_rx, key);
+    k_sem_reset(&sem_rx);
+    uart_broker_rx_resume();
 }
 
 int UartBrokerGet(uint8_t *data, int len)
+{
+    return UartBrokerGetTm(data, len, 1);
+}
+
+/**
+ * lenバイト受信するまで待って、受信バッファからまとめてコピーする
+ * [in]timeout_ms: 次のデータが来るまでの待ち時間(キャラ間タイムアウト)
+ * return: 受信できた長さ(タイムアウトしたらlenより短い)
+ */
+int UartBrokerGetTm(uint8_t *data, int len, int timeout_ms)
 {
     int cnt = 0;
-    int ret;
-    for (int i = 0; i < len; i++) {
-        ret = UartBrokerGetByte(&data[i]);
-        if (ret != 0) {
+    while (cnt < len) {
+        if (uart_broker_wait_rx(k_uptime_get() + timeout_ms) != 0) {
             break;
         }
-        cnt++;
+        k_spinlock_key_t key = k_spin_lock(&lock_rx);
+        cnt += ring_buf_get(&ring_rx, &data[cnt], len - cnt);
+        k_spin_unlock(&lock_rx, key);
+        uart_broker_rx_resume();
     }
     return cnt;
 }
 
+/**
+ * 受信バッファ内の連続領域を取得する(コピーしない)
+ * [out]data:   連続領域の先頭
+ * [in]len:     取得したい最大長
+ * [in]timeout_ms: 1Byteも無い場合の待ち時間
+ * return: 取得できた長さ(タイムアウトなら-EAGAIN)
+ * 読み終わったらUartBrokerGetFinish()で解放すること
+ */
+int UartBrokerGetClaim(uint8_t **data, int len, int timeout_ms)
+{
+    int ret = uart_broker_wait_rx(k_uptime_get() + timeout_ms);
+    if (ret != 0) {
+        return ret;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock_rx);
+    ret = ring_buf_get_claim(&ring_rx, data, len);
+    k_spin_unlock(&lock_rx, key);
+    return ret;
+}
+
+/**
+ * UartBrokerGetClaim()で取得した領域のうちlenバイトを解放する
+ */
+int UartBrokerGetFinish(int len)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock_rx);
+    int ret = ring_buf_get_finish(&ring_rx, len);
+    k_spin_unlock(&lock_rx, key);
+    uart_broker_rx_resume();
+    return ret;
+}
+
+#ifdef CONFIG_SIPF_XMODEM_RECV_BENCH
+/**
+ * RX_RDYと同じように受信バッファに積む(ベンチマーク用, エコーバックしない)
+ * return: 積んだバイト数
+ */
+int UartBrokerFeedRx(const uint8_t *data, int len)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock_rx);
+    uint32_t put = ring_buf_put(&ring_rx, data, len);
+    k_spin_unlock(&lock_rx, key);
+    k_sem_give(&sem_rx);
+    return put;
+}
+#endif
+
+/**
+ * 受信バッファが溢れて捨てたバイト数を返してクリアする
+ */
+int UartBrokerGetDropped(void)
+{
+    return (int)atomic_clear(&rx_dropped);
+}
+
 int UartBrokerInit(const struct device *uart)
 {
-    // 送受信キュー作成
-    k_msgq_init(&msgq_tx, tx_buff, 1, UART_TX_BUF_SZ);
-    k_msgq_init(&msgq_rx, rx_buff, 1, UART_RX_BUF_SZ);
+    int ret;
 
-    // スレッド作成
-    tid_ub = k_thread_create(&thread_ub, stack_ub, STACK_UB_SZ, uart_broker_thread, (void *)uart, NULL, NULL, PRIORITY, 0, K_NO_WAIT);
-    k_thread_name_set(tid_ub, "uart broker");
-    k_thread_start(&thread_ub);
+    uart_dev = uart;
+
+    struct uart_config cfg;
+    if (uart_config_get(uart, &cfg) == 0) {
+        rx_flow_ctrl = (cfg.flow_ctrl == UART_CFG_FLOW_CTRL_RTS_CTS);
+        tx_baudrate = cfg.baudrate;
+    }
+
+    // 受信開始
+    ret = uart_callback_set(uart, uart_broker_async_cb, NULL);
+    if (ret != 0) {
+        LOG_ERR("uart_callback_set() failed: %d", ret);
+        return ret;
+    }
+    ret = uart_broker_rx_start(uart);
+    if (ret != 0) {
+        LOG_ERR("uart_rx_enable() failed: %d", ret);
+        return ret;
+    }
 
     return 0;
 }
 
+/**
+ * 送信キューが空になるまで待つ
+ */
+int UartBrokerFlush(int timeout_ms)
+{
+    int64_t deadline = k_uptime_get() + timeout_ms;
+
+    for (;;) {
+        k_spinlock_key_t key = k_spin_lock(&lock_tx);
+        bool empty = (tx_desc_cnt == 0) && !tx_busy;
+        k_spin_unlock(&lock_tx, key);
+        if (empty) {
+            return 0;
+        }
+        int64_t remain = deadline - k_uptime_get();
+        if (remain < 0) {
+            return -EAGAIN;
+        }
+        k_sem_take(&sem_tx, K_MSEC(remain));
+    }
+}
+
+int UartBrokerGetConfig(struct uart_config *cfg)
+{
+    return uart_config_get(uart_dev, cfg);
+}
+
+/**
+ * UARTの設定(ボーレート、フロー制御)を変更する
+ * 送信キューを送り切ってから受信を止めて設定し直すので、キュー内のデータは失われない
+ */
+int UartBrokerSetConfig(const struct uart_config *cfg)
+{
+    int ret;
+
+    // 送信キューを送り切る
+    ret = UartBrokerFlush(1000);
+    if (ret != 0) {
+        LOG_ERR("UartBrokerFlush() failed: %d", ret);
+        return ret;
+    }
+
+    // 受信を止める(DMAバッファに残っている分はRX_RDYで受信リングバッファに入る)
+    atomic_set(&rx_reconfig, 1);
+    k_sem_reset(&sem_rx_disabled);
+    ret = uart_rx_disable(uart_dev);
+    if (ret == 0) {
+        k_sem_take(&sem_rx_disabled, K_MSEC(100));
+    }
+
+    ret = uart_configure(uart_dev, cfg);
+    if (ret != 0) {
+        LOG_ERR("uart_configure() failed: %d", ret);
+    } else {
+        rx_flow_ctrl = (cfg->flow_ctrl == UART_CFG_FLOW_CTRL_RTS_CTS);
+        tx_baudrate = cfg->baudrate;
+    }
+
+    // 受信を再開
+    atomic_set(&rx_reconfig, 0);
+    atomic_set(&rx_hold, UART_RX_HOLD_NONE);
+    int err = uart_broker_rx_start(uart_dev);
+    if (err != 0) {
+        LOG_ERR("uart_rx_enable() failed: %d", err);
+        return err;
+    }
+    return ret;
+}
+
 int UartBrokerTerm(void)
 {
     return 0;
@@ -143,8 +822,15 @@ int UartBrokerTerm(void)
 
 bool UartBrokerSetEcho(bool echo)
 {
-    k_mutex_lock(&mutex_is_echo, K_FOREVER);
-    is_echo = echo;
-    k_mutex_unlock(&mutex_is_echo);
+    atomic_set(&is_echo, echo ? 1 : 0);
     return echo;
 }
+
+/**
+ * 受信したらエコーバックを止めるバイトを設定する(-1で無効)
+ * 止めたエコーバックはUartBrokerSetEcho(true)で再開する
+ */
+void UartBrokerSetEchoBreak(int byte)
+{
+    atomic_set(&echo_break, byte);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "uart_broker.h"
+#include "uart_print_bench.h"
+
+/*
+ * UartBrokerPrint()と以前のマクロ(140Byteのスタックにsprintfしてから積む)の比較
+ *  それぞれ専用のスレッドで1行ずつ出力して、整形して積むまでのサイクル数とスタックの使用量を測る
+ *  UARTの送信待ちを含めないように、1行ごとに送信キューが空になるのを待ってから次を出す
+ */
+#define UART_PRINT_BENCH_CNT (16)
+#define UART_PRINT_BENCH_STACK_SZ (2048)
+#define UART_PRINT_BENCH_FMT "*** BENCH(Type%02x) v.%d.%d.%d ICCID:%s %d/%d ***\r\n"
+#define UART_PRINT_BENCH_ARGS 0x30, 1, 2, 3, "8981000000000000000", 123456, 654321
+
+// 以前のUartBrokerPrint()マクロ
+#define UART_PRINT_BENCH_LEGACY(...)                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                   \
+    {                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                  \
+        char msg[140];                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                 \
+        int len = sprintf(msg, __VA_ARGS__);                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                           \
+        UartBrokerPut((uint8_t *)msg, len);                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                            \
+    }
+
+K_THREAD_STACK_DEFINE(uart_print_bench_stack, UART_PRINT_BENCH_STACK_SZ);
+static struct k_thread uart_print_bench_thread;
+
+typedef enum { UART_PRINT_BENCH_NONE = 0, UART_PRINT_BENCH_LEGACY_MACRO, UART_PRINT_BENCH_STREAM } UartPrintBenchMode;
+
+static const char *const uart_print_bench_name[] = {"none", "legacy", "stream"};
+
+static void uart_print_bench_run(void *p1, void *p2, void *p3)
+{
+    UartPrintBenchMode mode = (UartPrintBenchMode)(uintptr_t)p1;
+    uint32_t *cycles = (uint32_t *)p2;
+
+    *cycles = 0;
+    for (int i = 0; i < UART_PRINT_BENCH_CNT; i++) {
+        uint32_t t0 = k_cycle_get_32();
+        if (mode == UART_PRINT_BENCH_LEGACY_MACRO) {
+            UART_PRINT_BENCH_LEGACY(UART_PRINT_BENCH_FMT, UART_PRINT_BENCH_ARGS);
+        } else if (mode == UART_PRINT_BENCH_STREAM) {
+            UartBrokerPrint(UART_PRINT_BENCH_FMT, UART_PRINT_BENCH_ARGS);
+        }
+        *cycles += k_cycle_get_32() - t0;
+        UartBrokerFlush(1000);
+    }
+}
+
+/**
+ * 1つの方法で測る
+ * [out]stack_used: スレッドのスタック使用量[Byte]
+ * return: 1行あたりのサイクル数
+ */
+static uint32_t uart_print_bench_measure(UartPrintBenchMode mode, size_t *stack_used)
+{
+    uint32_t cycles;
+    size_t unused = 0;
+
+    k_thread_create(&uart_print_bench_thread, uart_print_bench_stack, K_THREAD_STACK_SIZEOF(uart_print_bench_stack), uart_print_bench_run, (void *)(uintptr_t)mode, &cycles, NULL, K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+    k_thread_join(&uart_print_bench_thread, K_FOREVER);
+    (void)k_thread_stack_space_get(&uart_print_bench_thread, &unused);
+
+    *stack_used = K_THREAD_STACK_SIZEOF(uart_print_bench_stack) - unused;
+    return cycles / UART_PRINT_BENCH_CNT;
+}
+
+/**
+ * UartBrokerPrint()のベンチマーク(CONFIG_SIPF_UART_PRINT_BENCHのとき起動時に1回実行する)
+ * noneは何も出力しないスレッドで、スタック使用量の基準になる
+ */
+void UartPrintBench(void)
+{
+    for (UartPrintBenchMode mode = UART_PRINT_BENCH_NONE; mode <= UART_PRINT_BENCH_STREAM; mode++) {
+        size_t stack_used;
+        uint32_t cycles = uart_print_bench_measure(mode, &stack_used);
+        LOG_INF("UartPrintBench: %s: %u cycles (%u us), stack %u bytes", uart_print_bench_name[mode], cycles, k_cyc_to_us_floor32(cycles), (unsigned int)stack_used);
+    }
+}
@@ -3,25 +3,112 @@
  *
  * SPDX-License-Identifier: MIT
  */
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "xmodem.h"
 #include "uart_broker.h"
 
+#include <zephyr/sys/crc.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(sipf);
 
-// static uint8_t xmodem_block[132];
-
 #define XMODEM_BLOCK_BN(b) b[1]
 #define XMODEM_BLOCK_BNC(b) b[2]
 #define XMODEM_BLOCK_DATA_P(b) &b[3]
-#define XMODEM_BLOCK_SUM(b) b[131]
 
-static int xmodem_block_validation(uint8_t *block, uint8_t bn)
+#define XMODEM_CRC_REQ_MAX (3) // 'C'で最初のブロックを要求する回数(応答がなければチェックサムに切り替える)
+
+static bool recv_crc;     // CRC-16で受信する
+static bool recv_started; // 最初のブロックを受信した
+static int recv_req_cnt;  // 最初のブロックを要求した回数
+static bool recv_batch;   // YMODEMで受信する(最初にヘッダブロックが来る)
+static bool recv_stream;  // YMODEM-Gで受信する(ACKを返さない)
+static bool recv_header;  // YMODEMのヘッダブロックを受信した(次の'C'か'G'を送る)
+static bool send_crc;     // CRC-16(XMODEM-1K)で送信する
+static bool send_stream;  // YMODEM-Gで送信する(ACKを待たない)
+
+/**
+ * ブロックのチェックサムかCRC-16(BigEndian)を計算してdataの後ろに書く
+ * 戻り値: 書いた長さ
+ */
+static int xmodem_block_put_check(uint8_t *data, uint16_t sz_data, bool crc)
+{
+    if (crc) {
+        uint16_t c = crc16_itu_t(0x0000, data, sz_data);
+        data[sz_data] = c >> 8;
+        data[sz_data + 1] = c & 0xff;
+        return 2;
+    }
+    uint8_t s = 0;
+    for (int i = 0; i < sz_data; i++) {
+        s = s + data[i];
+    }
+    data[sz_data] = s;
+    return 1;
+}
+
+/**
+ * ブロックのデータを受信バッファからコピーしながらサムかCRC-16を計算する
+ * 受信バッファの連続領域ごとに1回だけ読む
+ * [out]check: 計算したサム(CRC-16)
+ * return: 0 成功, 負 キャラ間タイムアウト
+ */
+static int xmodem_recv_data(uint8_t *data, uint16_t sz_data, uint16_t *check)
 {
-    LOG_INF("latest bn: %02x, bn: %02x, bnc: %02x", bn, XMODEM_BLOCK_BN(block), XMODEM_BLOCK_BNC(block));
+    uint16_t c = 0;
+    uint8_t s = 0;
+    uint16_t cnt = 0;
+
+    while (cnt < sz_data) {
+        uint8_t *p;
+        int len = UartBrokerGetClaim(&p, sz_data - cnt, 100);
+        if (len < 0) {
+            return len;
+        }
+        memcpy(&data[cnt], p, len);
+        if (recv_crc) {
+            c = crc16_itu_t(c, p, len);
+        } else {
+            for (int i = 0; i < len; i++) {
+                s = s + p[i];
+            }
+        }
+        UartBrokerGetFinish(len);
+        cnt += len;
+    }
+    *check = recv_crc ? c : s;
+    return 0;
+}
+
+/**
+ * ブロックの残り(BN BNC DATA SUM/CRC)を受信する
+ * [out]check: 受信しながら計算したDATAのサム(CRC-16)
+ */
+static int xmodem_recv_rest(uint8_t *block, uint16_t sz_data, uint16_t *check)
+{
+    // BN BNC
+    if (UartBrokerGetTm(&block[1], 2, 100) != 2) {
+        return -EAGAIN;
+    }
+    // DATA
+    int ret = xmodem_recv_data(XMODEM_BLOCK_DATA_P(block), sz_data, check);
+    if (ret < 0) {
+        return ret;
+    }
+    // SUM/CRC
+    int sz_check = recv_crc ? 2 : 1;
+    if (UartBrokerGetTm(&block[3 + sz_data], sz_check, 100) != sz_check) {
+        return -EAGAIN;
+    }
+    return 0;
+}
+
+static int xmodem_block_validation(uint8_t *block, uint16_t sz_data, uint8_t bn, uint16_t check)
+{
+    LOG_DBG("latest bn: %02x, bn: %02x, bnc: %02x", bn, XMODEM_BLOCK_BN(block), XMODEM_BLOCK_BNC(block));
     // BNチェック
     if ((XMODEM_BLOCK_BN(block) + XMODEM_BLOCK_BNC(block)) != 0xff) {
         // BNとBNCが矛盾してる
@@ -39,18 +126,15 @@ static int xmodem_block_validation(uint8_t *block, uint8_t bn)
         return -1;
     }
 
-    // サムチェック
+    // サムチェック(CRC-16なら2Byte, BigEndian)
     uint8_t *d = XMODEM_BLOCK_DATA_P(block);
-    uint8_t s = 0;
-    for (int i = 0; i < 128; i++) {
-        s = s + d[i];
-    }
-    if (s == XMODEM_BLOCK_SUM(block)) {
+    uint16_t recv_check = recv_crc ? ((d[sz_data] << 8) | d[sz_data + 1]) : d[sz_data];
+    if (recv_check == check) {
         LOG_DBG("BN: %d", XMODEM_BLOCK_BN(block));
         return XMODEM_BLOCK_BN(block);
     } else {
         // サムが一致しない
-        LOG_ERR("SUM miss match. s=%02x sum=%02x", s, XMODEM_BLOCK_SUM(block));
+        LOG_ERR("%s miss match.", recv_crc ? "CRC" : "SUM");
         return -1;
     }
 }
@@ -80,6 +164,26 @@ static int xmodemSendNak(void)
     return 0;
 }
 
+static int xmodemSendCrcReq(void)
+{
+    // 'C'を送信(CRC-16で送ってほしい)
+    if (UartBrokerPutByte(0x43) != 0) {
+        // 失敗しちゃった
+        return -1;
+    }
+    return 0;
+}
+
+static int xmodemSendStreamReq(void)
+{
+    // 'G'を送信(YMODEM-Gで送ってほしい)
+    if (UartBrokerPutByte(0x47) != 0) {
+        // 失敗しちゃった
+        return -1;
+    }
+    return 0;
+}
+
 void XmodemBegin(void)
 {
     UartBrokerSetEcho(false);
@@ -96,7 +200,29 @@ void XmodemEnd(void)
  */
 int XmodemReceiveStart(void)
 {
-    return xmodemSendNak();
+    recv_crc = true;
+    recv_started = false;
+    recv_req_cnt = 1;
+    recv_batch = false;
+    recv_stream = false;
+    return xmodemSendCrcReq();
+}
+
+/**
+ * YMODEMで受信開始
+ * 最初にヘッダブロック(BN=0)が来るので、XmodemReceiveBlock()のbnは0xffで始める
+ * [in]stream: YMODEM-Gで受信する(UARTのフロー制御が効いているときだけ)
+ */
+int XmodemReceiveStartBatch(bool stream)
+{
+    recv_crc = true;
+    recv_started = false;
+    recv_req_cnt = 1;
+    recv_batch = true;
+    recv_stream = stream;
+    recv_header = false;
+    (void)UartBrokerGetDropped();
+    return stream ? xmodemSendStreamReq() : xmodemSendCrcReq();
 }
 
 /**
@@ -104,6 +230,22 @@ int XmodemReceiveStart(void)
  */
 int XmodemReceiveReqNextBlock(void)
 {
+    if (recv_stream) {
+        // YMODEM-GはACKを返さない(ヘッダブロックの後だけ'G'でデータを要求する)
+        if (recv_header) {
+            recv_header = false;
+            return xmodemSendStreamReq();
+        }
+        return 0;
+    }
+    if (recv_header) {
+        // YMODEMはヘッダブロックにACKを返してから'C'でデータを要求する
+        recv_header = false;
+        if (xmodemSendAck() != 0) {
+            return -1;
+        }
+        return xmodemSendCrcReq();
+    }
     return xmodemSendAck();
 }
 
@@ -112,17 +254,34 @@ int XmodemReceiveReqNextBlock(void)
  */
 int XmodemReceiveReqCurrentBlock(void)
 {
+    if (recv_stream) {
+        // YMODEM-Gは再送しない(始まる前だけ'G'を送り直す)
+        return recv_started ? -1 : xmodemSendStreamReq();
+    }
+    if (!recv_started && recv_batch) {
+        // YMODEMはCRC-16だけなので'C'を送り直す
+        return xmodemSendCrcReq();
+    }
+    if (!recv_started && recv_crc) {
+        // 最初のブロックが来なければ'C'に対応していないとみなしてチェックサムに切り替える
+        if (recv_req_cnt++ < XMODEM_CRC_REQ_MAX) {
+            return xmodemSendCrcReq();
+        }
+        LOG_INF("No response to 'C', fall back to checksum.");
+        recv_crc = false;
+    }
     return xmodemSendNak();
 }
 
 /**
  * ブロック受信
  * [in/out]bn:  受信済みブロックのBlock number
- * [out]block:  受信したブロック
+ * [out]block:  受信したブロック(XMODEM_SZ_BLOCK_BUFF以上)
+ * [out]sz_data:受信したブロックのデータ長(128か1024)
  * [in]time_out:受信タイムアウト
  * return:
  */
-XmodemRecvRet XmodemReceiveBlock(uint8_t *bn, uint8_t *block, int time_out)
+XmodemRecvRet XmodemReceiveBlock(uint8_t *bn, uint8_t *block, uint16_t *sz_data, int time_out)
 {
     uint8_t b;
     int ret;
@@ -130,18 +289,27 @@ XmodemRecvRet XmodemReceiveBlock(uint8_t *bn, uint8_t *block, int time_out)
     ret = UartBrokerGetByteTm(&b, time_out);
     if (ret == -EAGAIN) {
         LOG_INF("UartBrokerGetByteTm() timeout.");
+        if (recv_stream && recv_started) {
+            // YMODEM-Gは再送しないので転送全体をやめる
+            XmodemTransmitCancel();
+            return XMODEM_RECV_RET_TIMEOUT;
+        }
         return XMODEM_RECV_RET_RETRY;
     } else if (ret != 0) {
         LOG_ERR("UartBrokerGetByteTm() failed: %d", ret);
         return ret;
     }
 
-    uint8_t idx_block = 0;
-
     switch (b) {
     case 0x01: // SOH
         // ブロック開始
-        block[idx_block++] = 0x01;
+        block[0] = 0x01;
+        *sz_data = XMODEM_SZ_BLOCK;
+        break;
+    case 0x02: // STX
+        // 1024Byteのブロック開始
+        block[0] = 0x02;
+        *sz_data = XMODEM_SZ_BLOCK_1K;
         break;
     case 0x04: // EOT
         // 転送終了
@@ -157,26 +325,41 @@ XmodemRecvRet XmodemReceiveBlock(uint8_t *bn, uint8_t *block, int time_out)
     default:
         // 想定外のなにか
         LOG_ERR("Invalid HEADER: %02x", b);
+        if (recv_stream && recv_started) {
+            XmodemTransmitCancel();
+            return XMODEM_RECV_RET_FAILED;
+        }
         return XMODEM_RECV_RET_RETRY;
     }
 
-    // ブロックの残り131Byteを受信する
-    for (int i = 0; i < 131; i++) {
-        //キャラ間タイムアウト100[ms]で受信
-        ret = UartBrokerGetByteTm(&b, 100);
-        if (ret == 0) {
-            // 受信できた
-            block[idx_block++] = b;
-        } else {
-            // 失敗
-            LOG_HEXDUMP_ERR(block, 132, "block:");
-            LOG_ERR("%s(): Failed receive block: %d", __func__, ret);
-            return ret;
+    // ブロックの残りをキャラ間タイムアウト100[ms]でまとめて受信する
+    uint16_t check;
+    ret = xmodem_recv_rest(block, *sz_data, &check);
+    if (ret < 0) {
+        // 失敗
+        LOG_ERR("%s(): Failed receive block: %d", __func__, ret);
+        if (recv_stream) {
+            XmodemTransmitCancel();
         }
+        return ret;
     }
 
+    // 相手が送ってきたので、もう'C'かNAKかは切り替えない
+    recv_started = true;
+
     // ブロックの正当性チェック
-    int bn_recv = xmodem_block_validation(block, *bn);
+    int bn_recv = xmodem_block_validation(block, *sz_data, *bn, check);
+    if (recv_stream && (UartBrokerGetDropped() > 0)) {
+        // 受信バッファが溢れていたら途中が抜けている(フロー制御が効いていない)
+        LOG_ERR("UART RX overrun.");
+        bn_recv = -1;
+    }
+    if (recv_stream && (bn_recv < 0)) {
+        // YMODEM-Gは再送しないので転送全体をやめる
+        LOG_ERR("Stream aborted.");
+        XmodemTransmitCancel();
+        return XMODEM_RECV_RET_FAILED;
+    }
     if (bn_recv == -1) {
         // チェックサムとか間違ってたから再送要求
         return XMODEM_RECV_RET_RETRY;
@@ -187,9 +370,51 @@ XmodemRecvRet XmodemReceiveBlock(uint8_t *bn, uint8_t *block, int time_out)
 
     // ブロックが正しい
     *bn = bn_recv; // BNを更新
+    if (recv_batch && (bn_recv == 0)) {
+        recv_header = true;
+    }
     return XMODEM_RECV_RET_OK;
 }
 
+/**
+ * YMODEMのヘッダブロック(ファイル名 NUL ファイルサイズ(10進) ...)を読む
+ * [in]data:   ヘッダブロックのデータ
+ * [out]name:  ファイル名(dataの中を指す, 空なら最後のファイルの後の空ヘッダ)
+ * [out]size:  ファイルサイズ(なければ0)
+ */
+int XmodemParseHeader(uint8_t *data, uint16_t sz_data, char **name, uint32_t *size)
+{
+    uint16_t len = strnlen((char *)data, sz_data);
+    if (len >= sz_data) {
+        // NULがない
+        return -1;
+    }
+    *name = (char *)data;
+    *size = 0;
+    for (uint16_t i = len + 1; (i < sz_data) && (data[i] >= '0') && (data[i] <= '9'); i++) {
+        *size = *size * 10 + (data[i] - '0');
+    }
+    return 0;
+}
+
+/**
+ * YMODEMの最後の空ヘッダを受け取ってバッチを終える(失敗しても転送は済んでいる)
+ */
+int XmodemReceiveBatchEnd(uint8_t *block, int time_out)
+{
+    uint8_t bn = 0xff;
+    uint16_t sz_data;
+
+    if ((recv_stream ? xmodemSendStreamReq() : xmodemSendCrcReq()) != 0) {
+        return -1;
+    }
+    if (XmodemReceiveBlock(&bn, block, &sz_data, time_out) != XMODEM_RECV_RET_OK) {
+        return -1;
+    }
+    recv_header = false;
+    return xmodemSendAck();
+}
+
 /**
  * 転送をやめる
  */
@@ -215,6 +440,7 @@ XmodemSendRet XmodemSendWaitRequest(int time_out)
     int ret;
     uint8_t b;
 
+    send_stream = false;
     for (int i = 0; i < 10; i++) {
         ret = UartBrokerGetByteTm(&b, time_out / 10);
         // timeoutとか見る
@@ -228,6 +454,16 @@ XmodemSendRet XmodemSendWaitRequest(int time_out)
 
         switch (b) {
         case 0x15: // NAK(送信要求)
+            send_crc = false;
+            return XMODEM_SEND_RET_OK;
+            break;
+        case 0x43: // 'C'(CRC-16での送信要求)
+            send_crc = true;
+            return XMODEM_SEND_RET_OK;
+            break;
+        case 0x47: // 'G'(YMODEM-Gでの送信要求)
+            send_crc = true;
+            send_stream = true;
             return XMODEM_SEND_RET_OK;
             break;
         case 0x18: // CAN(キャンセル)
@@ -242,6 +478,87 @@ XmodemSendRet XmodemSendWaitRequest(int time_out)
     return XMODEM_SEND_RET_FAILED;
 }
 
+/**
+ * 送信するブロックのデータ長(XmodemSendWaitRequest()の後で有効)
+ */
+int XmodemSendBlockSize(void)
+{
+    return send_crc ? XMODEM_SZ_BLOCK_1K : XMODEM_SZ_BLOCK;
+}
+
+/**
+ * YMODEM-Gで送信するか(XmodemSendWaitRequest()の後で有効)
+ * そのときはデータの前にXmodemSendHeader()、最後にXmodemSendBatchEnd()を送る
+ */
+bool XmodemSendIsStream(void)
+{
+    return send_stream;
+}
+
+/**
+ * 'G'の要求を待つ
+ */
+static XmodemSendRet xmodem_send_wait_stream_req(int time_out)
+{
+    uint8_t b;
+    int ret = UartBrokerGetByteTm(&b, time_out);
+    if (ret == -EAGAIN) {
+        return XMODEM_SEND_RET_TIMEOUT;
+    } else if (ret < 0) {
+        return XMODEM_SEND_RET_FAILED;
+    }
+    if (b == 0x47) {
+        return XMODEM_SEND_RET_OK;
+    } else if (b == 0x18) { // CAN
+        return XMODEM_SEND_RET_CANCELED;
+    }
+    LOG_ERR("Invalid response: %02x", b);
+    return XMODEM_SEND_RET_FAILED;
+}
+
+/**
+ * YMODEM-Gのヘッダブロック(BN=0)を送って、データの要求('G')を待つ
+ * nameがNULLなら最後のファイルの後の空ヘッダ
+ */
+XmodemSendRet XmodemSendHeader(const char *name, uint32_t size, int time_out)
+{
+    uint8_t header[XMODEM_SZ_BLOCK];
+    uint8_t bn = 0;
+    int len = 0;
+
+    memset(header, 0, sizeof(header));
+    if (name != NULL) {
+        len = snprintf(header, sizeof(header) - 1, "%s", name) + 1;
+        if (len >= sizeof(header)) {
+            // ファイル名が長すぎる
+            return XMODEM_SEND_RET_FAILED;
+        }
+        snprintf(&header[len], sizeof(header) - len, "%u", size);
+    }
+    // ヘッダは空でも128Byte全部を送る(残りはNULで埋める)
+    XmodemSendRet xret = XmodemSendBlock(&bn, header, sizeof(header), time_out);
+    if (xret != XMODEM_SEND_RET_OK) {
+        return xret;
+    }
+    if (name == NULL) {
+        // 空ヘッダにはACKが返ってくるかもしれないが待たない
+        return XMODEM_SEND_RET_OK;
+    }
+    return xmodem_send_wait_stream_req(time_out);
+}
+
+/**
+ * YMODEM-Gのバッチを終える(XmodemSendEnd()の後で'G'を待って空ヘッダを送る)
+ */
+XmodemSendRet XmodemSendBatchEnd(int time_out)
+{
+    XmodemSendRet xret = xmodem_send_wait_stream_req(time_out);
+    if (xret != XMODEM_SEND_RET_OK) {
+        return xret;
+    }
+    return XmodemSendHeader(NULL, 0, time_out);
+}
+
 /**
  * 送信完了
  */
@@ -279,32 +596,43 @@ XmodemSendRet XmodemSendEnd(int time_out)
 XmodemSendRet XmodemSendBlock(uint8_t *bn, uint8_t *payload, int sz_payload, int time_out)
 {
     int ret;
-    static uint8_t block[132];
-
-    if (sz_payload > 128) {
+    static uint8_t block[XMODEM_SZ_BLOCK_BUFF];
+    uint16_t sz_data;
+
+    // 128Byteに収まれば短いブロックで送る
+    if (sz_payload <= XMODEM_SZ_BLOCK) {
+        sz_data = XMODEM_SZ_BLOCK;
+    } else if (send_crc && (sz_payload <= XMODEM_SZ_BLOCK_1K)) {
+        sz_data = XMODEM_SZ_BLOCK_1K;
+    } else {
         return XMODEM_SEND_RET_FAILED;
     }
 
-    memset(block, 0x1a, sizeof(block)); // 先にパディングのEOFで埋めておく
+    memset(&block[3], 0x1a, sz_data); // 先にパディングのEOFで埋めておく
 
-    block[0] = 0x01;                        // SOH
-    block[1] = *bn;                         // BN
-    block[2] = ~*bn;                        // BNC
-    memcpy(&block[3], payload, sz_payload); // DATA
-    block[131] = 0;                         // SUM
-    for (int i = 3; i < 131; i++) {
-        block[131] += block[i];
-    }
+    block[0] = (sz_data == XMODEM_SZ_BLOCK) ? 0x01 : 0x02; // SOH/STX
+    block[1] = *bn;                                        // BN
+    block[2] = ~*bn;                                       // BNC
+    memcpy(&block[3], payload, sz_payload);                // DATA
+    int sz_block = 3 + sz_data + xmodem_block_put_check(&block[3], sz_data, send_crc); // SUM/CRC
 
-    // LOG_HEXDUMP_INF(block, sizeof(block), "block:");
+    // LOG_HEXDUMP_INF(block, sz_block, "block:");
 
-    ret = UartBrokerPut(block, 132);
-    if (ret < 0) {
+    ret = UartBrokerPutZeroCopy(block, sz_block);
+    if (ret != sz_block) {
         return XMODEM_SEND_RET_FAILED;
     }
 
-    // 応答を待つ
     uint8_t b;
+    if (send_stream) {
+        // YMODEM-GはACKを待たずに次を送る(CANが来ていたらやめる)
+        if ((UartBrokerGetByteTm(&b, 0) == 0) && (b == 0x18)) {
+            return XMODEM_SEND_RET_CANCELED;
+        }
+        return XMODEM_SEND_RET_OK;
+    }
+
+    // 応答を待つ
     ret = UartBrokerGetByteTm(&b, time_out);
     if (ret == -EAGAIN) {
         return XMODEM_SEND_RET_TIMEOUT;
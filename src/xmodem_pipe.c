@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "xmodem_pipe.h"
+
+K_THREAD_STACK_DEFINE(xmodem_pipe_stack, XMODEM_PIPE_STACK_SZ);
+static struct k_thread xmodem_pipe_thread;
+
+K_MEM_SLAB_DEFINE_STATIC(xmodem_pipe_slab, sizeof(XmodemPipeBlock), XMODEM_PIPE_BLOCK_CNT, 4);
+// 受信したブロック(NULLで終わり)
+K_MSGQ_DEFINE(xmodem_pipe_msgq, sizeof(XmodemPipeBlock *), XMODEM_PIPE_BLOCK_CNT + 1, 4);
+
+static atomic_t pipe_abort;
+static int pipe_result; // 受信スレッドの結果(0: 完了, -ECANCELED: 送信側がやめた, 負: 失敗)
+
+/**
+ * 空いたブロックを確保する(やめるときはNULL)
+ */
+static XmodemPipeBlock *xmodem_pipe_alloc(void)
+{
+    XmodemPipeBlock *blk;
+    while (k_mem_slab_alloc(&xmodem_pipe_slab, (void **)&blk, K_MSEC(100)) != 0) {
+        if (atomic_get(&pipe_abort)) {
+            return NULL;
+        }
+    }
+    return blk;
+}
+
+/**
+ * 受信スレッド
+ * ブロックを受信できたら、次のブロックを置く場所が空いてからACKを返す
+ */
+static void xmodem_pipe_recv(void *p1, void *p2, void *p3)
+{
+    uint8_t bn = (uint8_t)(uintptr_t)p1;
+    bool is_batch = (bool)(uintptr_t)p2;
+    bool req_next = true; // true: ACK, false: NAK
+    int cnt_retry = 0;
+    XmodemPipeBlock *blk = NULL;
+
+    for (;;) {
+        if (blk == NULL) {
+            blk = xmodem_pipe_alloc();
+        }
+        if ((blk == NULL) || atomic_get(&pipe_abort)) {
+            // 送信側がやめた
+            XmodemTransmitCancel();
+            pipe_result = -ECANCELED;
+            break;
+        }
+
+        if (req_next) {
+            XmodemReceiveReqNextBlock();
+        } else {
+            XmodemReceiveReqCurrentBlock();
+        }
+        XmodemRecvRet xret = XmodemReceiveBlock(&bn, blk->block, &blk->sz_data, 1000);
+        if (xret == XMODEM_RECV_RET_OK) {
+            (void)k_msgq_put(&xmodem_pipe_msgq, &blk, K_FOREVER);
+            blk = NULL;
+            cnt_retry = 0;
+            req_next = true;
+        } else if (xret == XMODEM_RECV_RET_DUP) {
+            // 前のブロックのACKが届かなかったのでもう一度返す
+            req_next = true;
+        } else if (xret == XMODEM_RECV_RET_FINISHED) {
+            LOG_INF("XmodemReceiveBlock() finished.");
+            if (is_batch) {
+                // YMODEM: 最後の空ヘッダを受け取る
+                (void)XmodemReceiveBatchEnd(blk->block, 1000);
+            }
+            pipe_result = 0;
+            break;
+        } else if (xret == XMODEM_RECV_RET_RETRY) {
+            if (cnt_retry++ > 10) {
+                LOG_ERR("XmodemReceiveBlock() retry over.");
+                XmodemTransmitCancel();
+                pipe_result = -ETIMEDOUT;
+                break;
+            }
+            LOG_INF("XmodemReceiveBlock() retry.");
+            // 再送要求
+            req_next = false;
+        } else if (xret == XMODEM_RECV_RET_CANCELED) {
+            LOG_INF("XmodemReceiveBlock() canceled.");
+            pipe_result = 0;
+            break;
+        } else {
+            // YMODEM-Gでエラーがあったら転送全体をやめる
+            LOG_ERR("XmodemReceiveBlock() failed: %d", xret);
+            pipe_result = -EIO;
+            break;
+        }
+    }
+
+    if (blk != NULL) {
+        k_mem_slab_free(&xmodem_pipe_slab, (void **)&blk);
+    }
+    // 終わりを知らせる
+    blk = NULL;
+    (void)k_msgq_put(&xmodem_pipe_msgq, &blk, K_FOREVER);
+}
+
+/**
+ * パイプラインを開始する
+ * [in]block:     受信済みでまだACKを返していない最初のブロック
+ * [in]sz_data:   最初のブロックのデータ長
+ * [in]bn:        最初のブロックのBlock number
+ * [in]is_batch:  YMODEM(ヘッダブロック付き)で受信している
+ */
+int XmodemPipeStart(const uint8_t *block, uint16_t sz_data, uint8_t bn, bool is_batch)
+{
+    XmodemPipeBlock *blk;
+
+    k_msgq_purge(&xmodem_pipe_msgq);
+    atomic_set(&pipe_abort, 0);
+    pipe_result = 0;
+
+    if (k_mem_slab_alloc(&xmodem_pipe_slab, (void **)&blk, K_NO_WAIT) != 0) {
+        LOG_ERR("XmodemPipe: no free block");
+        return -ENOMEM;
+    }
+    blk->sz_data = sz_data;
+    memcpy(blk->block, block, 3 + sz_data);
+    (void)k_msgq_put(&xmodem_pipe_msgq, &blk, K_NO_WAIT);
+
+    k_thread_create(&xmodem_pipe_thread, xmodem_pipe_stack, K_THREAD_STACK_SIZEOF(xmodem_pipe_stack), xmodem_pipe_recv, (void *)(uintptr_t)bn, (void *)(uintptr_t)is_batch, NULL, XMODEM_PIPE_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&xmodem_pipe_thread, "xmodem_pipe");
+    return 0;
+}
+
+/**
+ * 受信したブロックを順番に取り出す(受信が終わったらNULL)
+ */
+XmodemPipeBlock *XmodemPipeGet(void)
+{
+    XmodemPipeBlock *blk = NULL;
+    (void)k_msgq_get(&xmodem_pipe_msgq, &blk, K_FOREVER);
+    return blk;
+}
+
+void XmodemPipeFree(XmodemPipeBlock *blk)
+{
+    if (blk != NULL) {
+        k_mem_slab_free(&xmodem_pipe_slab, (void **)&blk);
+    }
+}
+
+/**
+ * パイプラインを止める(受信中ならCANを送ってやめる)
+ * 戻り値: 受信スレッドの結果
+ */
+int XmodemPipeStop(void)
+{
+    XmodemPipeBlock *blk;
+
+    atomic_set(&pipe_abort, 1);
+    k_thread_join(&xmodem_pipe_thread, K_FOREVER);
+    // 取り出されなかったブロックを返す
+    while (k_msgq_get(&xmodem_pipe_msgq, &blk, K_NO_WAIT) == 0) {
+        XmodemPipeFree(blk);
+    }
+    return pipe_result;
+}
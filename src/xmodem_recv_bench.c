@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_DECLARE(sipf);
+
+#include "uart_broker.h"
+#include "xmodem.h"
+#include "xmodem_recv_bench.h"
+
+/*
+ * XMODEM-1Kのブロック受信(STXの後ろのBN BNC DATA(1024) CRC(2) = 1028Byte)の比較
+ *  claim: xmodem_recv_rest()と同じくGetClaim/GetFinishで受信バッファから直接コピーしながらCRCを計算する
+ *  legacy: 以前の実装と同じく1ByteずつUartBrokerGetByteTm()で受信して、最後にCRCを計算する
+ *  受信バッファ(1024Byte)に1ブロックは入らないので、RX_RDYと同じ128Byteずつ積んでは読む
+ *  積む時間は含めずに、読む(とCRCを計算する)時間だけを測る
+ */
+#define XMODEM_RECV_BENCH_CNT (8)
+#define XMODEM_RECV_BENCH_DATA_SZ (XMODEM_SZ_BLOCK_1K)
+#define XMODEM_RECV_BENCH_SZ (2 + XMODEM_RECV_BENCH_DATA_SZ + 2)
+#define XMODEM_RECV_BENCH_CHUNK_SZ (128)
+
+typedef enum { XMODEM_RECV_BENCH_LEGACY = 0, XMODEM_RECV_BENCH_CLAIM } XmodemRecvBenchMode;
+
+static const char *const xmodem_recv_bench_name[] = {"legacy", "claim"};
+
+static uint8_t bench_src[XMODEM_RECV_BENCH_SZ];
+static uint8_t bench_block[XMODEM_RECV_BENCH_SZ];
+
+/**
+ * 以前の実装: [pos, pos+len)を1Byteずつ受信する
+ */
+static int xmodem_recv_bench_legacy(int pos, int len)
+{
+    for (int i = 0; i < len; i++) {
+        if (UartBrokerGetByteTm(&bench_block[pos + i], 100) != 0) {
+            return -EAGAIN;
+        }
+    }
+    return 0;
+}
+
+/**
+ * xmodem_recv_rest()と同じ: BN BNCとCRCはまとめて、DATAは連続領域ごとにコピーしながらCRCを計算する
+ */
+static int xmodem_recv_bench_claim(int pos, int len, uint16_t *crc)
+{
+    int end = pos + len;
+    while (pos < end) {
+        if ((pos < 2) || (pos >= 2 + XMODEM_RECV_BENCH_DATA_SZ)) {
+            // BN BNC, CRC
+            int n = (pos < 2) ? MIN(2 - pos, end - pos) : (end - pos);
+            if (UartBrokerGetTm(&bench_block[pos], n, 100) != n) {
+                return -EAGAIN;
+            }
+            pos += n;
+            continue;
+        }
+        uint8_t *p;
+        int n = UartBrokerGetClaim(&p, MIN(end, 2 + XMODEM_RECV_BENCH_DATA_SZ) - pos, 100);
+        if (n < 0) {
+            return n;
+        }
+        memcpy(&bench_block[pos], p, n);
+        *crc = crc16_itu_t(*crc, p, n);
+        UartBrokerGetFinish(n);
+        pos += n;
+    }
+    return 0;
+}
+
+/**
+ * 1ブロック受信する
+ * [out]crc: 受信したDATAのCRC-16
+ * return: 読むのにかかったサイクル数, 0 失敗
+ */
+static uint32_t xmodem_recv_bench_block(XmodemRecvBenchMode mode, uint16_t *crc)
+{
+    uint32_t cycles = 0;
+
+    *crc = 0;
+    for (int pos = 0; pos < XMODEM_RECV_BENCH_SZ; pos += XMODEM_RECV_BENCH_CHUNK_SZ) {
+        int len = MIN(XMODEM_RECV_BENCH_CHUNK_SZ, XMODEM_RECV_BENCH_SZ - pos);
+        UartBrokerFeedRx(&bench_src[pos], len);
+
+        uint32_t t0 = k_cycle_get_32();
+        int ret = (mode == XMODEM_RECV_BENCH_LEGACY) ? xmodem_recv_bench_legacy(pos, len) : xmodem_recv_bench_claim(pos, len, crc);
+        cycles += k_cycle_get_32() - t0;
+        if (ret < 0) {
+            return 0;
+        }
+    }
+    if (mode == XMODEM_RECV_BENCH_LEGACY) {
+        // 以前はブロックを受信してからCRCを計算していた
+        uint32_t t0 = k_cycle_get_32();
+        *crc = crc16_itu_t(0x0000, &bench_block[2], XMODEM_RECV_BENCH_DATA_SZ);
+        cycles += k_cycle_get_32() - t0;
+    }
+    return cycles;
+}
+
+/**
+ * XMODEMのブロック受信のベンチマーク(CONFIG_SIPF_XMODEM_RECV_BENCHのとき起動時に1回実行する)
+ */
+void XmodemRecvBench(void)
+{
+    bench_src[0] = 0x01;
+    bench_src[1] = 0xfe;
+    for (int i = 0; i < XMODEM_RECV_BENCH_DATA_SZ; i++) {
+        bench_src[2 + i] = (uint8_t)(i * 37 + 11);
+    }
+    uint16_t expected = crc16_itu_t(0x0000, &bench_src[2], XMODEM_RECV_BENCH_DATA_SZ);
+    bench_src[2 + XMODEM_RECV_BENCH_DATA_SZ] = expected >> 8;
+    bench_src[2 + XMODEM_RECV_BENCH_DATA_SZ + 1] = expected & 0xff;
+
+    // 積んだデータはエコーバックしないが、ホストから来たデータは捨てておく
+    UartBrokerClearRecveiveQueue();
+    for (XmodemRecvBenchMode mode = XMODEM_RECV_BENCH_LEGACY; mode <= XMODEM_RECV_BENCH_CLAIM; mode++) {
+        uint32_t total = 0;
+        for (int i = 0; i < XMODEM_RECV_BENCH_CNT; i++) {
+            uint16_t crc;
+            memset(bench_block, 0, sizeof(bench_block));
+            uint32_t cycles = xmodem_recv_bench_block(mode, &crc);
+            if ((cycles == 0) || (crc != expected) || (memcmp(bench_block, bench_src, sizeof(bench_block)) != 0)) {
+                LOG_ERR("XmodemRecvBench: %s: failed", xmodem_recv_bench_name[mode]);
+                UartBrokerClearRecveiveQueue();
+                return;
+            }
+            total += cycles;
+        }
+        uint32_t cycles = total / XMODEM_RECV_BENCH_CNT;
+        LOG_INF("XmodemRecvBench: %s: %u cycles (%u us) per %d bytes", xmodem_recv_bench_name[mode], cycles, k_cyc_to_us_floor32(cycles), XMODEM_RECV_BENCH_SZ);
+    }
+    UartBrokerClearRecveiveQueue();
+}
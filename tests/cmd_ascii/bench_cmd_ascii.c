@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cmd_ascii_table.h"
+#include "cmd_ascii_names.h"
+
+/*
+ * コマンド名の検索を、以前の実装(登録順にstrlen+memcmpで前方一致を探す)とハッシュテーブルで比べる
+ *  入力はコマンド行(名前 + パラメータ)で、登録された全てのコマンドと未定義のコマンドを順に引く
+ */
+#define BENCH_REPEAT (200000)
+
+static CmdAsciiCmd cmds[CMD_ASCII_NAMES_CNT];
+
+static const char *const lines[] = {
+    "W 01 00", "R 01", "$TX 01 04 01 00000001", "$RX", "$TXRAW 0104010000001", "$OUTBOX", "$FPUT test.txt 00000010", "$FGET test.txt", "$UNLOCK UNLOCK", "$UPDATE VERSION", "$BAUD 115200", "$GNSSEN 1", "$GNSSSTAT", "$GNSSLOC", "$GNSSNMEA", "$UNKNOWN",
+};
+#define LINES_CNT ((int)(sizeof(lines) / sizeof(lines[0])))
+
+static uint16_t line_len[LINES_CNT];
+
+/* 以前のCmdAsciiParse()の検索 */
+static const CmdAsciiCmd *legacy_lookup(const uint8_t *in_buff, uint16_t in_len)
+{
+    for (int idx = 0; idx < CMD_ASCII_NAMES_CNT; idx++) {
+        int len = strlen(cmds[idx].cmd_name);
+        if (memcmp(in_buff, cmds[idx].cmd_name, len) == 0) {
+            if ((in_len == len) || (in_buff[len] == ' ')) {
+                return &cmds[idx];
+            }
+        }
+    }
+    return NULL;
+}
+
+static const CmdAsciiCmd *table_lookup(const uint8_t *in_buff, uint16_t in_len)
+{
+    // (CmdAsciiParse()と同じく名前を切り出してから引く)
+    uint16_t len = 0;
+    while ((len < in_len) && (in_buff[len] != ' ')) {
+        len++;
+    }
+    return CmdAsciiTableLookup(in_buff, len);
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * 全ての行をBENCH_REPEAT回引いて1回あたりの時間[ns]を返す
+ */
+static double bench(const char *name, const CmdAsciiCmd *(*lookup)(const uint8_t *, uint16_t))
+{
+    uintptr_t sum = 0;
+    double t0 = now_us();
+    for (int i = 0; i < BENCH_REPEAT; i++) {
+        for (int j = 0; j < LINES_CNT; j++) {
+            sum += (uintptr_t)lookup((const uint8_t *)lines[j], line_len[j]);
+        }
+    }
+    double ns = (now_us() - t0) * 1e3 / ((double)BENCH_REPEAT * LINES_CNT);
+    printf("%-12s %6.1f ns/lookup (%lx)\n", name, ns, (unsigned long)(sum & 0xff));
+    return ns;
+}
+
+int main(void)
+{
+    CmdAsciiTableClear();
+    for (int i = 0; i < CMD_ASCII_NAMES_CNT; i++) {
+        cmds[i].cmd_name = cmd_ascii_names[i];
+        CmdAsciiTableAdd(&cmds[i]);
+    }
+    for (int j = 0; j < LINES_CNT; j++) {
+        line_len[j] = strlen(lines[j]);
+        // 同じコマンドが見つかる
+        if (legacy_lookup((const uint8_t *)lines[j], line_len[j]) != table_lookup((const uint8_t *)lines[j], line_len[j])) {
+            printf("lookup mismatch: %s\n", lines[j]);
+            return 1;
+        }
+    }
+    printf("%d commands, %d lines\n", CMD_ASCII_NAMES_CNT, LINES_CNT);
+
+    double ns_old = bench("linear", legacy_lookup);
+    double ns_new = bench("hash", table_lookup);
+    printf("hash x%.1f\n", ns_old / ns_new);
+    return 0;
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef CMD_ASCII_NAMES_H
+#define CMD_ASCII_NAMES_H
+
+#include "cmd_ascii.h"
+
+/* ファームウェアでCMD_ASCII_DEFINE()しているコマンド(src/cmd_ascii.c, src/gnss/gnss_cmd.c) */
+static const char *const cmd_ascii_names[] = {
+    CMD_REG_W, CMD_REG_R, CMD_TX, CMD_RX, CMD_TXRAW, CMD_OUTBOX, CMD_FPUT, CMD_FGET, CMD_UNLOCK, CMD_UPDATE, CMD_BAUD, CMD_TLSSTAT, CMD_GNSS_ENABLE, CMD_GNSS_GET_STATUS, CMD_GNSS_GET_LOCATION, CMD_GNSS_GET_NMEA,
+};
+#define CMD_ASCII_NAMES_CNT ((int)(sizeof(cmd_ascii_names) / sizeof(cmd_ascii_names[0])))
+
+#endif
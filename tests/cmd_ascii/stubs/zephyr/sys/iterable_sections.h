@@ -0,0 +1,12 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef SIPF_TEST_STUB_ITERABLE_SECTIONS_H
+#define SIPF_TEST_STUB_ITERABLE_SECTIONS_H
+
+// ホストではセクションに置かずに普通の変数にする
+#define STRUCT_SECTION_ITERABLE(struct_type, varname) struct_type varname
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cmd_ascii_table.h"
+#include "cmd_ascii_names.h"
+
+static int failed;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failed++; \
+        } \
+    } while (0)
+
+static CmdAsciiCmd cmds[CMD_ASCII_NAMES_CNT];
+
+static const CmdAsciiCmd *lookup(const char *name)
+{
+    return CmdAsciiTableLookup((const uint8_t *)name, strlen(name));
+}
+
+/**
+ * CmdAsciiInit()と同じように登録されたコマンドを全て載せる
+ */
+static void table_init(void)
+{
+    CmdAsciiTableClear();
+    for (int i = 0; i < CMD_ASCII_NAMES_CNT; i++) {
+        cmds[i].cmd_name = cmd_ascii_names[i];
+        CHECK(CmdAsciiTableAdd(&cmds[i]) == 0);
+    }
+}
+
+/**
+ * 全てのコマンドが1回ずつ載っていて、それぞれの名前で見つかる
+ */
+static void test_table_no_dup_no_missing(void)
+{
+    int seen[CMD_ASCII_NAMES_CNT] = {0};
+    int used = 0;
+
+    table_init();
+    for (int idx = 0; idx < CMD_ASCII_HASH_SZ; idx++) {
+        const CmdAsciiCmd *cmd = CmdAsciiTableSlot(idx);
+        if (cmd == NULL) {
+            continue;
+        }
+        used++;
+        CHECK((cmd >= &cmds[0]) && (cmd < &cmds[CMD_ASCII_NAMES_CNT]));
+        seen[cmd - cmds]++;
+    }
+    CHECK(used == CMD_ASCII_NAMES_CNT);
+    for (int i = 0; i < CMD_ASCII_NAMES_CNT; i++) {
+        CHECK(seen[i] == 1);
+        CHECK(lookup(cmd_ascii_names[i]) == &cmds[i]);
+    }
+}
+
+/**
+ * 名前が完全に一致しなければ見つからない($TXと$TXRAWの前方一致など)
+ */
+static void test_lookup_exact(void)
+{
+    const char *unknown[] = {"", "$", "$T", "$TXR", "$TXRA", "$TXRAWX", "$tx", "WR", "$GNSS", "$GNSSNMEAX", " $TX"};
+
+    table_init();
+    for (size_t i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++) {
+        CHECK(lookup(unknown[i]) == NULL);
+    }
+    // 行の続きは長さで切る
+    CHECK(CmdAsciiTableLookup((const uint8_t *)"$TXRAW 0102", 3) == lookup(CMD_TX));
+    CHECK(CmdAsciiTableLookup((const uint8_t *)"$TXRAW 0102", 6) == lookup(CMD_TXRAW));
+}
+
+/**
+ * 同じ名前は-EEXISTで載せない
+ */
+static void test_add_duplicate(void)
+{
+    CmdAsciiCmd dup = {.cmd_name = CMD_RX};
+
+    table_init();
+    CHECK(CmdAsciiTableAdd(&dup) == -EEXIST);
+    CHECK(lookup(CMD_RX) == &cmds[3]);
+}
+
+/**
+ * 一杯になったら-ENOSPC、一杯でも見つからない名前の検索は終わる
+ */
+static void test_table_full(void)
+{
+    static CmdAsciiCmd extra[CMD_ASCII_HASH_SZ + 1];
+    static char names[CMD_ASCII_HASH_SZ + 1][8];
+
+    CmdAsciiTableClear();
+    for (int i = 0; i < CMD_ASCII_HASH_SZ; i++) {
+        snprintf(names[i], sizeof(names[i]), "$C%02d", i);
+        extra[i].cmd_name = names[i];
+        CHECK(CmdAsciiTableAdd(&extra[i]) == 0);
+    }
+    snprintf(names[CMD_ASCII_HASH_SZ], sizeof(names[0]), "$FULL");
+    extra[CMD_ASCII_HASH_SZ].cmd_name = names[CMD_ASCII_HASH_SZ];
+    CHECK(CmdAsciiTableAdd(&extra[CMD_ASCII_HASH_SZ]) == -ENOSPC);
+    CHECK(lookup("$FULL") == NULL);
+    for (int i = 0; i < CMD_ASCII_HASH_SZ; i++) {
+        CHECK(lookup(names[i]) == &extra[i]);
+    }
+}
+
+int main(void)
+{
+    test_table_no_dup_no_missing();
+    test_lookup_exact();
+    test_add_duplicate();
+    test_table_full();
+
+    if (failed > 0) {
+        printf("%d check(s) failed\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
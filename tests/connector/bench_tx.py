@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2022 SAKURA internet Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+# $$TXを続けて送って、OTIDが返ってくるまでの時間からmessages/minuteを測る(pyserialが必要)
+#  接続先はsipf_standin.pyにしておく(prj.conf.local)
+#
+#  python3 tests/connector/bench_tx.py /dev/ttyACM0 --count 100
+#
+import argparse
+import time
+
+import serial
+
+
+def wait_result(port, timeout):
+    """
+    OKかNGの行まで読んで、OKならTrue
+    """
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        line = port.readline().strip()
+        if line == b"OK":
+            return True
+        if line == b"NG":
+            return False
+    raise TimeoutError("no response")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure $$TX messages/minute through the UART")
+    parser.add_argument("port")
+    parser.add_argument("--baudrate", type=int, default=115200)
+    parser.add_argument("--count", type=int, default=100)
+    parser.add_argument("--timeout", type=float, default=30.0)
+    args = parser.parse_args()
+
+    with serial.Serial(args.port, args.baudrate, timeout=1) as port:
+        port.reset_input_buffer()
+        ok = 0
+        t0 = time.monotonic()
+        for i in range(args.count):
+            # TAG_ID=0x01, UINT32
+            port.write(b"$$TX 01 04 %08X\r\n" % i)
+            if wait_result(port, args.timeout):
+                ok += 1
+        elapsed = time.monotonic() - t0
+    print("%d/%d messages in %.1f s: %.1f messages/minute" % (ok, args.count, elapsed, ok * 60 / elapsed))
+
+
+if __name__ == "__main__":
+    main()
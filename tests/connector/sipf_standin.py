@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2022 SAKURA internet Inc.
+#
+# SPDX-License-Identifier: MIT
+#
+# ローカルで動かすSIPF AUTH/CONNECTORの代わり(HTTPS, Keep-Alive)
+#  OBJECTS_UP(_RETRY)にはOBJID_NOTIFICATIONを、OBJECTS_DOWN_REQUESTには空のOBJECTS_DOWNを返す
+#  接続数・TLSハンドシェイク(セッション再利用)・メッセージ数を数えて、一定間隔でmessages/minuteを出す
+#
+#  python3 tests/connector/sipf_standin.py --host sipf-standin.example.com
+#  (最初にtests/connector/cert/に自己署名の証明書を作り、ファームウェアに組み込むCの文字列も書き出す)
+#
+import argparse
+import http.server
+import os
+import ssl
+import subprocess
+import threading
+import time
+
+CERT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "cert")
+
+OBJECTS_UP = 0x00
+OBJECTS_UP_RETRY = 0x01
+OBJID_NOTIFICATION = 0x02
+OBJECTS_DOWN_REQUEST = 0x11
+OBJECTS_DOWN = 0x12
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.connections = 0
+        self.resumed = 0
+        self.requests = 0
+        self.messages = 0
+        self.window_start = time.monotonic()
+        self.window_messages = 0
+
+    def add(self, **kw):
+        with self.lock:
+            for k, v in kw.items():
+                setattr(self, k, getattr(self, k) + v)
+            if "messages" in kw:
+                self.window_messages += kw["messages"]
+
+    def report(self):
+        with self.lock:
+            now = time.monotonic()
+            rate = self.window_messages * 60 / (now - self.window_start)
+            print(
+                "messages/minute: %.1f (total messages=%d requests=%d connections=%d tls_resumed=%d)"
+                % (rate, self.messages, self.requests, self.connections, self.resumed),
+                flush=True,
+            )
+            self.window_start = now
+            self.window_messages = 0
+
+
+stats = Stats()
+otid_seq = 0
+otid_lock = threading.Lock()
+
+
+def next_otid():
+    global otid_seq
+    with otid_lock:
+        otid_seq += 1
+        return otid_seq.to_bytes(16, "big")
+
+
+def command_header(command_type, payload_size):
+    # COMMAND_TYPE COMMAND_TIME(8) OPTION_FLAG PAYLOAD_SIZE(2)
+    return bytes([command_type]) + bytes(8) + bytes([0x00]) + payload_size.to_bytes(2, "big")
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # Keep-Alive
+    auth_path = "/v0/session_key"
+    connector_path = "/v0"
+
+    def setup(self):
+        super().setup()
+        resumed = 1 if getattr(self.connection, "session_reused", False) else 0
+        stats.add(connections=1, resumed=resumed)
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            super().log_message(fmt, *args)
+
+    def reply(self, status, body, content_type="application/octet-stream", close=False):
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        if close:
+            self.send_header("Connection", "close")
+            self.close_connection = True
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", "0"))
+        body = self.rfile.read(length)
+        stats.add(requests=1)
+
+        if self.path == self.auth_path:
+            # USERNAME\nPASSWORD\n
+            self.reply(200, b"standin\nstandin\n", "text/plain", close=True)
+            return
+        if (self.path != self.connector_path) or (len(body) < 12):
+            self.reply(404, b"", close=True)
+            return
+
+        command_type = body[0]
+        if command_type in (OBJECTS_UP, OBJECTS_UP_RETRY):
+            stats.add(messages=1)
+            # RESULT RESERVED OTID(16)
+            payload = bytes([0x00, 0x00]) + next_otid()
+            self.reply(200, command_header(OBJID_NOTIFICATION, len(payload)) + payload)
+        elif command_type == OBJECTS_DOWN_REQUEST:
+            # RESULT OTID(16) USER_SEND_DATETIME_MS(8) RECEIVED_DATETIME_MS(8) REMAINS RESERVED(1)
+            payload = bytes([0x00]) + bytes(16) + bytes(8) + bytes(8) + bytes([0x00, 0x00])
+            self.reply(200, command_header(OBJECTS_DOWN, len(payload)) + payload)
+        else:
+            self.reply(400, b"")
+
+
+def make_cert(host):
+    """
+    自己署名の証明書を作って、ファームウェアに組み込むCの文字列(standin.crt.inc)も書き出す
+    """
+    os.makedirs(CERT_DIR, exist_ok=True)
+    crt = os.path.join(CERT_DIR, "standin.crt")
+    key = os.path.join(CERT_DIR, "standin.key")
+    inc = os.path.join(CERT_DIR, "standin.crt.inc")
+    if not os.path.exists(crt):
+        san = ("IP:" if host.replace(".", "").isdigit() else "DNS:") + host
+        subprocess.run(
+            ["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-sha256", "-days", "365",
+             "-keyout", key, "-out", crt, "-subj", "/CN=" + host, "-addext", "subjectAltName=" + san],
+            check=True,
+            stderr=subprocess.DEVNULL,
+        )
+    with open(crt) as f, open(inc, "w") as out:
+        for line in f.read().splitlines():
+            out.write('"%s\\n"\n' % line)
+    return crt, key
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local stand-in for the SIPF AUTH/CONNECTOR endpoints")
+    parser.add_argument("--host", required=True, help="name the device connects to (certificate CN/SAN)")
+    parser.add_argument("--port", type=int, default=443)
+    parser.add_argument("--http", action="store_true", help="plain HTTP (CONFIG_SIPF_CONNECTOR_DISABLE_SSL)")
+    parser.add_argument("--auth-path", default=Handler.auth_path)
+    parser.add_argument("--connector-path", default=Handler.connector_path)
+    parser.add_argument("--interval", type=int, default=60, help="report interval in seconds")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    Handler.auth_path = args.auth_path
+    Handler.connector_path = args.connector_path
+    httpd = http.server.ThreadingHTTPServer(("", args.port), Handler)
+    httpd.verbose = args.verbose
+    if not args.http:
+        crt, key = make_cert(args.host)
+        ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        ctx.minimum_version = ssl.TLSVersion.TLSv1_2
+        ctx.load_cert_chain(crt, key)
+        httpd.socket = ctx.wrap_socket(httpd.socket, server_side=True)
+        print("certificate for the firmware: %s" % os.path.join(CERT_DIR, "standin.crt.inc"), flush=True)
+
+    def report():
+        while True:
+            time.sleep(args.interval)
+            stats.report()
+
+    threading.Thread(target=report, daemon=True).start()
+    print("listening on %s:%d (%s)" % (args.host, args.port, "http" if args.http else "https"), flush=True)
+    try:
+        httpd.serve_forever()
+    except KeyboardInterrupt:
+        stats.report()
+
+
+if __name__ == "__main__":
+    main()
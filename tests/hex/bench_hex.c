@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "hex.h"
+
+/*
+ * 255オブジェクトの$$RXの応答と同じ量の16進変換を、以前の実装とsrc/hex.cで比べる
+ *  以前: 1Byteごとにsprintf("%02X"), 受信はhexToUint8()(文字種ごとの分岐)
+ *  オブジェクトはTYPE TAG_ID VALUE_LEN VALUE(8Byte)
+ */
+#define BENCH_OBJ_CNT (255)
+#define BENCH_VALUE_LEN (8)
+#define BENCH_OBJ_SZ (3 + BENCH_VALUE_LEN)
+#define BENCH_REPEAT (2000)
+
+static uint8_t objs[BENCH_OBJ_CNT * BENCH_OBJ_SZ];
+static uint8_t hex[BENCH_OBJ_CNT * BENCH_OBJ_SZ * 2 + 1];
+static uint8_t dec[BENCH_OBJ_CNT * BENCH_OBJ_SZ];
+
+/* 以前のcmd_ascii.cのhexToUint8() */
+static uint8_t legacyHexToUint8(uint8_t *pchars, uint8_t *err)
+{
+    uint8_t ret = 0;
+    if (err) {
+        *err = 0;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if ((pchars[i] >= (uint8_t)'0') && (pchars[i] <= (uint8_t)'9')) {
+            ret |= (pchars[i] - (uint8_t)'0') << (i == 0 ? 4 : 0);
+        } else if ((pchars[i] >= (uint8_t)'a') && (pchars[i] <= (uint8_t)'f')) {
+            ret |= (pchars[i] - (uint8_t)'a' + 10) << (i == 0 ? 4 : 0);
+        } else if ((pchars[i] >= (uint8_t)'A') && (pchars[i] <= (uint8_t)'F')) {
+            ret |= (pchars[i] - (uint8_t)'A' + 10) << (i == 0 ? 4 : 0);
+        } else {
+            if (err) {
+                ret = 0;
+                *err = 0xff;
+            }
+        }
+    }
+    return ret;
+}
+
+static void legacy_encode(void)
+{
+    int idx = 0;
+    for (int i = 0; i < BENCH_OBJ_CNT; i++) {
+        const uint8_t *obj = &objs[i * BENCH_OBJ_SZ];
+        for (int j = 0; j < BENCH_OBJ_SZ; j++) {
+            idx += sprintf((char *)&hex[idx], "%02X", obj[j]);
+        }
+    }
+}
+
+static void hex_encode(void)
+{
+    size_t idx = 0;
+    for (int i = 0; i < BENCH_OBJ_CNT; i++) {
+        const uint8_t *obj = &objs[i * BENCH_OBJ_SZ];
+        // TYPE TAG_ID VALUE_LENは1Byteずつ、VALUEはまとめて変換する
+        idx += HexEncode(&hex[idx], &obj[0], 1);
+        idx += HexEncode(&hex[idx], &obj[1], 1);
+        idx += HexEncode(&hex[idx], &obj[2], 1);
+        idx += HexEncode(&hex[idx], &obj[3], BENCH_VALUE_LEN);
+    }
+}
+
+static int legacy_decode(void)
+{
+    uint8_t err;
+    for (size_t i = 0; i < sizeof(dec); i++) {
+        dec[i] = legacyHexToUint8(&hex[i * 2], &err);
+        if (err != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int hex_decode(void)
+{
+    for (int i = 0; i < BENCH_OBJ_CNT; i++) {
+        uint8_t *obj = &dec[i * BENCH_OBJ_SZ];
+        const uint8_t *src = &hex[i * BENCH_OBJ_SZ * 2];
+        for (int j = 0; j < 3; j++) {
+            int v = HexToUint8(&src[j * 2]);
+            if (v < 0) {
+                return -1;
+            }
+            obj[j] = v;
+        }
+        if (HexDecode(&obj[3], &src[6], BENCH_VALUE_LEN) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * BENCH_REPEAT回実行してバイト列の長さあたりの速度[Byte/us]を返す
+ */
+static double bench(const char *name, int (*func)(void), void (*vfunc)(void))
+{
+    double t0 = now_us();
+    for (int i = 0; i < BENCH_REPEAT; i++) {
+        if (func != NULL) {
+            if (func() != 0) {
+                printf("%s: failed\n", name);
+                return 0;
+            }
+        } else {
+            vfunc();
+        }
+    }
+    double elapsed = now_us() - t0;
+    double rate = (double)sizeof(objs) * BENCH_REPEAT / elapsed;
+    printf("%-16s %8.1f us/response %8.2f bytes/us\n", name, elapsed / BENCH_REPEAT, rate);
+    return rate;
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(objs); i++) {
+        objs[i] = (uint8_t)(i * 37 + 11);
+    }
+    printf("$RX response: %d objects, %d bytes -> %d hex chars\n", BENCH_OBJ_CNT, (int)sizeof(objs), (int)sizeof(objs) * 2);
+
+    double enc_old = bench("encode sprintf", NULL, legacy_encode);
+    double enc_new = bench("encode HexEncode", NULL, hex_encode);
+    double dec_old = bench("decode legacy", legacy_decode, NULL);
+    double dec_new = bench("decode HexDecode", hex_decode, NULL);
+
+    if (memcmp(dec, objs, sizeof(objs)) != 0) {
+        printf("round trip mismatch\n");
+        return 1;
+    }
+    printf("encode x%.1f, decode x%.1f\n", enc_new / enc_old, dec_new / dec_old);
+    return 0;
+}
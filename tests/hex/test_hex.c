@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hex.h"
+
+static int failed;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failed++; \
+        } \
+    } while (0)
+
+/**
+ * 全ての値がsprintf("%02X")と同じ文字になる
+ */
+static void test_encode_all_values(void)
+{
+    uint8_t src[256];
+    uint8_t dst[256 * 2 + 1];
+    char ref[3];
+
+    for (int i = 0; i < 256; i++) {
+        src[i] = i;
+    }
+    CHECK(HexEncode(dst, src, sizeof(src)) == sizeof(src) * 2);
+    CHECK(dst[sizeof(src) * 2] == '\0');
+    for (int i = 0; i < 256; i++) {
+        snprintf(ref, sizeof(ref), "%02X", i);
+        CHECK(memcmp(&dst[i * 2], ref, 2) == 0);
+    }
+}
+
+/**
+ * 4Byteずつの変換と端数の組み合わせ(0-9Byte)で往復する
+ */
+static void test_round_trip_tail(void)
+{
+    uint8_t src[9] = {0x00, 0x01, 0x7f, 0x80, 0xa5, 0x5a, 0xfe, 0xff, 0x3c};
+    uint8_t hex[sizeof(src) * 2 + 1];
+    uint8_t dec[sizeof(src)];
+
+    for (size_t len = 0; len <= sizeof(src); len++) {
+        memset(hex, 0xcc, sizeof(hex));
+        memset(dec, 0xcc, sizeof(dec));
+        CHECK(HexEncode(hex, src, len) == len * 2);
+        CHECK(hex[len * 2] == '\0');
+        CHECK(HexDecode(dec, hex, len) == 0);
+        CHECK(memcmp(dec, src, len) == 0);
+        if (len < sizeof(dec)) {
+            // lenより後ろは書かない
+            CHECK(dec[len] == 0xcc);
+        }
+    }
+}
+
+/**
+ * 小文字も受け付ける
+ */
+static void test_decode_lower(void)
+{
+    uint8_t dec[5];
+
+    CHECK(HexDecode(dec, (const uint8_t *)"0aBcDeF9fF", sizeof(dec)) == 0);
+    CHECK(memcmp(dec, "\x0a\xbc\xde\xf9\xff", sizeof(dec)) == 0);
+}
+
+/**
+ * 16進文字以外はどの位置にあっても-EINVAL(4Byteずつの部分と端数の部分)
+ */
+static void test_decode_invalid(void)
+{
+    const char *valid = "0123456789ABCDEF01";
+    const uint8_t bad[] = {'G', 'g', ' ', '\0', 0x80, 0xff, '/', ':', '@', '`'};
+    uint8_t buf[18];
+    uint8_t dec[9];
+
+    CHECK(HexDecode(dec, (const uint8_t *)valid, 9) == 0);
+    for (int pos = 0; pos < 18; pos++) {
+        for (size_t i = 0; i < sizeof(bad); i++) {
+            memcpy(buf, valid, sizeof(buf));
+            buf[pos] = bad[i];
+            CHECK(HexDecode(dec, buf, 9) == -EINVAL);
+        }
+    }
+}
+
+static void test_nibble(void)
+{
+    CHECK(HexNibble('0') == 0);
+    CHECK(HexNibble('9') == 9);
+    CHECK(HexNibble('A') == 10);
+    CHECK(HexNibble('f') == 15);
+    CHECK(HexNibble('G') == -EINVAL);
+    CHECK(HexNibble(0x00) == -EINVAL);
+    CHECK(HexToUint8((const uint8_t *)"7F") == 0x7f);
+    CHECK(HexToUint8((const uint8_t *)"ff") == 0xff);
+    CHECK(HexToUint8((const uint8_t *)"0x") == -EINVAL);
+    CHECK(HexToUint8((const uint8_t *)"x0") == -EINVAL);
+}
+
+int main(void)
+{
+    test_encode_all_values();
+    test_round_trip_tail();
+    test_decode_lower();
+    test_decode_invalid();
+    test_nibble();
+
+    if (failed > 0) {
+        printf("%d check(s) failed\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sipf/sipf_object.h"
+
+/*
+ * センサー値を送るようなOBJECTS_UPの組み立てを、SipfObjectCreateObjUpPayload()とビルダーで比べる
+ *  以前: 値をLittleEndianのバイト列にしてSipfObjectObjectの配列を作り、ペイロードに変換する
+ *  ビルダー: リクエストバッファに型ごとにBigEndianで直接書く
+ *  1メッセージはUINT32 INT16 FLOAT32 UINT64 FLOAT64 UINT8の組をBENCH_SET_CNT回
+ */
+#define BENCH_SET_CNT (8)
+#define BENCH_OBJ_CNT (BENCH_SET_CNT * 6)
+#define BENCH_REPEAT (200000)
+
+static SipfClientHttpCtx *ctx;
+static uint8_t ref[BUFF_SZ];
+static int ref_len;
+static volatile uint32_t seed = 1; // 定数畳み込みさせない
+
+typedef struct
+{
+    uint32_t u32;
+    int16_t i16;
+    float f32;
+    uint64_t u64;
+    double f64;
+    uint8_t u8;
+} BenchSet;
+
+static void bench_values(BenchSet *set, int i)
+{
+    uint32_t s = seed + i;
+    set->u32 = s * 2654435761u;
+    set->i16 = (int16_t)(s * 31);
+    set->f32 = (float)s * 0.25f;
+    set->u64 = (uint64_t)s << 33 | s;
+    set->f64 = (double)s * -0.125;
+    set->u8 = (uint8_t)s;
+}
+
+static int legacy_build(void)
+{
+    SipfObjectObject objs[BENCH_OBJ_CNT];
+    BenchSet sets[BENCH_SET_CNT];
+    uint16_t sz;
+
+    for (int i = 0; i < BENCH_SET_CNT; i++) {
+        BenchSet *set = &sets[i];
+        SipfObjectObject *o = &objs[i * 6];
+        bench_values(set, i);
+        // (ホストもnRF9160もLittleEndianなので値のアドレスをそのまま渡せる)
+        o[0] = (SipfObjectObject){OBJ_TYPE_UINT32, i * 6 + 0, sizeof(set->u32), (uint8_t *)&set->u32};
+        o[1] = (SipfObjectObject){OBJ_TYPE_INT16, i * 6 + 1, sizeof(set->i16), (uint8_t *)&set->i16};
+        o[2] = (SipfObjectObject){OBJ_TYPE_FLOAT32, i * 6 + 2, sizeof(set->f32), (uint8_t *)&set->f32};
+        o[3] = (SipfObjectObject){OBJ_TYPE_UINT64, i * 6 + 3, sizeof(set->u64), (uint8_t *)&set->u64};
+        o[4] = (SipfObjectObject){OBJ_TYPE_FLOAT64, i * 6 + 4, sizeof(set->f64), (uint8_t *)&set->f64};
+        o[5] = (SipfObjectObject){OBJ_TYPE_UINT8, i * 6 + 5, sizeof(set->u8), &set->u8};
+    }
+    uint8_t *payload = SipfObjClientGetObjUpPayloadBuff(ctx, &sz);
+    return SipfObjectCreateObjUpPayload(payload, sz, objs, BENCH_OBJ_CNT);
+}
+
+static int builder_build(void)
+{
+    SipfObjectBuilder builder;
+
+    SipfObjectBuilderBegin(&builder, ctx);
+    for (int i = 0; i < BENCH_SET_CNT; i++) {
+        BenchSet set;
+        bench_values(&set, i);
+        SipfObjectBuilderAddU32(&builder, i * 6 + 0, set.u32);
+        SipfObjectBuilderAddI16(&builder, i * 6 + 1, set.i16);
+        SipfObjectBuilderAddFloat32(&builder, i * 6 + 2, set.f32);
+        SipfObjectBuilderAddU64(&builder, i * 6 + 3, set.u64);
+        SipfObjectBuilderAddFloat64(&builder, i * 6 + 4, set.f64);
+        SipfObjectBuilderAddU8(&builder, i * 6 + 5, set.u8);
+    }
+    return (builder.err != 0) ? builder.err : builder.len;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * BENCH_REPEAT回組み立てて1メッセージあたりの時間[ns]を返す
+ */
+static double bench(const char *name, int (*build)(void))
+{
+    int len = 0;
+    double t0 = now_us();
+    for (int i = 0; i < BENCH_REPEAT; i++) {
+        len = build();
+        if (len < 0) {
+            printf("%s: failed %d\n", name, len);
+            return 0;
+        }
+    }
+    double ns = (now_us() - t0) * 1e3 / BENCH_REPEAT;
+    printf("%-24s %8.1f ns/message (%d bytes)\n", name, ns, len);
+    return ns;
+}
+
+int main(void)
+{
+    ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    printf("OBJECTS_UP: %d objects\n", BENCH_OBJ_CNT);
+
+    double ns_old = bench("CreateObjUpPayload", legacy_build);
+    ref_len = legacy_build();
+    memcpy(ref, SipfObjClientGetObjUpPayloadBuff(ctx, NULL), ref_len);
+    double ns_new = bench("SipfObjectBuilder", builder_build);
+
+    if ((builder_build() != ref_len) || (memcmp(ref, SipfObjClientGetObjUpPayloadBuff(ctx, NULL), ref_len) != 0)) {
+        printf("payload mismatch\n");
+        return 1;
+    }
+    printf("builder x%.1f\n", ns_old / ns_new);
+    SipfClientHttpCtxFree(ctx);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <string.h>
+
+#include "sipf/sipf_client_http.h"
+#include "sipf_client_http_stub.h"
+
+/*
+ * lib/sipf/src/sipf_client_http.cの代わり(ネットワークには出ない)
+ *  送信したリクエストを覚えておいて、OBJECTS_UPにはOBJID_NOTIFICATION(Result OK)を返す
+ */
+static SipfClientHttpCtx stub_ctx;
+static uint8_t stub_res_body[30];
+
+const uint8_t *stub_last_req;
+size_t stub_last_req_len;
+
+SipfClientHttpCtx *SipfClientHttpCtxAlloc(k_timeout_t timeout)
+{
+    (void)timeout;
+    memset(&stub_ctx, 0, sizeof(stub_ctx));
+    return &stub_ctx;
+}
+
+void SipfClientHttpCtxFree(SipfClientHttpCtx *ctx)
+{
+    (void)ctx;
+}
+
+char *SipfClientHttpGetAuthInfo(void)
+{
+    return "Authorization: Basic dGVzdDp0ZXN0\r\n";
+}
+
+int SipfClientHttpCtxRun(SipfClientHttpCtx *ctx, const char *hostname, bool tls)
+{
+    (void)hostname;
+    (void)tls;
+    stub_last_req = (const uint8_t *)ctx->req.payload;
+    stub_last_req_len = ctx->req.payload_len;
+
+    // COMMAND_HEADER(12) + RESULT(1) RESERVED(1) OTID(16)
+    memset(stub_res_body, 0, sizeof(stub_res_body));
+    stub_res_body[0] = 0x02; // OBJID_NOTIFICATION
+    for (int i = 0; i < 16; i++) {
+        stub_res_body[12 + 2 + i] = STUB_OTID_BASE + i;
+    }
+    strcpy(ctx->res.http_status, "OK");
+    ctx->res.http_status_code = 200;
+    ctx->res.content_length = sizeof(stub_res_body);
+    ctx->res.body_frag_start = stub_res_body;
+    ctx->res.body_frag_len = sizeof(stub_res_body);
+    return 0;
+}
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef SIPF_CLIENT_HTTP_STUB_H
+#define SIPF_CLIENT_HTTP_STUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STUB_OTID_BASE (0xa0) // 応答するOTIDはSTUB_OTID_BASEから1ずつ増える16Byte
+
+// 最後にSipfClientHttpCtxRun()したリクエストのペイロード(COMMAND_HEADERから)
+extern const uint8_t *stub_last_req;
+extern size_t stub_last_req_len;
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+/* ホストでlib/sipfをビルドするための最低限の代わり */
+#ifndef SIPF_TEST_STUB_KERNEL_H
+#define SIPF_TEST_STUB_KERNEL_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MSEC_PER_SEC (1000)
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+typedef struct
+{
+    int64_t ticks;
+} k_timeout_t;
+
+#define K_SECONDS(s) ((k_timeout_t){.ticks = (s)*MSEC_PER_SEC})
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef SIPF_TEST_STUB_LOG_H
+#define SIPF_TEST_STUB_LOG_H
+
+// ベンチマークの邪魔をしないようにログは捨てる
+#define LOG_MODULE_DECLARE(...)
+#define LOG_ERR(...) ((void)0)
+#define LOG_WRN(...) ((void)0)
+#define LOG_INF(...) ((void)0)
+#define LOG_DBG(...) ((void)0)
+#define LOG_HEXDUMP_DBG(...) ((void)0)
+
+#endif
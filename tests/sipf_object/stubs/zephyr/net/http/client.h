@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef SIPF_TEST_STUB_HTTP_CLIENT_H
+#define SIPF_TEST_STUB_HTTP_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum http_method { HTTP_GET = 1, HTTP_POST = 3 };
+
+struct http_request
+{
+    enum http_method method;
+    const char *url;
+    const char *host;
+    const char *payload;
+    size_t payload_len;
+    const char **header_fields;
+};
+
+struct http_response
+{
+    char http_status[32];
+    uint16_t http_status_code;
+    size_t content_length;
+    uint8_t *body_frag_start;
+    size_t body_frag_len;
+};
+
+#endif
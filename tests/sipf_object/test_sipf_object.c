@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2022 SAKURA internet Inc.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sipf/sipf_object.h"
+#include "sipf_client_http_stub.h"
+
+static int failed;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failed++; \
+        } \
+    } while (0)
+
+/**
+ * 型ごとのTYPE TAG_ID VALUE_LEN VALUE(BigEndian)
+ */
+static void test_builder_layout(void)
+{
+    static const uint8_t expected[] = {
+        OBJ_TYPE_UINT8,   0x01, 1, 0x12,
+        OBJ_TYPE_INT8,    0x02, 1, 0xfe,
+        OBJ_TYPE_UINT16,  0x03, 2, 0x12, 0x34,
+        OBJ_TYPE_INT16,   0x04, 2, 0xff, 0xfe,
+        OBJ_TYPE_UINT32,  0x05, 4, 0x12, 0x34, 0x56, 0x78,
+        OBJ_TYPE_INT32,   0x06, 4, 0x80, 0x00, 0x00, 0x00,
+        OBJ_TYPE_UINT64,  0x07, 8, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+        OBJ_TYPE_INT64,   0x08, 8, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+        OBJ_TYPE_FLOAT32, 0x09, 4, 0x3f, 0xc0, 0x00, 0x00,                         // 1.5f
+        OBJ_TYPE_FLOAT64, 0x0a, 8, 0xbf, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // -1.5
+        OBJ_TYPE_BIN,     0x0b, 3, 0xde, 0xad, 0x00,
+        OBJ_TYPE_STR_UTF8, 0x0c, 5, 'h', 'e', 'l', 'l', 'o',
+        OBJ_TYPE_STR_UTF8, 0x0d, 0,
+    };
+    static const uint8_t bin[] = {0xde, 0xad, 0x00};
+    SipfObjectBuilder builder;
+
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    CHECK(SipfObjectBuilderBegin(&builder, ctx) == 0);
+    CHECK(SipfObjectBuilderAddU8(&builder, 0x01, 0x12) == 0);
+    CHECK(SipfObjectBuilderAddI8(&builder, 0x02, -2) == 0);
+    CHECK(SipfObjectBuilderAddU16(&builder, 0x03, 0x1234) == 0);
+    CHECK(SipfObjectBuilderAddI16(&builder, 0x04, -2) == 0);
+    CHECK(SipfObjectBuilderAddU32(&builder, 0x05, 0x12345678) == 0);
+    CHECK(SipfObjectBuilderAddI32(&builder, 0x06, INT32_MIN) == 0);
+    CHECK(SipfObjectBuilderAddU64(&builder, 0x07, 0x0123456789abcdefULL) == 0);
+    CHECK(SipfObjectBuilderAddI64(&builder, 0x08, -2) == 0);
+    CHECK(SipfObjectBuilderAddFloat32(&builder, 0x09, 1.5f) == 0);
+    CHECK(SipfObjectBuilderAddFloat64(&builder, 0x0a, -1.5) == 0);
+    CHECK(SipfObjectBuilderAddBin(&builder, 0x0b, bin, sizeof(bin)) == 0);
+    CHECK(SipfObjectBuilderAddStr(&builder, 0x0c, "hello") == 0);
+    CHECK(SipfObjectBuilderAddStr(&builder, 0x0d, "") == 0);
+
+    CHECK(builder.err == 0);
+    CHECK(builder.len == sizeof(expected));
+    CHECK(memcmp(builder.buff, expected, sizeof(expected)) == 0);
+    SipfClientHttpCtxFree(ctx);
+}
+
+/**
+ * SipfObjectCreateObjUpPayload()(VALUEはLittleEndianで渡す)と同じバイト列になる
+ */
+static void test_builder_same_as_create_payload(void)
+{
+    uint8_t v_u16[] = {0x34, 0x12};
+    uint8_t v_u32[] = {0x78, 0x56, 0x34, 0x12};
+    uint8_t v_f32[] = {0x00, 0x00, 0xc0, 0x3f};
+    uint8_t v_u64[] = {0xef, 0xcd, 0xab, 0x89, 0x67, 0x45, 0x23, 0x01};
+    uint8_t v_str[] = {'a', 'b', 'c'};
+    SipfObjectObject objs[] = {
+        {OBJ_TYPE_UINT16, 0x10, sizeof(v_u16), v_u16},
+        {OBJ_TYPE_UINT32, 0x11, sizeof(v_u32), v_u32},
+        {OBJ_TYPE_FLOAT32, 0x12, sizeof(v_f32), v_f32},
+        {OBJ_TYPE_UINT64, 0x13, sizeof(v_u64), v_u64},
+        {OBJ_TYPE_STR_UTF8, 0x14, sizeof(v_str), v_str},
+    };
+    uint8_t ref[64];
+    SipfObjectBuilder builder;
+
+    int len = SipfObjectCreateObjUpPayload(ref, sizeof(ref), objs, sizeof(objs) / sizeof(objs[0]));
+    CHECK(len > 0);
+
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    SipfObjectBuilderBegin(&builder, ctx);
+    SipfObjectBuilderAddU16(&builder, 0x10, 0x1234);
+    SipfObjectBuilderAddU32(&builder, 0x11, 0x12345678);
+    SipfObjectBuilderAddFloat32(&builder, 0x12, 1.5f);
+    SipfObjectBuilderAddU64(&builder, 0x13, 0x0123456789abcdefULL);
+    SipfObjectBuilderAddStr(&builder, 0x14, "abc");
+    CHECK(builder.len == len);
+    CHECK(memcmp(builder.buff, ref, len) == 0);
+    SipfClientHttpCtxFree(ctx);
+}
+
+/**
+ * 入り切らなければ-ENOMEMが残って、以降の追加もFinish()も失敗する(書いた分は変えない)
+ */
+static void test_builder_enomem_sticky(void)
+{
+    uint8_t bin[255];
+    SipfObjectBuilder builder;
+    SipfObjectOtid otid;
+
+    memset(bin, 0x55, sizeof(bin));
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    SipfObjectBuilderBegin(&builder, ctx);
+    int added = 0;
+    while (SipfObjectBuilderAddBin(&builder, 0x20, bin, sizeof(bin)) == 0) {
+        added++;
+    }
+    CHECK(added == builder.sz / (3 + sizeof(bin)));
+    CHECK(builder.err == -ENOMEM);
+    uint16_t len = builder.len;
+    CHECK(len == added * (3 + sizeof(bin)));
+
+    // 小さいオブジェクトなら入る大きさでも追加しない
+    CHECK(builder.sz - len >= 3 + 1);
+    CHECK(SipfObjectBuilderAddU8(&builder, 0x21, 0x01) == -ENOMEM);
+    CHECK(SipfObjectBuilderAddStr(&builder, 0x22, "x") == -ENOMEM);
+    CHECK(builder.len == len);
+
+    stub_last_req = NULL;
+    CHECK(SipfObjectBuilderFinish(&builder, &otid) == -ENOMEM);
+    CHECK(stub_last_req == NULL); // 送信しない
+    SipfClientHttpCtxFree(ctx);
+}
+
+/**
+ * 255Byteを超える文字列は-EINVAL(VALUE_LENに書けない)、255Byteちょうどは書ける
+ */
+static void test_builder_str_too_long(void)
+{
+    char str[257];
+    SipfObjectBuilder builder;
+    SipfObjectOtid otid;
+
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    SipfObjectBuilderBegin(&builder, ctx);
+
+    memset(str, 'a', 255);
+    str[255] = '\0';
+    CHECK(SipfObjectBuilderAddStr(&builder, 0x30, str) == 0);
+    CHECK(builder.len == 3 + 255);
+    CHECK(builder.buff[2] == 255);
+
+    memset(str, 'b', 256);
+    str[256] = '\0';
+    CHECK(SipfObjectBuilderAddStr(&builder, 0x31, str) == -EINVAL);
+    CHECK(builder.len == 3 + 255);
+    CHECK(SipfObjectBuilderAddU8(&builder, 0x32, 0x01) == -EINVAL);
+    CHECK(builder.len == 3 + 255);
+
+    // 後からバッファが足りなくなってもerrは最初の-EINVALのまま
+    uint8_t bin[255] = {0};
+    for (int i = 0; i < 8; i++) {
+        CHECK(SipfObjectBuilderAddBin(&builder, 0x33, bin, sizeof(bin)) == -EINVAL);
+    }
+    CHECK(SipfObjectBuilderFinish(&builder, &otid) == -EINVAL);
+    SipfClientHttpCtxFree(ctx);
+}
+
+/**
+ * Finish()はCOMMAND_HEADERを付けてペイロード領域をそのまま送り、OTIDを返す
+ */
+static void test_builder_finish(void)
+{
+    SipfObjectBuilder builder;
+    SipfObjectOtid otid;
+
+    SipfClientHttpCtx *ctx = SipfClientHttpCtxAlloc(SIPF_HTTP_CTX_TIMEOUT);
+    SipfObjectBuilderBegin(&builder, ctx);
+    SipfObjectBuilderAddU32(&builder, 0x40, 0xcafebabe);
+    memset(&otid, 0, sizeof(otid));
+    CHECK(SipfObjectBuilderFinish(&builder, &otid) == 0);
+
+    CHECK(stub_last_req_len == 12 + 3 + 4);
+    CHECK(stub_last_req[0] == OBJECTS_UP);
+    CHECK(stub_last_req[10] == 0x00);
+    CHECK(stub_last_req[11] == 3 + 4);
+    CHECK(memcmp(&stub_last_req[12], "\x04\x40\x04\xca\xfe\xba\xbe", 7) == 0);
+    for (int i = 0; i < 16; i++) {
+        CHECK(otid.value[i] == STUB_OTID_BASE + i);
+    }
+    SipfClientHttpCtxFree(ctx);
+}
+
+int main(void)
+{
+    test_builder_layout();
+    test_builder_same_as_create_payload();
+    test_builder_enomem_sticky();
+    test_builder_str_too_long();
+    test_builder_finish();
+
+    if (failed > 0) {
+        printf("%d check(s) failed\n", failed);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}